@@ -96,6 +96,17 @@ static void print_hints(struct dictionary *dict, wchar_t *word)
 	word_list_done(&list);
 }
 
+/** Wypisuje pamięć zajmowaną przez wczytaną część słownika.
+ @param[in] dict Obsługiwany słownik.
+ */
+static void print_stats(struct dictionary *dict)
+{
+	struct dictionary_stats stats;
+	dictionary_stats(dict, &stats);
+	fprintf(stderr, "nodes: %zu, pending subtrees: %zu, memory: %zu B\n",
+			stats.nodes, stats.pending, stats.bytes);
+}
+
 /** Funkcja przetwarza słowo z stdin i odpowiednio wypisuje z powrotem na stdout.
  @param[in] buf Przetwarzane słowo.
  @param[in] bytesRead Długość wczytanego słowa.
@@ -198,21 +209,19 @@ int main(int argc, char * const argv[])
 
 	/* otwórz plik słownika i wczytuj dane z stdin */
 	int param = (option_set ? WITH_OPT - 1 : WITHOUT_OPT - 1);
-	FILE *fp;
-	fp = fopen(argv[param], "r");
-	if (!fp) {
+	if (access(argv[param], R_OK) != 0) {
 		perror(argv[param]);
 		exit(EXIT_FAILURE);
 	}
 	struct dictionary *dict;
-	dict = dictionary_load(fp);
+	dict = dictionary_load_file(argv[param]);
 	if (dict == NULL) {
-		fclose(fp);
 		fprintf(stderr, "%s: Empty file. Exiting...\n", argv[param]);
 		exit(EXIT_FAILURE);
 	}
 	process_input(dict);
-	fclose(fp);
+	if (option_set)
+		print_stats(dict);
 	dictionary_done(dict);
 
 	return 0;
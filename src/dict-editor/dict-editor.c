@@ -37,6 +37,7 @@ enum Command {
     LOAD,
     QUIT,
     CLEAR,
+    IMPORT,
     COMMANDS_COUNT };
 
 
@@ -52,7 +53,8 @@ static const char *commands[] =
     "save",
     "load",
     "quit",
-    "clear"
+    "clear",
+    "import"
 };
 
 /** Maksymalna długość komendy.
@@ -211,6 +213,19 @@ static int file_command(struct dictionary **dict, enum Command c)
                 *dict = new_dict;
                 break;
             }
+        case IMPORT:
+            {
+                struct dictionary *new_dict = dictionary_import(filename);
+                if (!new_dict)
+                {
+                    fprintf(stderr, "Failed to import dictionary\n");
+                    exit(1);
+                }
+                printf("dictionary imported from file %s\n", filename);
+                dictionary_done(*dict);
+                *dict = new_dict;
+                break;
+            }
         default:
             assert(false);
     }
@@ -273,20 +288,9 @@ int main(void)
 {
     setlocale(LC_ALL, "pl_PL.UTF-8");
     struct dictionary *dict = dictionary_new();
-    dictionary_rule_add(dict, L"\0", L"\0", false, 2, RULE_SPLIT);
-    dictionary_rule_add(dict, L"\0", L"\0", false, 2, RULE_NORMAL);
-    dictionary_rule_add(dict, L"a", L"ą", true, 1, RULE_NORMAL);
-    dictionary_rule_add(dict, L"01", L"10", false, 2, RULE_NORMAL);
-    dictionary_rule_add(dict, L"0", L"1", false, 2, RULE_NORMAL);
-    dictionary_rule_add(dict, L"0", L"12", false, 2, RULE_NORMAL);
-    dictionary_rule_add(dict, L"\0", L"1", false, 1, RULE_NORMAL);
 
     do {} while (try_process_command(&dict));
-    dictionary_save_lang(dict, "kupa");
     if (dict != NULL)
-    	dictionary_done(dict);
-    dict = dictionary_load_lang("kupa");
-    fprintf(stderr, "loaded\n");
-    dictionary_done(dict);
+        dictionary_done(dict);
     return 0;
 }
@@ -0,0 +1,186 @@
+/** @file
+ Implementacja alokatora przyrostowego (arena).
+
+ @ingroup dictionary
+ @author Maja Zalewska <mz336088@students.mimuw.edu.pl>
+ @copyright Uniwerstet Warszawski
+ @date 2015-06-14
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "arena.h"
+
+#define ARENA_CHUNK	(1 << 16)	///< Domyślny rozmiar bloku.
+#define ARENA_KEEP	(1 << 20)	///< Liczba bajtów zachowywanych przy arena_reset().
+#define ARENA_ALIGN	(sizeof(union arena_align))	///< Wyrównanie przydzielanej pamięci.
+
+/// Typy o największym wyrównaniu, tak jak pamięć z malloc().
+union arena_align
+{
+	long double number;	///< Liczba zmiennoprzecinkowa.
+	long long integer;	///< Liczba całkowita.
+	void *pointer;	///< Wskaźnik.
+};
+
+/// Blok pamięci areny.
+struct arena_chunk
+{
+	struct arena_chunk *next;	///< Następny blok.
+	size_t size;	///< Rozmiar danych bloku.
+	size_t used;	///< Liczba przydzielonych bajtów.
+	union arena_align data[];	///< Dane bloku.
+};
+
+/// Klucz areny bieżącego wątku.
+static pthread_key_t thread_key;
+/// Zapewnia jednokrotne utworzenie thread_key.
+static pthread_once_t thread_once = PTHREAD_ONCE_INIT;
+
+/** @name Funkcje pomocnicze
+ @{
+ */
+
+/**
+	Tworzy nowy blok.
+	@param[in] size Minimalny rozmiar danych bloku.
+	@return Nowy blok, NULL jeśli zabrakło pamięci.
+ */
+static struct arena_chunk *chunk_new(size_t size)
+{
+	if (size < ARENA_CHUNK)
+		size = ARENA_CHUNK;
+	struct arena_chunk *chunk = malloc(sizeof(struct arena_chunk) + size);
+	if (chunk == NULL)
+		return NULL;
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+/**
+	Zwalnia arenę kończącego się wątku.
+	@param[in] arg Arena wątku.
+ */
+static void thread_arena_free(void *arg)
+{
+	arena_done(arg);
+	free(arg);
+}
+
+/// Tworzy klucz areny wątku.
+static void thread_key_create(void)
+{
+	pthread_key_create(&thread_key, thread_arena_free);
+}
+
+/// @}
+
+/** @name Elementy interfejsu
+ @{
+ */
+
+void arena_init(struct arena *arena)
+{
+	arena->first = NULL;
+	arena->current = NULL;
+	arena->used = 0;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+	struct arena_chunk *chunk = arena->current;
+	while (chunk != NULL && chunk->used + size > chunk->size)
+	{
+		// Następne bloki są puste od ostatniego arena_reset().
+		if (chunk->next == NULL || chunk->next->size < size)
+		{
+			struct arena_chunk *fresh = chunk_new(size);
+			if (fresh == NULL)
+				return NULL;
+			fresh->next = chunk->next;
+			chunk->next = fresh;
+		}
+		chunk = chunk->next;
+	}
+	if (chunk == NULL)
+	{
+		if ((chunk = arena->first = chunk_new(size)) == NULL)
+			return NULL;
+	}
+	arena->current = chunk;
+	arena->used += size;
+	void *ptr = (char *) chunk->data + chunk->used;
+	chunk->used += size;
+	return ptr;
+}
+
+wchar_t *arena_wcsndup(struct arena *arena, const wchar_t *str, size_t len)
+{
+	size_t n = wcsnlen(str, len);
+	wchar_t *copy = arena_alloc(arena, sizeof(wchar_t) * (n + 1));
+	if (copy != NULL)
+	{
+		wmemcpy(copy, str, n);
+		copy[n] = L'\0';
+	}
+	return copy;
+}
+
+size_t arena_used(const struct arena *arena)
+{
+	return arena->used;
+}
+
+void arena_reset(struct arena *arena)
+{
+	size_t kept = 0;
+	struct arena_chunk **link = &arena->first;
+	while (*link != NULL)
+	{
+		struct arena_chunk *chunk = *link;
+		if (kept + chunk->size > ARENA_KEEP && kept > 0)
+		{
+			*link = chunk->next;
+			free(chunk);
+			continue;
+		}
+		kept += chunk->size;
+		chunk->used = 0;
+		link = &chunk->next;
+	}
+	arena->current = arena->first;
+	arena->used = 0;
+}
+
+void arena_done(struct arena *arena)
+{
+	while (arena->first != NULL)
+	{
+		struct arena_chunk *next = arena->first->next;
+		free(arena->first);
+		arena->first = next;
+	}
+	arena->current = NULL;
+	arena->used = 0;
+}
+
+struct arena *arena_thread(void)
+{
+	pthread_once(&thread_once, thread_key_create);
+	struct arena *arena = pthread_getspecific(thread_key);
+	if (arena == NULL && (arena = malloc(sizeof(struct arena))) != NULL)
+	{
+		arena_init(arena);
+		pthread_setspecific(thread_key, arena);
+	}
+	return arena;
+}
+
+/**
+ @}
+ */
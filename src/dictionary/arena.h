@@ -0,0 +1,84 @@
+/** @file
+    Interfejs alokatora przyrostowego (arena).
+    Pamięć przydzielana jest kolejno z dużych bloków i zwalniana
+    naraz dla całej areny, co nadaje się do danych żyjących tylko
+    w czasie jednego zapytania, np. stanów wyszukiwania podpowiedzi.
+
+    @ingroup dictionary
+    @author Maja Zalewska <mz336088@students.mimuw.edu.pl>
+    @copyright Uniwerstet Warszawski
+    @date 2015-06-14
+ */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+#include <wchar.h>
+
+struct arena_chunk;	///< Blok pamięci areny. Patrz arena.c
+
+/// Arena: lista bloków, z których kolejno przydzielana jest pamięć.
+struct arena
+{
+	struct arena_chunk *first;	///< Pierwszy blok.
+	struct arena_chunk *current;	///< Blok, z którego obecnie przydzielamy.
+	size_t used;	///< Liczba bajtów przydzielonych od ostatniego arena_reset().
+};
+
+/**
+	Inicjuje pustą arenę.
+	@param[out] arena Arena.
+ */
+void arena_init(struct arena *arena);
+
+/**
+	Przydziela pamięć z areny.
+	Pamięć jest wyrównana jak dla malloc() i ważna do arena_reset().
+	@param[in,out] arena Arena.
+	@param[in] size Liczba bajtów.
+	@return Przydzielona pamięć, NULL jeśli zabrakło pamięci.
+ */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/**
+	Kopiuje co najwyżej len znaków słowa do areny.
+	@param[in,out] arena Arena.
+	@param[in] str Kopiowane słowo.
+	@param[in] len Maksymalna liczba kopiowanych znaków.
+	@return Kopia słowa zakończona L'\0'.
+ */
+wchar_t *arena_wcsndup(struct arena *arena, const wchar_t *str, size_t len);
+
+/**
+	Zwraca liczbę bajtów przydzielonych z areny od ostatniego arena_reset(),
+	razem z wyrównaniem.
+	@param[in] arena Arena.
+	@return Liczba bajtów.
+ */
+size_t arena_used(const struct arena *arena);
+
+/**
+	Zwalnia naraz całą pamięć przydzieloną z areny.
+	Bloki są zachowywane do ponownego użycia, poza nadmiarem
+	ponad ARENA_KEEP bajtów.
+	@param[in,out] arena Arena.
+ */
+void arena_reset(struct arena *arena);
+
+/**
+	Zwalnia wszystkie bloki areny.
+	@param[in,out] arena Arena.
+ */
+void arena_done(struct arena *arena);
+
+/**
+	Zwraca arenę bieżącego wątku.
+	Arena jest tworzona przy pierwszym użyciu i zwalniana po zakończeniu
+	wątku. Kolejne zapytania w tym samym wątku korzystają z tych samych
+	bloków, więc powinny kończyć się wywołaniem arena_reset().
+	@return Arena bieżącego wątku.
+ */
+struct arena *arena_thread(void);
+
+#endif /* ARENA_H_ */
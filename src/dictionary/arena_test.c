@@ -0,0 +1,73 @@
+/** @file
+	Test do alokatora arena.
+	@ingroup tests
+	@date: 14 June 2015
+	@author: Maja Zalewska <mz336088@mimuw.edu.pl>
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <cmocka.h>
+#include "arena.h"
+
+/// Sprawdza wyrównanie i rozłączność przydzielanej pamięci.
+static void arena_alloc_test(void **state)
+{
+	struct arena arena;
+	arena_init(&arena);
+	char *a = arena_alloc(&arena, 3);
+	long double *b = arena_alloc(&arena, sizeof(long double));
+	assert_non_null(a);
+	assert_non_null(b);
+	assert_int_equal((uintptr_t) b % sizeof(long double), 0);
+	assert_true((char *) b >= a + 3);
+	// Większe od bloku przydziały dostają osobny blok.
+	char *big = arena_alloc(&arena, 1 << 20);
+	assert_non_null(big);
+	big[(1 << 20) - 1] = 'x';
+	wchar_t *word = arena_wcsndup(&arena, L"abrakadabra", 4);
+	assert_int_equal(wcscmp(word, L"abra"), 0);
+	arena_done(&arena);
+	assert_null(arena.first);
+}
+
+/// Sprawdza, czy po arena_reset() pamięć jest używana ponownie.
+static void arena_reset_test(void **state)
+{
+	struct arena arena;
+	arena_init(&arena);
+	void *first = arena_alloc(&arena, 16);
+	for (int i = 0; i < 10000; i++)
+		assert_non_null(arena_alloc(&arena, 64));
+	assert_true(arena_used(&arena) >= 16 + 10000 * 64);
+	arena_reset(&arena);
+	assert_int_equal(arena_used(&arena), 0);
+	assert_true(arena_alloc(&arena, 16) == first);
+	arena_done(&arena);
+}
+
+/// Sprawdza arenę wątku.
+static void arena_thread_test(void **state)
+{
+	struct arena *arena = arena_thread();
+	assert_non_null(arena);
+	assert_true(arena_thread() == arena);
+	assert_non_null(arena_alloc(arena, 100));
+	arena_reset(arena);
+}
+
+/// Wywołuje testy.
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(arena_alloc_test),
+		cmocka_unit_test(arena_reset_test),
+		cmocka_unit_test(arena_thread_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
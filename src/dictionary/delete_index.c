@@ -0,0 +1,715 @@
+/** @file
+ Implementacja indeksu wariantów słów po usunięciu liter.
+
+ Warianty nie są przechowywane, tablica trzyma tylko ich skróty i listy
+ słów. Kolizja skrótów daje co najwyżej dodatkowych kandydatów, których
+ i tak odrzuca sprawdzenie odległości.
+
+ @ingroup dictionary
+ @author Maja Zalewska <mz336088@students.mimuw.edu.pl>
+ @copyright Uniwerstet Warszawski
+ @date 2015-06-18
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "delete_index.h"
+
+#define INDEX_MAGIC	"DELIDX02"	///< Znacznik początku pliku indeksu, zawiera wersję formatu.
+#define MAGIC_LEN	8	///< Długość znacznika.
+#define TABLE_SIZE	1024	///< Początkowy rozmiar tablicy skrótów.
+#define WORDS_SIZE	64	///< Początkowy rozmiar tablicy słów.
+#define IDS_SIZE	4	///< Początkowy rozmiar listy słów wariantu.
+#define CANDIDATES_SIZE	64	///< Początkowy rozmiar tablicy kandydatów.
+#define FNV_OFFSET	14695981039346656037ULL	///< Początkowa wartość skrótu FNV-1a.
+#define FNV_PRIME	1099511628211ULL	///< Mnożnik skrótu FNV-1a.
+
+/// Wariant w tablicy skrótów.
+struct index_entry
+{
+	uint64_t hash;	///< Skrót wariantu, 0 oznacza wolne miejsce.
+	uint32_t count;	///< Liczba słów wariantu.
+	uint32_t capacity;	///< Rozmiar tablicy ids, 0 jeśli jedyne słowo jest w id.
+	/// Słowa wariantu.
+	union
+	{
+		uint32_t id;	///< Jedyne słowo, jeśli capacity == 0.
+		uint32_t *ids;	///< Tablica słów, jeśli capacity > 0.
+	} words;
+};
+
+/// Indeks wariantów słów.
+struct delete_index
+{
+	struct index_entry *table;	///< Tablica skrótów z adresowaniem otwartym.
+	size_t capacity;	///< Rozmiar tablicy, potęga dwójki.
+	size_t size;	///< Liczba zajętych miejsc w tablicy.
+	wchar_t **words;	///< Słowa według identyfikatorów, NULL dla usuniętych.
+	uint32_t words_len;	///< Liczba użytych identyfikatorów.
+	uint32_t words_max;	///< Rozmiar tablic words i free_ids.
+	uint32_t *free_ids;	///< Identyfikatory usuniętych słów do ponownego użycia.
+	uint32_t free_len;	///< Liczba wolnych identyfikatorów.
+	int max_distance;	///< Największa liczba usuwanych liter.
+};
+
+/// Nagłówek pliku indeksu.
+struct index_header
+{
+	char magic[MAGIC_LEN];	///< Znacznik INDEX_MAGIC.
+	struct dict_image_key key;	///< Klucz pliku słownika.
+	uint32_t max_distance;	///< Największa liczba usuwanych liter.
+	uint32_t words;	///< Liczba słów.
+	uint32_t entries;	///< Liczba niepustych wariantów.
+};
+
+/// Funkcja wywoływana dla skrótu każdego wariantu słowa.
+typedef int variant_callback(uint64_t hash, void *data);
+
+/// Dane dodawania i usuwania słowa.
+struct word_update
+{
+	struct delete_index *index;	///< Indeks.
+	uint32_t id;	///< Identyfikator słowa.
+};
+
+/// Kandydaci zebrani przez delete_index_lookup().
+struct candidates
+{
+	const struct delete_index *index;	///< Indeks.
+	uint32_t *ids;	///< Identyfikatory kandydatów, z powtórzeniami.
+	size_t len;	///< Liczba kandydatów.
+	size_t max;	///< Rozmiar tablicy ids.
+	struct arena *arena;	///< Arena zapytania.
+};
+
+/** @name Funkcje pomocnicze
+ @{
+ */
+
+/**
+	Liczy skrót wariantu słowa.
+	@param[in] word Słowo.
+	@param[in] len Długość słowa.
+	@param[in] deleted Które litery są usunięte.
+	@return Skrót, różny od 0.
+ */
+static uint64_t variant_hash(const wchar_t *word, size_t len, const bool *deleted)
+{
+	uint64_t hash = FNV_OFFSET;
+	for (size_t i = 0; i < len; i++)
+	{
+		if (deleted[i])
+			continue;
+		hash ^= (uint32_t) word[i];
+		hash *= FNV_PRIME;
+	}
+	return hash != 0 ? hash : 1;
+}
+
+/**
+	Wywołuje funkcję dla skrótów wszystkich wariantów słowa, w których
+	usunięto co najwyżej left liter na pozycjach od from.
+	Ten sam wariant może się powtórzyć, jeśli słowo ma powtórzone litery.
+	@param[in] word Słowo.
+	@param[in] len Długość słowa.
+	@param[in] from Pierwsza pozycja, z której można usunąć literę.
+	@param[in] left Liczba liter, które można jeszcze usunąć.
+	@param[in,out] deleted Które litery są usunięte.
+	@param[in] callback Funkcja wywoływana dla każdego wariantu.
+	@param[in,out] data Dane przekazywane do funkcji callback.
+	@return 0 jeśli się udało, wynik funkcji callback, jeśli był niezerowy.
+ */
+static int for_each_variant(const wchar_t *word, size_t len, size_t from, int left,
+		bool *deleted, variant_callback *callback, void *data)
+{
+	int result = callback(variant_hash(word, len, deleted), data);
+	for (size_t i = from; result == 0 && left > 0 && i < len; i++)
+	{
+		deleted[i] = true;
+		result = for_each_variant(word, len, i + 1, left - 1, deleted, callback, data);
+		deleted[i] = false;
+	}
+	return result;
+}
+
+/**
+	Wywołuje funkcję dla skrótów wszystkich wariantów słowa.
+	@param[in] word Słowo.
+	@param[in] max_distance Największa liczba usuwanych liter.
+	@param[in] callback Funkcja wywoływana dla każdego wariantu.
+	@param[in,out] data Dane przekazywane do funkcji callback.
+	@return 0 jeśli się udało, wynik funkcji callback, jeśli był niezerowy.
+ */
+static int variants(const wchar_t *word, int max_distance,
+		variant_callback *callback, void *data)
+{
+	size_t len = wcslen(word);
+	bool deleted[len + 1];
+	memset(deleted, 0, sizeof(deleted));
+	return for_each_variant(word, len, 0, max_distance, deleted, callback, data);
+}
+
+/**
+	Zwraca miejsce w tablicy dla skrótu: zajęte przez ten skrót albo
+	pierwsze wolne.
+	@param[in] table Tablica.
+	@param[in] capacity Rozmiar tablicy.
+	@param[in] hash Skrót.
+	@return Miejsce w tablicy.
+ */
+static struct index_entry *find_entry(struct index_entry *table, size_t capacity,
+		uint64_t hash)
+{
+	size_t i = hash & (capacity - 1);
+	while (table[i].hash != 0 && table[i].hash != hash)
+		i = (i + 1) & (capacity - 1);
+	return &table[i];
+}
+
+/**
+	Powiększa tablicę skrótów tak, żeby zmieściła size wariantów
+	przy wypełnieniu poniżej 3/4.
+	@param[in,out] index Indeks.
+	@param[in] size Liczba wariantów.
+	@return 0 jeśli się udało, -1 jeśli zabrakło pamięci.
+ */
+static int reserve_entries(struct delete_index *index, size_t size)
+{
+	size_t capacity = index->capacity;
+	while (4 * size > 3 * capacity)
+		capacity *= 2;
+	if (capacity == index->capacity)
+		return 0;
+	struct index_entry *table = calloc(capacity, sizeof(struct index_entry));
+	if (table == NULL)
+		return -1;
+	for (size_t i = 0; i < index->capacity; i++)
+	{
+		if (index->table[i].hash != 0)
+			*find_entry(table, capacity, index->table[i].hash) = index->table[i];
+	}
+	free(index->table);
+	index->table = table;
+	index->capacity = capacity;
+	return 0;
+}
+
+/**
+	Zwraca wariant o danym skrócie, dodając go do tablicy, jeśli go nie ma.
+	@param[in,out] index Indeks.
+	@param[in] hash Skrót.
+	@return Wariant, NULL jeśli zabrakło pamięci.
+ */
+static struct index_entry *get_entry(struct delete_index *index, uint64_t hash)
+{
+	if (reserve_entries(index, index->size + 1) != 0)
+		return NULL;
+	struct index_entry *entry = find_entry(index->table, index->capacity, hash);
+	if (entry->hash == 0)
+	{
+		entry->hash = hash;
+		index->size++;
+	}
+	return entry;
+}
+
+/**
+	Zwraca tablicę słów wariantu.
+	@param[in] entry Wariant.
+	@return Tablica słów.
+ */
+static uint32_t *entry_ids(struct index_entry *entry)
+{
+	return entry->capacity > 0 ? entry->words.ids : &entry->words.id;
+}
+
+/**
+	Dodaje słowo do wariantu.
+	Słowo jest dodawane raz, nawet jeśli ma kilka równych wariantów,
+	bo wszystkie warianty słowa są dodawane jeden po drugim.
+	@param[in,out] entry Wariant.
+	@param[in] id Identyfikator słowa.
+	@return 0 jeśli się udało, -1 jeśli zabrakło pamięci.
+ */
+static int entry_add(struct index_entry *entry, uint32_t id)
+{
+	uint32_t *ids = entry_ids(entry);
+	if (entry->count > 0 && ids[entry->count - 1] == id)
+		return 0;
+	if (entry->count == (entry->capacity > 0 ? entry->capacity : 1))
+	{
+		uint32_t capacity = entry->capacity > 0 ? entry->capacity * 2 : IDS_SIZE;
+		ids = realloc(entry->capacity > 0 ? entry->words.ids : NULL,
+				sizeof(uint32_t) * capacity);
+		if (ids == NULL)
+			return -1;
+		if (entry->capacity == 0)
+			ids[0] = entry->words.id;
+		entry->words.ids = ids;
+		entry->capacity = capacity;
+	}
+	ids[entry->count++] = id;
+	return 0;
+}
+
+/**
+	Dodaje słowo do wariantu o danym skrócie.
+	@param[in] hash Skrót wariantu.
+	@param[in] data Dodawane słowo, struct word_update.
+	@return 0 jeśli się udało, -1 jeśli zabrakło pamięci.
+ */
+static int add_variant(uint64_t hash, void *data)
+{
+	struct word_update *update = data;
+	struct index_entry *entry = get_entry(update->index, hash);
+	if (entry == NULL)
+		return -1;
+	return entry_add(entry, update->id);
+}
+
+/**
+	Usuwa słowo z wariantu o danym skrócie.
+	@param[in] hash Skrót wariantu.
+	@param[in] data Usuwane słowo, struct word_update.
+	@return 0.
+ */
+static int remove_variant(uint64_t hash, void *data)
+{
+	struct word_update *update = data;
+	struct delete_index *index = update->index;
+	struct index_entry *entry = find_entry(index->table, index->capacity, hash);
+	uint32_t *ids = entry_ids(entry);
+	for (uint32_t i = 0; i < entry->count; i++)
+	{
+		if (ids[i] == update->id)
+		{
+			ids[i] = ids[--entry->count];
+			break;
+		}
+	}
+	return 0;
+}
+
+/**
+	Dopisuje słowa wariantu o danym skrócie do kandydatów.
+	@param[in] hash Skrót wariantu.
+	@param[in,out] data Kandydaci, struct candidates.
+	@return 0 jeśli się udało, -1 jeśli zabrakło pamięci.
+ */
+static int add_candidates(uint64_t hash, void *data)
+{
+	struct candidates *candidates = data;
+	const struct delete_index *index = candidates->index;
+	struct index_entry *entry = find_entry(index->table, index->capacity, hash);
+	if (candidates->len + entry->count > candidates->max)
+	{
+		size_t max = candidates->max * 2;
+		while (max < candidates->len + entry->count)
+			max *= 2;
+		uint32_t *ids = arena_alloc(candidates->arena, sizeof(uint32_t) * max);
+		if (ids == NULL)
+			return -1;
+		memcpy(ids, candidates->ids, sizeof(uint32_t) * candidates->len);
+		candidates->ids = ids;
+		candidates->max = max;
+	}
+	memcpy(candidates->ids + candidates->len, entry_ids(entry),
+			sizeof(uint32_t) * entry->count);
+	candidates->len += entry->count;
+	return 0;
+}
+
+/**
+	Porównuje identyfikatory słów dla qsort().
+	@param[in] a Pierwszy identyfikator.
+	@param[in] b Drugi identyfikator.
+	@return Wynik porównania.
+ */
+static int compare_ids(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+	return x < y ? -1 : x > y;
+}
+
+/**
+	Liczy odległość edycyjną słów, o ile nie przekracza ona max_distance.
+	@param[in] a Pierwsze słowo.
+	@param[in] a_len Długość pierwszego słowa.
+	@param[in] b Drugie słowo.
+	@param[in] b_len Długość drugiego słowa.
+	@param[in] max_distance Największa odległość.
+	@param[in,out] rows Miejsce na dwa wiersze tablicy, po b_len + 1 liczb.
+	@return Odległość, max_distance + 1 jeśli jest większa.
+ */
+static int bounded_distance(const wchar_t *a, size_t a_len, const wchar_t *b,
+		size_t b_len, int max_distance, int *rows)
+{
+	if ((a_len > b_len ? a_len - b_len : b_len - a_len) > (size_t) max_distance)
+		return max_distance + 1;
+	int *row = rows, *next = rows + b_len + 1;
+	for (size_t j = 0; j <= b_len; j++)
+		row[j] = j;
+	for (size_t i = 1; i <= a_len; i++)
+	{
+		int best = next[0] = i;
+		for (size_t j = 1; j <= b_len; j++)
+		{
+			int cost = row[j - 1] + (a[i - 1] != b[j - 1]);
+			if (row[j] + 1 < cost)
+				cost = row[j] + 1;
+			if (next[j - 1] + 1 < cost)
+				cost = next[j - 1] + 1;
+			next[j] = cost;
+			if (cost < best)
+				best = cost;
+		}
+		if (best > max_distance)
+			return max_distance + 1;
+		int *swap = row;
+		row = next;
+		next = swap;
+	}
+	return row[b_len] <= max_distance ? row[b_len] : max_distance + 1;
+}
+
+/**
+	Zapewnia miejsce na kolejny identyfikator słowa.
+	@param[in,out] index Indeks.
+	@return 0 jeśli się udało, -1 jeśli zabrakło pamięci.
+ */
+static int reserve_id(struct delete_index *index)
+{
+	if (index->words_len < index->words_max)
+		return 0;
+	uint32_t max = index->words_max * 2;
+	wchar_t **words = realloc(index->words, sizeof(wchar_t *) * max);
+	if (words == NULL)
+		return -1;
+	index->words = words;
+	uint32_t *free_ids = realloc(index->free_ids, sizeof(uint32_t) * max);
+	if (free_ids == NULL)
+		return -1;
+	index->free_ids = free_ids;
+	index->words_max = max;
+	return 0;
+}
+
+/**
+	Szuka identyfikatora słowa.
+	@param[in] index Indeks.
+	@param[in] word Słowo.
+	@param[out] id Identyfikator słowa.
+	@return true jeśli słowo jest w indeksie, false w p.p.
+ */
+static bool find_id(const struct delete_index *index, const wchar_t *word, uint32_t *id)
+{
+	size_t len = wcslen(word);
+	bool deleted[len + 1];
+	memset(deleted, 0, sizeof(deleted));
+	struct index_entry *entry = find_entry(index->table, index->capacity,
+			variant_hash(word, len, deleted));
+	uint32_t *ids = entry_ids(entry);
+	for (uint32_t i = 0; i < entry->count; i++)
+	{
+		if (wcscmp(index->words[ids[i]], word) == 0)
+		{
+			*id = ids[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+	Wczytuje słowa indeksu z pliku.
+	@param[in,out] index Pusty indeks.
+	@param[in] count Liczba słów.
+	@param[in,out] stream Plik indeksu.
+	@return 0 jeśli się udało, -1 w p.p.
+ */
+static int load_words(struct delete_index *index, uint32_t count, FILE *stream)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t len;
+		if (fread(&len, sizeof(len), 1, stream) != 1 || reserve_id(index) != 0)
+			return -1;
+		uint32_t *symbols = malloc(sizeof(uint32_t) * (len + 1));
+		wchar_t *word = malloc(sizeof(wchar_t) * (len + 1));
+		bool ok = symbols != NULL && word != NULL
+				&& fread(symbols, sizeof(uint32_t), len, stream) == len;
+		for (uint32_t j = 0; ok && j < len; j++)
+			word[j] = (wchar_t) symbols[j];
+		free(symbols);
+		if (!ok)
+		{
+			free(word);
+			return -1;
+		}
+		word[len] = L'\0';
+		index->words[index->words_len++] = word;
+	}
+	return 0;
+}
+
+/**
+	Wczytuje warianty indeksu z pliku.
+	@param[in,out] index Indeks z wczytanymi słowami.
+	@param[in] count Liczba wariantów.
+	@param[in,out] stream Plik indeksu.
+	@return 0 jeśli się udało, -1 w p.p.
+ */
+static int load_entries(struct delete_index *index, uint32_t count, FILE *stream)
+{
+	// Warianty są zapisane w kolejności miejsc w tablicy, więc wstawiane
+	// do mniejszej tablicy tworzyłyby długie ciągi zajętych miejsc.
+	if (reserve_entries(index, count) != 0)
+		return -1;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint64_t hash;
+		uint32_t ids_len;
+		if (fread(&hash, sizeof(hash), 1, stream) != 1 || hash == 0
+				|| fread(&ids_len, sizeof(ids_len), 1, stream) != 1 || ids_len == 0)
+			return -1;
+		struct index_entry *entry = get_entry(index, hash);
+		if (entry == NULL || entry->count > 0)
+			return -1;
+		if (ids_len > 1)
+		{
+			if ((entry->words.ids = malloc(sizeof(uint32_t) * ids_len)) == NULL)
+				return -1;
+			entry->capacity = ids_len;
+		}
+		uint32_t *ids = entry_ids(entry);
+		if (fread(ids, sizeof(uint32_t), ids_len, stream) != ids_len)
+			return -1;
+		entry->count = ids_len;
+		for (uint32_t j = 0; j < ids_len; j++)
+		{
+			if (ids[j] >= index->words_len)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/// @}
+
+/** @name Elementy interfejsu
+ @{
+ */
+
+struct delete_index *delete_index_new(int max_distance)
+{
+	struct delete_index *index = malloc(sizeof(struct delete_index));
+	if (index == NULL)
+		return NULL;
+	index->table = calloc(TABLE_SIZE, sizeof(struct index_entry));
+	index->capacity = TABLE_SIZE;
+	index->size = 0;
+	index->words = malloc(sizeof(wchar_t *) * WORDS_SIZE);
+	index->free_ids = malloc(sizeof(uint32_t) * WORDS_SIZE);
+	index->words_len = 0;
+	index->words_max = WORDS_SIZE;
+	index->free_len = 0;
+	index->max_distance = max_distance;
+	if (index->table == NULL || index->words == NULL || index->free_ids == NULL)
+	{
+		delete_index_free(index);
+		return NULL;
+	}
+	return index;
+}
+
+void delete_index_free(struct delete_index *index)
+{
+	if (index == NULL)
+		return;
+	if (index->table != NULL)
+	{
+		for (size_t i = 0; i < index->capacity; i++)
+		{
+			if (index->table[i].capacity > 0)
+				free(index->table[i].words.ids);
+		}
+	}
+	if (index->words != NULL)
+	{
+		for (uint32_t i = 0; i < index->words_len; i++)
+			free(index->words[i]);
+	}
+	free(index->table);
+	free(index->words);
+	free(index->free_ids);
+	free(index);
+}
+
+int delete_index_max_distance(const struct delete_index *index)
+{
+	return index->max_distance;
+}
+
+int delete_index_add(struct delete_index *index, const wchar_t *word)
+{
+	struct word_update update = { index, 0 };
+	if (index->free_len > 0)
+		update.id = index->free_ids[--index->free_len];
+	else if (reserve_id(index) == 0)
+		update.id = index->words_len++;
+	else
+		return -1;
+	if ((index->words[update.id] = wcsdup(word)) == NULL
+			|| variants(word, index->max_distance, add_variant, &update) != 0)
+	{
+		// Cofamy częściowo dodane słowo.
+		variants(word, index->max_distance, remove_variant, &update);
+		free(index->words[update.id]);
+		index->words[update.id] = NULL;
+		index->free_ids[index->free_len++] = update.id;
+		return -1;
+	}
+	return 0;
+}
+
+void delete_index_remove(struct delete_index *index, const wchar_t *word)
+{
+	struct word_update update = { index, 0 };
+	if (!find_id(index, word, &update.id))
+		return;
+	variants(word, index->max_distance, remove_variant, &update);
+	free(index->words[update.id]);
+	index->words[update.id] = NULL;
+	index->free_ids[index->free_len++] = update.id;
+}
+
+void delete_index_lookup(const struct delete_index *index, const wchar_t *word,
+		int max_distance, struct arena *arena, delete_index_callback *callback,
+		void *data)
+{
+	struct candidates candidates = { index, NULL, 0, CANDIDATES_SIZE, arena };
+	candidates.ids = arena_alloc(arena, sizeof(uint32_t) * CANDIDATES_SIZE);
+	if (candidates.ids == NULL
+			|| variants(word, max_distance, add_candidates, &candidates) != 0)
+		return;
+	qsort(candidates.ids, candidates.len, sizeof(uint32_t), compare_ids);
+	size_t len = wcslen(word);
+	int *rows = arena_alloc(arena, sizeof(int) * 2 * (len + 1));
+	for (size_t i = 0; i < candidates.len; i++)
+	{
+		if (i > 0 && candidates.ids[i] == candidates.ids[i - 1])
+			continue;
+		const wchar_t *found = index->words[candidates.ids[i]];
+		int distance = bounded_distance(found, wcslen(found), word, len,
+				max_distance, rows);
+		if (distance <= max_distance)
+			callback(found, distance, data);
+	}
+}
+
+size_t delete_index_bytes(const struct delete_index *index)
+{
+	if (index == NULL)
+		return 0;
+	size_t bytes = sizeof(struct delete_index)
+			+ sizeof(struct index_entry) * index->capacity
+			+ (sizeof(wchar_t *) + sizeof(uint32_t)) * index->words_max;
+	for (size_t i = 0; i < index->capacity; i++)
+		bytes += sizeof(uint32_t) * index->table[i].capacity;
+	for (uint32_t i = 0; i < index->words_len; i++)
+	{
+		if (index->words[i] != NULL)
+			bytes += sizeof(wchar_t) * (wcslen(index->words[i]) + 1);
+	}
+	return bytes;
+}
+
+int delete_index_save(const struct delete_index *index,
+		const struct dict_image_key *key, FILE *stream)
+{
+	struct index_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, INDEX_MAGIC, MAGIC_LEN);
+	header.key = *key;
+	header.max_distance = index->max_distance;
+	header.words = index->words_len - index->free_len;
+	for (size_t i = 0; i < index->capacity; i++)
+	{
+		if (index->table[i].count > 0)
+			header.entries++;
+	}
+	// Usunięte słowa pomijamy, więc pozostałe dostają nowe identyfikatory.
+	uint32_t *renumber = malloc(sizeof(uint32_t) * (index->words_len + 1));
+	if (renumber == NULL || fwrite(&header, sizeof(header), 1, stream) != 1)
+	{
+		free(renumber);
+		return -1;
+	}
+	int result = 0;
+	uint32_t next = 0;
+	for (uint32_t i = 0; result == 0 && i < index->words_len; i++)
+	{
+		const wchar_t *word = index->words[i];
+		if (word == NULL)
+			continue;
+		renumber[i] = next++;
+		uint32_t len = wcslen(word);
+		if (fwrite(&len, sizeof(len), 1, stream) != 1)
+			result = -1;
+		for (uint32_t j = 0; result == 0 && j < len; j++)
+		{
+			uint32_t symbol = (uint32_t) word[j];
+			if (fwrite(&symbol, sizeof(symbol), 1, stream) != 1)
+				result = -1;
+		}
+	}
+	for (size_t i = 0; result == 0 && i < index->capacity; i++)
+	{
+		struct index_entry *entry = &index->table[i];
+		if (entry->count == 0)
+			continue;
+		if (fwrite(&entry->hash, sizeof(entry->hash), 1, stream) != 1
+				|| fwrite(&entry->count, sizeof(entry->count), 1, stream) != 1)
+			result = -1;
+		uint32_t *ids = entry_ids(entry);
+		for (uint32_t j = 0; result == 0 && j < entry->count; j++)
+		{
+			if (fwrite(&renumber[ids[j]], sizeof(uint32_t), 1, stream) != 1)
+				result = -1;
+		}
+	}
+	free(renumber);
+	return result;
+}
+
+struct delete_index *delete_index_load(const char *path,
+		const struct dict_image_key *key)
+{
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL)
+		return NULL;
+	struct index_header header;
+	struct delete_index *index = NULL;
+	if (fread(&header, sizeof(header), 1, fp) == 1
+			&& memcmp(header.magic, INDEX_MAGIC, MAGIC_LEN) == 0
+			&& header.key.size == key->size
+			&& header.key.mtime_sec == key->mtime_sec
+			&& header.key.mtime_nsec == key->mtime_nsec
+			&& (index = delete_index_new(header.max_distance)) != NULL)
+	{
+		if (load_words(index, header.words, fp) != 0
+				|| load_entries(index, header.entries, fp) != 0)
+		{
+			delete_index_free(index);
+			index = NULL;
+		}
+	}
+	fclose(fp);
+	return index;
+}
+
+/**
+ @}
+ */
@@ -0,0 +1,113 @@
+/** @file
+    Interfejs indeksu wariantów słów po usunięciu liter (SymSpell).
+    Dla każdego słowa indeks pamięta wszystkie słowa powstałe przez
+    usunięcie z niego co najwyżej max_distance liter. Słowa odległe
+    od zapytania o co najwyżej k zmian mają z nim wspólny wariant, więc
+    podpowiedzi to kilka wyszukiwań w tablicy skrótów i sprawdzenie
+    odległości znalezionych kandydatów.
+
+    @ingroup dictionary
+    @author Maja Zalewska <mz336088@students.mimuw.edu.pl>
+    @copyright Uniwerstet Warszawski
+    @date 2015-06-18
+ */
+
+#ifndef DELETE_INDEX_H_
+#define DELETE_INDEX_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include <wchar.h>
+#include "arena.h"
+#include "dict_image.h"
+
+struct delete_index;	///< Indeks wariantów słów. Patrz delete_index.c
+
+/**
+	Funkcja wywoływana dla każdego znalezionego słowa.
+	@param[in] word Słowo z indeksu.
+	@param[in] distance Odległość edycyjna słowa od zapytania.
+	@param[in,out] data Dane przekazane do delete_index_lookup().
+ */
+typedef void delete_index_callback(const wchar_t *word, int distance, void *data);
+
+/**
+	Tworzy pusty indeks.
+	@param[in] max_distance Największa liczba usuwanych liter.
+	@return Indeks, NULL jeśli zabrakło pamięci.
+ */
+struct delete_index *delete_index_new(int max_distance);
+
+/**
+	Zwalnia indeks.
+	@param[in] index Indeks, może być NULL.
+ */
+void delete_index_free(struct delete_index *index);
+
+/**
+	Zwraca największą odległość, dla której indeks znajduje wszystkie słowa.
+	@param[in] index Indeks.
+	@return Największa liczba usuwanych liter.
+ */
+int delete_index_max_distance(const struct delete_index *index);
+
+/**
+	Dodaje słowo do indeksu.
+	Słowo nie może już być w indeksie.
+	@param[in,out] index Indeks.
+	@param[in] word Słowo.
+	@return 0 jeśli się udało, -1 jeśli zabrakło pamięci.
+ */
+int delete_index_add(struct delete_index *index, const wchar_t *word);
+
+/**
+	Usuwa słowo z indeksu, jeśli w nim jest.
+	@param[in,out] index Indeks.
+	@param[in] word Słowo.
+ */
+void delete_index_remove(struct delete_index *index, const wchar_t *word);
+
+/**
+	Wyszukuje słowa odległe od zapytania o co najwyżej max_distance
+	usunięć, zamian i dodań liter. Każde słowo jest zgłaszane raz,
+	w nieokreślonej kolejności.
+	@param[in] index Indeks.
+	@param[in] word Zapytanie.
+	@param[in] max_distance Największa odległość, co najwyżej
+	delete_index_max_distance().
+	@param[in,out] arena Arena zapytania.
+	@param[in] callback Funkcja wywoływana dla każdego znalezionego słowa.
+	@param[in,out] data Dane przekazywane do funkcji callback.
+ */
+void delete_index_lookup(const struct delete_index *index, const wchar_t *word,
+		int max_distance, struct arena *arena, delete_index_callback *callback,
+		void *data);
+
+/**
+	Liczy bajty zajmowane przez indeks.
+	@param[in] index Indeks, może być NULL.
+	@return Przybliżona liczba bajtów.
+ */
+size_t delete_index_bytes(const struct delete_index *index);
+
+/**
+	Zapisuje indeks.
+	@param[in] index Indeks.
+	@param[in] key Klucz pliku słownika, z którego powstał indeks.
+	@param[in,out] stream Plik, do którego zapisujemy indeks.
+	@return 0 jeśli zapis się powiódł, -1 w p.p.
+ */
+int delete_index_save(const struct delete_index *index,
+		const struct dict_image_key *key, FILE *stream);
+
+/**
+	Wczytuje indeks zapisany przez delete_index_save().
+	Indeks z innym kluczem jest nieaktualny i nie jest wczytywany.
+	@param[in] path Ścieżka pliku indeksu.
+	@param[in] key Klucz pliku słownika.
+	@return Indeks, NULL jeśli pliku nie ma, jest nieaktualny lub niepoprawny.
+ */
+struct delete_index *delete_index_load(const char *path,
+		const struct dict_image_key *key);
+
+#endif /* DELETE_INDEX_H_ */
@@ -0,0 +1,141 @@
+/** @file
+	Test do indeksu wariantów słów po usunięciu liter.
+	@ingroup tests
+	@date: 18 June 2015
+	@author: Maja Zalewska <mz336088@mimuw.edu.pl>
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <cmocka.h>
+#include "delete_index.h"
+
+#define MAX_FOUND	16	///< Maksymalna liczba zapamiętywanych słów.
+
+/// Słowa znalezione w indeksie.
+struct found
+{
+	size_t count;	///< Liczba słów.
+	const wchar_t *word[MAX_FOUND];	///< Słowa.
+	int distance[MAX_FOUND];	///< Odległości słów.
+};
+
+/// Zapamiętuje znalezione słowo.
+static void remember(const wchar_t *word, int distance, void *data)
+{
+	struct found *found = data;
+	assert_true(found->count < MAX_FOUND);
+	found->word[found->count] = word;
+	found->distance[found->count] = distance;
+	found->count++;
+}
+
+/// Zwraca odległość znalezionego słowa, -1 jeśli go nie znaleziono.
+static int distance(const struct found *found, const wchar_t *word)
+{
+	for (size_t i = 0; i < found->count; i++)
+		if (wcscmp(found->word[i], word) == 0)
+			return found->distance[i];
+	return -1;
+}
+
+/// Wyszukuje słowa w indeksie.
+static void lookup(const struct delete_index *index, const wchar_t *word,
+		int max_distance, struct found *found)
+{
+	struct arena arena;
+	arena_init(&arena);
+	found->count = 0;
+	delete_index_lookup(index, word, max_distance, &arena, remember, found);
+	arena_done(&arena);
+}
+
+/// Sprawdza wyszukiwanie słów po usunięciu, zamianie i dodaniu liter.
+static void delete_index_lookup_test(void **state)
+{
+	const wchar_t *words[] = { L"kot", L"kota", L"koty", L"pies", L"aa" };
+	struct delete_index *index = delete_index_new(2);
+	assert_non_null(index);
+	for (int i = 0; i < 5; i++)
+		assert_int_equal(delete_index_add(index, words[i]), 0);
+	struct found found;
+	lookup(index, L"kot", 1, &found);
+	assert_int_equal(found.count, 3);
+	assert_int_equal(distance(&found, L"kot"), 0);
+	assert_int_equal(distance(&found, L"kota"), 1);
+	assert_int_equal(distance(&found, L"koty"), 1);
+	lookup(index, L"kto", 2, &found);
+	assert_int_equal(found.count, 3);
+	assert_int_equal(distance(&found, L"kot"), 2);
+	lookup(index, L"pis", 1, &found);
+	assert_int_equal(found.count, 1);
+	assert_int_equal(distance(&found, L"pies"), 1);
+	// Słowo z powtórzoną literą jest znajdowane raz.
+	lookup(index, L"a", 1, &found);
+	assert_int_equal(found.count, 1);
+	lookup(index, L"", 2, &found);
+	assert_int_equal(found.count, 1);
+	assert_int_equal(distance(&found, L"aa"), 2);
+	delete_index_remove(index, L"kota");
+	delete_index_remove(index, L"kotek");
+	lookup(index, L"kot", 1, &found);
+	assert_int_equal(found.count, 2);
+	assert_int_equal(distance(&found, L"kota"), -1);
+	// Identyfikator usuniętego słowa jest używany ponownie.
+	assert_int_equal(delete_index_add(index, L"kit"), 0);
+	lookup(index, L"kot", 1, &found);
+	assert_int_equal(found.count, 3);
+	assert_int_equal(distance(&found, L"kit"), 1);
+	assert_true(delete_index_bytes(index) > 0);
+	delete_index_free(index);
+}
+
+/// Sprawdza zapis i wczytanie indeksu.
+static void delete_index_save_test(void **state)
+{
+	struct dict_image_key key = { 10, 20, 30, 0 };
+	struct dict_image_key other = { 11, 20, 30, 0 };
+	struct delete_index *index = delete_index_new(2);
+	assert_int_equal(delete_index_add(index, L"kot"), 0);
+	assert_int_equal(delete_index_add(index, L"kota"), 0);
+	assert_int_equal(delete_index_add(index, L"pies"), 0);
+	delete_index_remove(index, L"kot");
+	char path[] = "/tmp/delete_index_testXXXXXX";
+	int fd = mkstemp(path);
+	assert_true(fd >= 0);
+	FILE *fp = fdopen(fd, "wb");
+	assert_int_equal(delete_index_save(index, &key, fp), 0);
+	fclose(fp);
+	delete_index_free(index);
+	assert_null(delete_index_load(path, &other));
+	index = delete_index_load(path, &key);
+	unlink(path);
+	assert_non_null(index);
+	assert_int_equal(delete_index_max_distance(index), 2);
+	struct found found;
+	lookup(index, L"kot", 1, &found);
+	assert_int_equal(found.count, 1);
+	assert_int_equal(distance(&found, L"kota"), 1);
+	lookup(index, L"pies", 0, &found);
+	assert_int_equal(found.count, 1);
+	delete_index_remove(index, L"kota");
+	lookup(index, L"kot", 1, &found);
+	assert_int_equal(found.count, 0);
+	delete_index_free(index);
+}
+
+/// Wywołuje testy.
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(delete_index_lookup_test),
+		cmocka_unit_test(delete_index_save_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
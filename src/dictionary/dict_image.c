@@ -0,0 +1,232 @@
+/** @file
+ Implementacja skompilowanego, binarnego obrazu słownika.
+
+ @ingroup dictionary
+ @author Maja Zalewska <mz336088@students.mimuw.edu.pl>
+ @copyright Uniwerstet Warszawski
+ @date 2015-06-10
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <locale.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "dict_image.h"
+
+#define IMAGE_MAGIC	"DICTIMG3"	///< Znacznik początku obrazu, zawiera wersję formatu.
+#define MAGIC_LEN	8	///< Długość znacznika.
+#define FNV_OFFSET	14695981039346656037ULL	///< Początkowa wartość skrótu FNV-1a.
+#define FNV_PRIME	1099511628211ULL	///< Mnożnik skrótu FNV-1a.
+#define WORD_BIT	1	///< Bit oznaczający węzeł kończący słowo.
+
+/// Napis, którego klucze sortowania wyznaczają odcisk porządku liter.
+#define COLLATION_PROBE	L"aAąĄbBcCćĆdDeEęĘfFgGhHiIjJkKlLłŁmMnNńŃoOóÓpPqQrRsSśŚtTuUvVwWxXyYzZźŹżŻ0-9 '"
+
+/// Nagłówek obrazu.
+struct image_header
+{
+	char magic[MAGIC_LEN];	///< Znacznik IMAGE_MAGIC.
+	struct dict_image_key key;	///< Klucz pliku źródłowego.
+	uint32_t alphabet_size;	///< Liczba liter alfabetu.
+	uint32_t nodes;	///< Liczba węzłów, razem z korzeniem.
+};
+
+/// Zapis węzła w obrazie.
+struct image_node
+{
+	uint32_t symbol;	///< Litera prowadząca do węzła.
+	uint32_t info;	///< Liczba dzieci przesunięta o bit, najmłodszy bit to WORD_BIT.
+	uint32_t frequency;	///< Częstość słowa, 0 dla węzła niekończącego słowa.
+};
+
+/** @name Funkcje pomocnicze
+ @{
+ */
+
+/**
+	Liczy węzły drzewa.
+	@param[in] node Korzeń drzewa.
+	@return Liczba węzłów.
+ */
+static uint32_t count_nodes(struct nodeInfo *node)
+{
+	uint32_t count = 1;
+	vector *children = trie_children(node);
+	for (int i = 0; i < size(children); i++)
+		count += count_nodes(at_pos(children, i)->node);
+	return count;
+}
+
+/**
+	Zapisuje dzieci węzła w porządku preorder.
+	@param[in] node Węzeł drzewa.
+	@param[in,out] stream Plik obrazu.
+	@return 0 jeśli zapis się powiódł, -1 w p.p.
+ */
+static int save_children(struct nodeInfo *node, FILE *stream)
+{
+	vector *children = node->children;
+	for (int i = 0; i < size(children); i++)
+	{
+		vectorItem *item = at_pos(children, i);
+		struct image_node rec;
+		rec.symbol = (uint32_t) item->symbol;
+		vector *grandchildren = trie_children(item->node);
+		if (trie_load_failed(item->node))
+			return -1;
+		rec.info = ((uint32_t) size(grandchildren) << 1)
+				| (item->node->number == WORD ? WORD_BIT : 0);
+		rec.frequency = item->node->number == WORD ? item->node->frequency : 0;
+		if (fwrite(&rec, sizeof(rec), 1, stream) != 1
+				|| save_children(item->node, stream) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+/**
+	Odtwarza dzieci węzła z obrazu.
+	@param[in,out] node Węzeł drzewa.
+	@param[in] rec Zapis węzła.
+	@param[in] nodes Tablica zapisów węzłów.
+	@param[in] count Liczba zapisów węzłów.
+	@param[in,out] next Indeks kolejnego nieprzeczytanego zapisu.
+	@return 0 jeśli się udało, -1 jeśli obraz jest niepoprawny.
+ */
+static int load_children(struct nodeInfo *node, const struct image_node *rec,
+		const struct image_node *nodes, uint32_t count, uint32_t *next)
+{
+	uint32_t children = rec->info >> 1;
+	if (children > count - *next)
+		return -1;
+	reserve(node->children, children);
+	for (uint32_t i = 0; i < children; i++)
+	{
+		const struct image_node *child_rec = &nodes[(*next)++];
+		struct nodeInfo *child = trie_create_nodeInfo(
+				child_rec->info & WORD_BIT ? WORD : MID_NODE, node);
+		child->frequency = child_rec->frequency;
+		push_back(node->children,
+				create_vectorItem(child, (wchar_t) child_rec->symbol));
+		if (load_children(child, child_rec, nodes, count, next) != 0)
+			return -1;
+		trie_update_bounds(child);
+	}
+	return 0;
+}
+
+/// @}
+
+/** @name Elementy interfejsu
+ @{
+ */
+
+uint64_t dict_image_hash(const void *data, size_t len)
+{
+	const unsigned char *bytes = data;
+	uint64_t hash = FNV_OFFSET;
+	for (size_t i = 0; i < len; i++)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+uint64_t dict_image_collation(void)
+{
+	const char *name = setlocale(LC_COLLATE, NULL);
+	uint64_t hash = dict_image_hash(name, name != NULL ? strlen(name) : 0);
+	size_t len = wcsxfrm(NULL, COLLATION_PROBE, 0);
+	wchar_t *keys = malloc(sizeof(wchar_t) * (len + 1));
+	if (keys != NULL)
+	{
+		wcsxfrm(keys, COLLATION_PROBE, len + 1);
+		hash = (hash ^ dict_image_hash(keys, sizeof(wchar_t) * len)) * FNV_PRIME;
+		free(keys);
+	}
+	return hash;
+}
+
+int dict_image_save(struct nodeInfo *root, vector *alphabet,
+		const struct dict_image_key *key, FILE *stream)
+{
+	struct image_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, IMAGE_MAGIC, MAGIC_LEN);
+	header.key = *key;
+	header.alphabet_size = size(alphabet);
+	header.nodes = count_nodes(root);
+	if (fwrite(&header, sizeof(header), 1, stream) != 1)
+		return -1;
+	for (int i = 0; i < size(alphabet); i++)
+	{
+		uint32_t symbol = (uint32_t) at_pos(alphabet, i)->symbol;
+		if (fwrite(&symbol, sizeof(symbol), 1, stream) != 1)
+			return -1;
+	}
+	struct image_node rec = { 0, (uint32_t) size(trie_children(root)) << 1, 0 };
+	if (fwrite(&rec, sizeof(rec), 1, stream) != 1)
+		return -1;
+	return save_children(root, stream);
+}
+
+int dict_image_key_read(const char *path, struct dict_image_key *key)
+{
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL)
+		return -1;
+	struct image_header header;
+	size_t read = fread(&header, sizeof(header), 1, fp);
+	fclose(fp);
+	if (read != 1 || memcmp(header.magic, IMAGE_MAGIC, MAGIC_LEN) != 0)
+		return -1;
+	*key = header.key;
+	return 0;
+}
+
+int dict_image_load(struct nodeInfo *root, vector *alphabet, const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < sizeof(struct image_header))
+	{
+		close(fd);
+		return -1;
+	}
+	void *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED)
+		return -1;
+	const struct image_header *header = image;
+	const uint32_t *symbols = (const uint32_t *) (header + 1);
+	const struct image_node *nodes =
+			(const struct image_node *) (symbols + header->alphabet_size);
+	int result = -1;
+	if (memcmp(header->magic, IMAGE_MAGIC, MAGIC_LEN) == 0 && header->nodes > 0
+			&& st.st_size == sizeof(*header)
+				+ sizeof(uint32_t) * (size_t) header->alphabet_size
+				+ sizeof(struct image_node) * (size_t) header->nodes)
+	{
+		reserve(alphabet, header->alphabet_size);
+		for (uint32_t i = 0; i < header->alphabet_size; i++)
+			push_back(alphabet, create_vectorItem(NULL, (wchar_t) symbols[i]));
+		uint32_t next = 1;
+		result = load_children(root, &nodes[0], nodes, header->nodes, &next);
+		trie_update_bounds(root);
+		if (result == 0 && next != header->nodes)
+			result = -1;
+	}
+	munmap(image, st.st_size);
+	return result;
+}
+
+/**
+ @}
+ */
@@ -0,0 +1,77 @@
+/** @file
+    Interfejs skompilowanego, binarnego obrazu słownika.
+    Obraz zawiera alfabet i węzły drzewa TRIE w porządku preorder
+    i pozwala odtworzyć słownik bez parsowania pliku tekstowego.
+
+    @ingroup dictionary
+    @author Maja Zalewska <mz336088@students.mimuw.edu.pl>
+    @copyright Uniwerstet Warszawski
+    @date 2015-06-10
+ */
+
+#ifndef DICT_IMAGE_H_
+#define DICT_IMAGE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "trie.h"
+
+/**
+	Klucz pliku źródłowego, z którego powstał obraz.
+	Obraz jest aktualny, jeśli klucz zgadza się z plikiem źródłowym.
+ */
+struct dict_image_key
+{
+	uint64_t size;	///< Rozmiar pliku źródłowego.
+	int64_t mtime_sec;	///< Czas modyfikacji pliku źródłowego, sekundy.
+	int64_t mtime_nsec;	///< Czas modyfikacji pliku źródłowego, nanosekundy.
+	uint64_t hash;	///< Skrót zawartości pliku źródłowego.
+	/// Odcisk porządku liter (LC_COLLATE), w którym zapisano dzieci węzłów.
+	uint64_t collation;
+};
+
+/**
+	Liczy skrót (FNV-1a) zawartości pliku.
+	@param[in] data Zawartość pliku.
+	@param[in] len Długość zawartości.
+	@return Skrót.
+ */
+uint64_t dict_image_hash(const void *data, size_t len);
+
+/**
+	Liczy odcisk bieżącego porządku liter (LC_COLLATE).
+	Obejmuje nazwę ustawienia i klucze sortowania wzorcowego napisu,
+	więc zmienia się także po zmianie danych lokalizacji o tej samej nazwie.
+	@return Odcisk porządku.
+ */
+uint64_t dict_image_collation(void);
+
+/**
+	Zapisuje obraz słownika.
+	@param[in] root Korzeń drzewa.
+	@param[in] alphabet Alfabet słownika.
+	@param[in] key Klucz pliku źródłowego.
+	@param[in,out] stream Plik, do którego zapisujemy obraz.
+	@return 0 jeśli zapis się powiódł, -1 w p.p.
+ */
+int dict_image_save(struct nodeInfo *root, vector *alphabet,
+		const struct dict_image_key *key, FILE *stream);
+
+/**
+	Wczytuje klucz zapisany w obrazie.
+	@param[in] path Ścieżka obrazu.
+	@param[out] key Wczytany klucz.
+	@return 0 jeśli się udało, -1 jeśli obrazu nie ma lub jest niepoprawny.
+ */
+int dict_image_key_read(const char *path, struct dict_image_key *key);
+
+/**
+	Wczytuje obraz słownika.
+	@param[in,out] root Pusty korzeń drzewa.
+	@param[in,out] alphabet Pusty alfabet słownika.
+	@param[in] path Ścieżka obrazu.
+	@return 0 jeśli się udało, -1 w p.p.
+ */
+int dict_image_load(struct nodeInfo *root, vector *alphabet, const char *path);
+
+#endif /* DICT_IMAGE_H_ */
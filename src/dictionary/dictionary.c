@@ -14,25 +14,63 @@
 #include <string.h>
 #include <wctype.h>
 #include <locale.h>
+#include <limits.h>
+#include <stdint.h>
 #include <assert.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 #include <argz.h>
+#include <pthread.h>
+#include <time.h>
 #include "dictionary.h"
 #include "trie.h"
 #include "rules_list.h"
+#include "dict_image.h"
+#include "import.h"
+#include "rule_matcher.h"
+#include "delete_index.h"
+#include "trace.h"
 #include "utils.h"
 
 #define _GNU_SOURCE	///< Korzystamy ze standardu gnu99.
 
 #define PERMISSIONS	0777 ///< Mode do tworzenia katalogu do zapisu słowników.
 #define LIST_PATH	CONF_PATH "/dict_list.txt" ///< Ścieżka zapisu listy słowników.
+#define CACHE_PATH	CONF_PATH "/cache"	///< Folder skompilowanych obrazów słowników.
+#define IMAGE_SUFFIX	".img"	///< Rozszerzenie pliku obrazu słownika.
+#define INDEX_SUFFIX	".del"	///< Rozszerzenie pliku indeksu usunięć liter.
+#define WORD_SIZE	32	///< Początkowy rozmiar bufora na importowane słowo.
+#define SAVE_CHUNK	(1 << 16)	///< Liczba bajtów zapisywanych między informacjami o postępie.
+#define FILE_MODE	0644	///< Uprawnienia pliku słownika zapisywanego w tle.
+#define MAX_THREADS	16	///< Maksymalna liczba wątków zbierających stany warstwy.
+/// Domyślna najmniejsza liczba stanów warstw źródłowych, od której stany
+/// warstwy są zbierane w wielu wątkach.
+#define PARALLEL_STATES	256
+#define STATES_CHUNK	16	///< Liczba stanów przydzielanych naraz wątkowi.
+#define MEMO_WALK	4	///< Liczba liter przejścia, od której zapamiętujemy jego wynik.
+#define SESSION_WORD	32	///< Początkowy rozmiar bufora na słowo sesji podpowiedzi.
+/// Liczba sprawdzeń ograniczeń na jeden odczyt zegara przy wyszukiwaniu bez reguł.
+#define LIMIT_CHECKS	64
 #define DIGITS	10
 #define SIDE	16
 
 
+/**
+  Poddrzewo korzenia współdzielone ze zrzutami słownika dla zapisów w tle.
+  Słownik przed zmianą poddrzewa zastępuje je kopią, a oryginał zwalnia
+  ostatni zrzut, który go czyta.
+ */
+struct frozen_subtree
+{
+	struct nodeInfo *node;	///< Korzeń poddrzewa.
+	int snapshots;	///< Liczba zrzutów, które czytają poddrzewo.
+	bool detached;	///< Czy słownik zastąpił już poddrzewo kopią.
+};
+
 /**
   Struktura przechowująca słownik.
   Na razie prosta implementacja z użyciem listy słów.
@@ -43,6 +81,53 @@ struct dictionary
     vector *alphabet;	///< Alfabet obsługiwany przez słownik.
     int cost;	///< Maksymalny koszt podpowiedzi.
     struct rules_list *rules;	///< Lista reguł słownika.
+    void *image;	///< Zmapowany plik słownika, z którego wczytywane są poddrzewa.
+    size_t image_len;	///< Długość zmapowanego pliku.
+    /// Automat lewych stron reguł, wzorce mają te same indeksy co reguły.
+    struct rule_matcher *matcher;
+    pthread_mutex_t matcher_lock;	///< Chroni przygotowanie automatu reguł.
+    int max_rule_cost;	///< Największy koszt reguły słownika.
+    int min_rule_cost;	///< Najmniejszy koszt reguły słownika.
+    size_t split_rules;	///< Liczba reguł słownika z flagą s.
+    /// Największy przyrost długości słowa przez regułę względem jej kosztu
+    /// wynosi grow_len / grow_cost, 0 jeśli żadna reguła nie wydłuża słowa.
+    int grow_len;
+    int grow_cost;	///< Mianownik przyrostu długości słowa.
+    /// Największy ubytek długości słowa przez regułę względem jej kosztu
+    /// wynosi shrink_len / shrink_cost, 0 jeśli żadna reguła nie skraca słowa.
+    int shrink_len;
+    int shrink_cost;	///< Mianownik ubytku długości słowa.
+    enum hints_engine engine;	///< Algorytm wyszukiwania podpowiedzi.
+    int max_distance;	///< Maksymalna odległość edycyjna podpowiedzi bez reguł.
+    struct delete_index *index;	///< Indeks usunięć liter, NULL jeśli wyłączony.
+    int threads;	///< Liczba wątków zbierających stany warstwy.
+    /// Najmniejsza liczba stanów warstw źródłowych, od której używamy wielu wątków.
+    size_t parallel_states;
+    pthread_mutex_t saving_lock;	///< Chroni licznik saving i tablicę frozen.
+    pthread_cond_t saved;	///< Sygnalizuje, że zapis w tle przestał czytać słownik.
+    int saving;	///< Liczba zapisów w tle, które jeszcze czytają słownik.
+    struct frozen_subtree *frozen;	///< Poddrzewa korzenia czytane przez zapisy w tle.
+    size_t frozen_len;	///< Liczba poddrzew w tablicy frozen.
+    size_t frozen_max;	///< Rozmiar tablicy frozen.
+};
+
+/// Rodzaj instrukcji skompilowanej reguły.
+enum rule_opcode
+{
+	OP_LITERAL,	///< Ciąg liter: po lewej porównywany ze słowem, po prawej przepisywany.
+	OP_BIND,	///< Pierwsze wystąpienie zmiennej po lewej, zapamiętuje literę słowa.
+	OP_CHECK,	///< Kolejne wystąpienie zmiennej po lewej, porównuje literę słowa.
+	OP_EMIT,	///< Zmienna po prawej, wpisuje zapamiętaną literę.
+	OP_FREE	///< Zmienna występująca tylko po prawej, literę wybiera traverse().
+};
+
+/// Instrukcja skompilowanej reguły.
+struct rule_op
+{
+	enum rule_opcode code;	///< Rodzaj instrukcji.
+	unsigned variable;	///< Numer zmiennej.
+	size_t pos;	///< Pozycja w stronie reguły.
+	size_t len;	///< Długość ciągu liter dla OP_LITERAL.
 };
 
 /**
@@ -55,8 +140,197 @@ struct rule
 	wchar_t *right;	///< Prawa strona reguły.
 	int cost;	///< Koszt refuły.
 	enum rule_flag flag;	///< Flaga reguły.
+	size_t left_len;	///< Długość lewej strony.
+	size_t right_len;	///< Długość prawej strony.
+	/// Pozycja zmiennej prawej strony niewystępującej po lewej, right_len jeśli jej nie ma.
+	size_t free_pos;
+	/// Instrukcje reguły, najpierw lewej strony, potem prawej.
+	struct rule_op *program;
+	size_t left_ops;	///< Liczba instrukcji lewej strony.
+	size_t ops;	///< Liczba wszystkich instrukcji.
+	bool variable_right;	///< Czy prawa strona zawiera zmienne.
+};
+
+/// Ograniczenia jednego wyszukiwania podpowiedzi i ich stan.
+struct search_budget
+{
+	const struct hints_limits *limits;	///< Ograniczenia, NULL jeśli ich nie ma.
+	struct timespec deadline;	///< Chwila, po której przerywamy wyszukiwanie.
+	unsigned period;	///< Co ile sprawdzeń odczytujemy zegar.
+	unsigned checks;	///< Liczba sprawdzeń od ostatniego odczytu zegara.
+	enum hints_status status;	///< Powód przerwania, HINTS_COMPLETE jeśli go nie było.
+};
+
+struct collect_worker;	///< Dane wątku zbierającego stany.
+
+/// Dane jednego zapytania o podpowiedzi.
+struct hints_query
+{
+	const struct dictionary *dict;	///< Przeszukiwany słownik.
+	const wchar_t *word;	///< Słowo, dla którego szukamy podpowiedzi.
+	size_t len;	///< Długość słowa.
+	/// Reguły pasujące do kolejnych sufiksów słowa, osobno dla każdego kosztu.
+	struct rules_list **rules;
+	/// Czy do sufiksu od danej pozycji pasuje jakakolwiek reguła.
+	bool *matched;
+	/// Maski TRIE_LETTER() liter sufiksów słowa, NULL w sesji podpowiedzi.
+	uint64_t *letters;
+	int max_cost;	///< Największy koszt reguły, którą warto stosować.
+	int min_cost;	///< Najmniejszy koszt reguły.
+	int threads;	///< Liczba wątków zbierających stany warstwy.
+	struct rules_list **layers;	///< Stany o kolejnych kosztach.
+	/// Kolejka stanów do przejrzenia, NULL dla algorytmu warstwowego.
+	struct state_queue *queue;
+	/// Czy zapytanie należy do sesji podpowiedzi, wtedy nowe stany
+	/// trafiają do kolejki bez rozwijania.
+	bool session;
+	/// Lista, do której trafiają stany po regule z flagą s zamiast do
+	/// warstw, NULL jeśli nie dzielimy słowa, patrz get_hints_segmented().
+	struct rules_list *pieces;
+	struct state_set seen;	///< Wszystkie dotąd utworzone stany.
+	/// Przejścia po drzewie resztą słowa, używane tylko przez algorytm best-first.
+	struct walk_memo walks;
+	/// Stany wcześniejszych warstw, jeśli zapytanie wykonuje wątek zbierający
+	/// stany, wtedy seen zawiera tylko stany zebrane przez ten wątek.
+	const struct state_set *shared;
+	/// Wątki zbierające stany, NULL jeśli nie były potrzebne.
+	struct collect_worker *workers;
+	struct arena *arena;	///< Arena zapytania.
+	/// Ograniczenia wyszukiwania, wątek zbierający stany ma własną kopię.
+	struct search_budget budget;
+};
+
+/// Dane wątku zbierającego stany.
+struct collect_worker
+{
+	struct hints_query query;	///< Zapytanie z areną i zbiorem stanów wątku.
+	struct arena arena;	///< Arena wątku, zwalniana na końcu zapytania.
+	struct rules_list states;	///< Zebrane stany.
+	struct rules_list kept;	///< Zebrane stany, których nie utworzył inny wątek.
+};
+
+/// Wspólny stan wątków zbierających stany jednej warstwy.
+struct collect_job
+{
+	struct hints_query *query;	///< Zapytanie.
+	int cost;	///< Koszt zbieranych stanów.
+	int max_rule;	///< Największy koszt stosowanych reguł.
+	size_t count;	///< Łączna liczba stanów warstw źródłowych.
+	size_t next;	///< Pierwszy nieprzydzielony stan.
+	int started;	///< Liczba wątków, które zaczęły zbierać stany.
+	int merged;	///< Liczba wątków, których stany są przenoszone do warstwy.
+};
+
+/// Słowo z zapytania o podpowiedzi dla wielu słów.
+struct batch_word
+{
+	const wchar_t *word;	///< Słowo.
+	size_t index;	///< Pozycja słowa w zapytaniu.
+};
+
+/// Wspólny stan wątków wyszukujących podpowiedzi dla wielu słów.
+struct batch_job
+{
+	const struct dictionary *dict;	///< Słownik.
+	const struct batch_word *words;	///< Różne słowa zapytania.
+	size_t count;	///< Liczba różnych słów.
+	size_t next;	///< Pierwsze nieprzydzielone słowo.
+	int threads;	///< Liczba wątków zbierających stany warstwy jednego słowa.
+	struct word_list *lists;	///< Listy podpowiedzi, indeksowane pozycją w zapytaniu.
+};
+
+/// Reguła pasująca do słowa sesji podpowiedzi.
+struct session_match
+{
+	const struct rule *rule;	///< Reguła.
+	size_t pos;	///< Pozycja, od której pasuje lewa strona reguły.
+};
+
+/// Stany sesji podpowiedzi kończące się na jednej pozycji słowa.
+struct session_position
+{
+	struct arena arena;	///< Arena stanów i dopasowań pozycji.
+	/// Stany pozycji powstałe bez reguł z flagą e, które zależą od długości słowa.
+	struct state_set seen;
+	struct rules_list states;	///< Te same stany w kolejności kosztu.
+	/// Reguły bez flagi e o niepustej lewej stronie, które kończą się na pozycji.
+	struct rules_list moves;
+	struct rules_list empty;	///< Reguły bez flagi e o pustej lewej stronie.
+	struct rules_list end;	///< Reguły z flagą e, które kończą się na pozycji.
+};
+
+/// Sesja podpowiedzi dla słowa wpisywanego znak po znaku.
+struct hints_session
+{
+	/// Zapytanie o bieżące słowo, wspólne dla wszystkich pozycji.
+	struct hints_query query;
+	wchar_t *word;	///< Bufor słowa.
+	size_t max_len;	///< Największa długość słowa mieszcząca się w buforze.
+	/// Stany kolejnych pozycji, od 0 do długości słowa, puste bez reguł.
+	/// Pozycje za końcem słowa czekają na ponowne użycie z wyczyszczoną areną.
+	struct rules_list positions;
+	/// Arena buforów słowa, stare bufory zostają, bo wskazują na nie fragmenty stanów.
+	struct arena arena;
+	struct arena scratch;	///< Arena stanów tworzonych tylko dla podpowiedzi.
+	bool by_rules;	///< Czy podpowiedzi wyszukujemy według reguł.
+};
+
+/**
+	Dane wyliczania podziałów słowa na części, z których każda jest
+	słowem ze słownika po zastosowaniu reguł. Część nieostatnia kończy
+	się stanem po regule z flagą s, a ostatnia stanem końcowym.
+ */
+struct segment_query
+{
+	struct hints_query *query;	///< Zapytanie.
+	/// Stany kończące części zaczynające się na kolejnych pozycjach słowa.
+	struct rules_list *parts;
+	/// Najmniejszy koszt dokończenia podpowiedzi od kolejnych pozycji,
+	/// INT_MAX jeśli się nie da.
+	int *tails;
+	const struct state **path;	///< Części bieżącego podziału.
+	struct word_collector *hints;	///< Wybrane podpowiedzi.
+};
+
+/// Dane jednego zapytania o słowa w danej odległości edycyjnej.
+struct levenshtein_query
+{
+	const wchar_t *word;	///< Słowo, dla którego szukamy podpowiedzi.
+	size_t len;	///< Długość słowa.
+	int max_distance;	///< Największa odległość podpowiedzi.
+	/// Wiersze tablicy odległości dla kolejnych prefiksów, po len + 1 liczb.
+	int *rows;
+	wchar_t *prefix;	///< Bieżący prefiks, czyli ścieżka w drzewie.
+	struct word_collector *hints;	///< Wybrane podpowiedzi.
+	size_t visited;	///< Liczba odwiedzonych węzłów drzewa.
+	struct search_budget budget;	///< Ograniczenia wyszukiwania.
+};
+
+/// Dane wyszukiwania podpowiedzi w indeksie usunięć liter.
+struct index_query
+{
+	const struct dictionary *dict;	///< Słownik.
+	struct word_collector *hints;	///< Wybrane podpowiedzi.
+};
+
+/// Zapis słownika wykonywany w tle.
+struct save_task
+{
+	struct dictionary *dict;	///< Zapisywany słownik.
+	struct dictionary *snapshot;	///< Zrzut słownika, patrz snapshot_dictionary().
+	bool index;	///< Czy zapisać też indeks usunięć liter.
+	char *lang;	///< Nazwa języka.
+	dictionary_save_callback *callback;	///< Funkcja informująca o postępie.
+	void *data;	///< Dane przekazywane do funkcji callback.
 };
 
+/// Chroni pliki słowników i ich listę przed równoczesnymi zapisami.
+static pthread_mutex_t save_lock = PTHREAD_MUTEX_INITIALIZER;
+/// Sygnalizuje zakończenie zapisu w tle.
+static pthread_cond_t save_done = PTHREAD_COND_INITIALIZER;
+/// Liczba trwających zapisów w tle.
+static int saves_running = 0;
+
 /** @name Funkcje pomocnicze
   @{
  */
@@ -74,132 +348,196 @@ static void dictionary_free(struct dictionary *dict)
 		dict->alphabet = delete_all(dict->alphabet);
 		dict->root = trie_clear(dict->root);
 		dictionary_rule_clear(dict);
+		rules_list_done(dict->rules, DEL_NO);
+		free(dict->rules);
 		dict->rules = NULL;
+		rule_matcher_free(dict->matcher);
+		pthread_mutex_destroy(&dict->matcher_lock);
+		pthread_mutex_destroy(&dict->saving_lock);
+		pthread_cond_destroy(&dict->saved);
+		free(dict->frozen);
+		delete_index_free(dict->index);
+		if (dict->image != NULL)
+			munmap(dict->image, dict->image_len);
 		free(dict);
 		dict = NULL;
 	}
 }
 
 /**
-	Usuwa pojedynczy znak w słowie.
-	@param[in] str Zmieniane słowo.
-	@param[in] pos Pozycja, z której usuwany jest znak.
+	Przygotowuje ograniczenia wyszukiwania, czas liczymy od tej chwili.
+	Odczyt zegara kosztuje tyle co kilka kroków wyszukiwania bez reguł,
+	ale jest dużo tańszy od rozwinięcia stanu według reguł.
+	@param[out] budget Ograniczenia wyszukiwania.
+	@param[in] limits Ograniczenia, NULL oznacza ich brak.
+	@param[in] period Co ile sprawdzeń odczytujemy zegar.
  */
-static void remove_char(wchar_t *str, int pos) {
-
-    assert(str != NULL);
-	wchar_t *src, *dst;
-    int i = 0;
-    for (src = dst = str; *src != L'\0'; src++)
-    {
-        *dst = *src;
-        if (i != pos) dst++;
-        i++;
-    }
-    *dst = L'\0';
+static void budget_init(struct search_budget *budget, const struct hints_limits *limits,
+		unsigned period)
+{
+	budget->limits = limits;
+	budget->period = period;
+	budget->checks = 0;
+	budget->status = HINTS_COMPLETE;
+	if (limits == NULL || limits->time_us == 0)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &budget->deadline);
+	unsigned long long nsec = budget->deadline.tv_nsec + limits->time_us % 1000000 * 1000;
+	budget->deadline.tv_sec += limits->time_us / 1000000 + nsec / 1000000000;
+	budget->deadline.tv_nsec = nsec % 1000000000;
 }
 
 /**
-	Dodaje do list słowa, które można otrzymać poprzez usunięcie jednej litery.
-	@param[in] dict Słownik, z którego korzystamy.
-	@param[in] a Słowo, z którego usuwamy literę.
-	@param[in] list Lista, do której dopisujemy otrzymane słowa, o ile są w słowniku.
+	Sprawdza, czy wyszukiwanie przekroczyło ograniczenia, i zapamiętuje
+	powód przerwania. Zegar odczytujemy co budget->period sprawdzeń.
+	@param[in,out] budget Ograniczenia wyszukiwania.
+	@param[in] states Liczba dotąd utworzonych stanów.
+	@param[in] bytes Liczba dotąd przydzielonych bajtów.
+	@return true jeśli trzeba przerwać wyszukiwanie, false w p.p.
  */
-static void hints_by_delete(const struct dictionary *dict, const wchar_t *a, struct word_list *list)
+static bool budget_exceeded(struct search_budget *budget, size_t states, size_t bytes)
 {
-	int i;
-	int len = wcslen(a);
-	wchar_t *b = malloc(sizeof(wchar_t) * (len + 1));
-	for (i = 0; i < len; i++)
+	const struct hints_limits *limits = budget->limits;
+	if (limits == NULL || budget->status != HINTS_COMPLETE)
+		return budget->status != HINTS_COMPLETE;
+	if (limits->max_states > 0 && states >= limits->max_states)
+		budget->status = HINTS_STATE_LIMIT;
+	else if (limits->max_bytes > 0 && bytes >= limits->max_bytes)
+		budget->status = HINTS_MEMORY_LIMIT;
+	else if (limits->time_us > 0 && ++budget->checks >= budget->period)
 	{
-		wcscpy(b, a);
-		remove_char(b, i);
-		if (dictionary_find(dict, b))
-			word_list_add(list, b);
+		struct timespec now;
+		budget->checks = 0;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec > budget->deadline.tv_sec || (now.tv_sec == budget->deadline.tv_sec
+				&& now.tv_nsec >= budget->deadline.tv_nsec))
+			budget->status = HINTS_TIMEOUT;
 	}
-	free(b);
+	return budget->status != HINTS_COMPLETE;
 }
 
 /**
-	Dodaje do list słowa, które można otrzymać poprzez zamianę jednej litery.
-	@param[in] dict Słownik, z którego korzystamy.
-	@param[in] a Słowo, w którym zmieniamy literę.
-	@param[in] list Lista, do której dopisujemy otrzymane słowa, o ile są w słowniku.
+	Przechodzi w głąb poddrzewo węzła, licząc dla kolejnych liter
+	wiersze tablicy odległości edycyjnej od słowa zapytania. Wiersz jest
+	stanem automatu Levenshteina dla bieżącego prefiksu, więc gałąź,
+	w której cały wiersz przekracza max_distance, odcinamy od razu.
+	Po przekroczeniu ograniczeń wyszukiwania wracamy bez dalszego
+	przechodzenia.
+	@param[in,out] query Zapytanie.
+	@param[in] node Węzeł odpowiadający bieżącemu prefiksowi.
+	@param[in] depth Długość bieżącego prefiksu.
  */
-static void hints_by_replace(const struct dictionary *dict, const wchar_t *a, struct word_list *list)
+static void levenshtein_walk(struct levenshtein_query *query,
+		struct nodeInfo *node, size_t depth)
 {
-	int i, j;
-	int len = wcslen(a);
-	wchar_t *b = malloc(sizeof(wchar_t) * (len + 1));
-	bool selfAdded = false;
-	int alphabetSize = size(dict->alphabet);
-	for (i = 0; i < len; i++)
+	const int *row = query->rows + depth * (query->len + 1);
+	int *next = query->rows + (depth + 1) * (query->len + 1);
+	int limit = query->max_distance + 1;
+	// Poza pasem |depth + 1 - i| <= max_distance odległość jest za duża.
+	size_t low = depth + 1 > limit ? depth + 1 - query->max_distance : 1;
+	size_t high = depth + limit < query->len ? depth + limit : query->len;
+	vector *children = trie_children(node);
+	for (int j = 0; j < size(children); j++)
 	{
-		for (j = 0; j < alphabetSize; j++)
+		vectorItem *child = at_pos(children, j);
+		int best = next[0] = depth + 1;
+		if (low > 1)
+			next[low - 1] = limit;
+		if (high < query->len)
+			next[high + 1] = limit;
+		for (size_t i = low; i <= high; i++)
 		{
-			wcscpy(b, a);
-			b[i] = at_pos(dict->alphabet, j)->symbol;
-			if (dictionary_find(dict, b))
-			{
-				if ((!wcscmp(b, a)) && !selfAdded)
-				{	word_list_add(list, b);
-					selfAdded = true;
-				}
-				else if (wcscmp(b, a))
-					word_list_add(list, b);
-			}
+			int cost = row[i - 1] + (query->word[i - 1] != child->symbol);
+			if (row[i] + 1 < cost)
+				cost = row[i] + 1;
+			if (next[i - 1] + 1 < cost)
+				cost = next[i - 1] + 1;
+			next[i] = cost;
+			if (cost < best)
+				best = cost;
+		}
+		if (best > query->max_distance)
+			continue;
+		if (budget_exceeded(&query->budget, ++query->visited, 0))
+			return;
+		query->prefix[depth] = child->symbol;
+		if (child->node->number == WORD && high == query->len
+				&& next[query->len] <= query->max_distance
+				&& word_collector_accepts(query->hints, next[query->len],
+						child->node->frequency))
+		{
+			query->prefix[depth + 1] = L'\0';
+			word_collector_add(query->hints, query->prefix, next[query->len],
+					child->node->frequency);
 		}
+		levenshtein_walk(query, child->node, depth + 1);
 	}
-	free(b);
 }
 
 /**
-	Dopisuje literę do słowa na dowolnej pozycji.
-	@param[in] dst Nowo powstałe słowo.
-	@param[in] str Napis do dopisania.
-	@param[in] pos Pozycja, od której zaczyna się dopisywanie.
+	Dodaje podpowiedź znalezioną w indeksie usunięć liter.
+	Kosztem podpowiedzi jest odległość słowa od zapytania.
+	@param[in] word Słowo.
+	@param[in] distance Odległość słowa od zapytania.
+	@param[in,out] data Zapytanie, struct index_query.
  */
-static void append(wchar_t *dst, const wchar_t *str, int pos) {
-	wchar_t *buf = malloc(sizeof(wchar_t) * (wcslen(dst) + 1 + 1));
-	buf[wcslen(dst) + 1] = L'\0';
-	wcsncpy(buf, dst, pos); // copy at most first pos characters
-    int len = pos;
-    wcscpy(buf+len, str); // add the letter
-    len += 1;  // increase the length
-    wcscpy(buf+len, dst+pos); // copy the rest
-    wcscpy(dst, buf);   // copy it back
-    free(buf);
+static void add_index_hint(const wchar_t *word, int distance, void *data)
+{
+	struct index_query *query = data;
+	struct nodeInfo *node = trie_find_word(query->dict->root, word);
+	uint32_t frequency = node != NULL ? node->frequency : DEFAULT_FREQUENCY;
+	if (word_collector_accepts(query->hints, distance, frequency))
+		word_collector_add(query->hints, word, distance, frequency);
 }
 
 /**
-	Dodaje do list słowa, które można otrzymać poprzez dodanie jednej litery.
-	@param[in] dict Słownik, z którego korzystamy.
-	@param[in] a Słowo, do którego dodajemy literę.
-	@param[in] list Lista, do której dopisujemy otrzymane słowa, o ile są w słowniku.
+	Wybiera słowa ze słownika odległe od słowa o co najwyżej
+	max_distance usunięć, zamian i dodań liter, jak podpowiedzi
+	o koszcie równym odległości. Jeśli słownik ma indeks usunięć liter
+	dla tej odległości, to korzystamy z niego. W p.p. słowo dłuższe od
+	zapytania o więcej niż max_distance liter ma większą odległość, więc
+	wystarczy len + max_distance + 1 wierszy.
+	@param[in] dict Słownik.
+	@param[in] word Słowo.
+	@param[in,out] list Lista podpowiedzi, zainicjowana przez find_hints().
+	@param[in,out] arena Arena zapytania.
+	@param[in] limits Ograniczenia wyszukiwania, NULL jeśli ich nie ma.
+	@return HINTS_COMPLETE albo powód przerwania wyszukiwania.
  */
-static void hints_by_add(const struct dictionary *dict, const wchar_t *a, struct word_list *list)
+static enum hints_status hints_by_distance(const struct dictionary *dict,
+		const wchar_t *word, struct word_list *list, struct arena *arena,
+		const struct hints_limits *limits)
 {
-	int i, j;
-	int len = wcslen(a) + 1;
-	wchar_t *b = malloc(sizeof(wchar_t) * (len + 1));
-	int alphabetSize = size(dict->alphabet);
-	for (i = 0; i < len; i++)
+	struct word_collector hints;
+	if (word_collector_init(&hints, DICTIONARY_MAX_HINTS) != 0)
+		return HINTS_NO_MEMORY;
+	if (dict->index != NULL && dict->max_distance <= delete_index_max_distance(dict->index))
 	{
-		for (j = 0; j < alphabetSize; j++)
-		{
-			memset(b, 0, len);
-			wcscpy(b, a);
-			const wchar_t letter[ONE_LETTER_STRING] =
-				{ at_pos(dict->alphabet, j)->symbol, L'\0' };
-			append(b, letter, i);
-			if (dictionary_find(dict, b))
-				word_list_add(list, b);
-		}
+		struct index_query query = { dict, &hints };
+		delete_index_lookup(dict->index, word, dict->max_distance, arena,
+				add_index_hint, &query);
+		word_collector_finish(&hints, list);
+		word_collector_done(&hints);
+		return HINTS_COMPLETE;
 	}
-	free(b);
+	struct levenshtein_query query;
+	query.word = word;
+	query.len = wcslen(word);
+	query.max_distance = dict->max_distance;
+	query.hints = &hints;
+	query.visited = 0;
+	budget_init(&query.budget, limits, LIMIT_CHECKS);
+	size_t depth = query.len + dict->max_distance + 1;
+	query.rows = arena_alloc(arena, sizeof(int) * (query.len + 1) * (depth + 1));
+	query.prefix = arena_alloc(arena, sizeof(wchar_t) * (depth + 1));
+	for (size_t i = 0; i <= query.len; i++)
+		query.rows[i] = i;
+	levenshtein_walk(&query, dict->root, 0);
+	word_collector_finish(&hints, list);
+	word_collector_done(&hints);
+	return query.budget.status;
 }
 
-
 /**
 	Wczytuje alfabet słownika z pliku.
 	@param[in] dict Wczytywany słownik.
@@ -208,14 +546,38 @@ static void hints_by_add(const struct dictionary *dict, const wchar_t *a, struct
 static void load_alphabet(struct dictionary *dict, FILE *stream)
 {
 	wchar_t ch;
-//	ch = fgetwc(stream);
-//	fprintf(stderr, "mam znak load alphabet: %lc.", ch);
 	while ((ch = fgetwc(stream)) != EOF && (ch != L'\n'))
 	{
 		vectorItem *vItm = create_vectorItem(NULL, ch);
 		push_back(dict->alphabet, vItm);
 	}
-	fprintf(stderr, "mam znak load alphabet: %lc.", ch);
+	TRACE(TRACE_DEBUG, "alfabet: %d liter", size(dict->alphabet));
+}
+
+/**
+	Wczytuje alfabet słownika z obrazu pliku.
+	@param[in] dict Wczytywany słownik.
+	@param[in] text Początek obrazu pliku.
+	@param[in] end Koniec obrazu pliku.
+	@return Wskaźnik za wczytanym alfabetem, NULL jeśli obraz jest niepoprawny.
+ */
+static const char *image_load_alphabet(struct dictionary *dict,
+		const char *text, const char *end)
+{
+	mbstate_t ps;
+	memset(&ps, 0, sizeof(ps));
+	while (text < end && *text != '\n')
+	{
+		wchar_t ch;
+		size_t len = mbrtowc(&ch, text, end - text, &ps);
+		if (len == 0 || len == (size_t) -1 || len == (size_t) -2)
+			return NULL;
+		push_back(dict->alphabet, create_vectorItem(NULL, ch));
+		text += len;
+	}
+	if (text >= end)
+		return NULL;
+	return text + 1;
 }
 
 /**
@@ -251,6 +613,21 @@ static char * create_file_path(char *dir, const char *file)
 	return path;
 }
 
+/**
+	Tworzy wzorzec ścieżki pliku tymczasowego dla mkstemp().
+	Plik tymczasowy leży w tym samym folderze, więc można go
+	atomowo podmienić funkcją rename().
+	@param[in] path Ścieżka docelowego pliku.
+	@return Wzorzec ścieżki pliku tymczasowego.
+ */
+static char *create_temp_path(const char *path)
+{
+	char *tmp = malloc(strlen(path) + strlen(".XXXXXX") + 1);
+	strcpy(tmp, path);
+	strcat(tmp, ".XXXXXX");
+	return tmp;
+}
+
 /**
 	Otwiera plik do zapisu słownika.
 	@param[in] path Ścieżka do pliku.
@@ -352,17 +729,157 @@ static int is_in_list(char *lang)
 	return exists;
 }
 
-static struct rule *create_rule(wchar_t * left, wchar_t *right,
+/**
+	Usuwa regułę.
+	@param[in] rule Reguła.
+ */
+static void free_rule(struct rule *rule)
+{
+	free(rule->left);
+	free(rule->right);
+	free(rule->program);
+	free(rule);
+}
+
+/**
+	Kompiluje stronę reguły do instrukcji.
+	@param[in,out] rule Reguła, do której programu dopisujemy instrukcje.
+	@param[in] side Strona reguły.
+	@param[in] len Długość strony.
+	@param[in] left Czy to lewa strona.
+	@param[in,out] bound Zmienne, które wystąpiły już po lewej stronie.
+ */
+static void compile_side(struct rule *rule, const wchar_t *side, size_t len,
+		bool left, bool *bound)
+{
+	for (size_t i = 0; i < len; )
+	{
+		struct rule_op *op = &rule->program[rule->ops++];
+		op->pos = i;
+		op->len = 1;
+		if (!iswdigit(side[i]))
+		{
+			op->code = OP_LITERAL;
+			while (i + op->len < len && !iswdigit(side[i + op->len]))
+				op->len++;
+			i += op->len;
+			continue;
+		}
+		op->variable = side[i] - L'0';
+		if (left)
+			op->code = bound[op->variable] ? OP_CHECK : OP_BIND;
+		else
+			op->code = bound[op->variable] ? OP_EMIT : OP_FREE;
+		bound[op->variable] |= left;
+		i++;
+	}
+}
+
+/**
+	Kompiluje regułę do instrukcji, żeby przy stosowaniu reguły nie
+	rozpoznawać od nowa zmiennych w jej stronach.
+	@param[in,out] rule Reguła z wypełnionymi stronami i ich długościami.
+	@return true jeśli się udało, false jeśli zabrakło pamięci.
+ */
+static bool compile_rule(struct rule *rule)
+{
+	bool bound[DIGITS] = { false };
+	rule->program = malloc(sizeof(struct rule_op) * (rule->left_len + rule->right_len + 1));
+	if (rule->program == NULL)
+		return false;
+	rule->ops = 0;
+	compile_side(rule, rule->left, rule->left_len, true, bound);
+	rule->left_ops = rule->ops;
+	compile_side(rule, rule->right, rule->right_len, false, bound);
+	rule->variable_right = false;
+	for (size_t i = rule->left_ops; i < rule->ops; i++)
+		if (rule->program[i].code != OP_LITERAL)
+			rule->variable_right = true;
+	return true;
+}
+
+/**
+	Tworzy regułę z kopiami obu stron.
+	@param[in] left Lewa strona reguły.
+	@param[in] right Prawa strona reguły.
+	@param[in] cost Koszt reguły.
+	@param[in] flag Flaga reguły.
+	@return Nowa reguła, NULL jeśli zabrakło pamięci.
+ */
+static struct rule *create_rule(const wchar_t *left, const wchar_t *right,
 								int cost, enum rule_flag flag)
 {
 	struct rule *rule = malloc(sizeof(struct rule));
-	rule->left = left;
-	rule->right = right;
+	if (rule == NULL)
+		return NULL;
+	rule->left = wcsdup(left);
+	rule->right = wcsdup(right);
+	if (rule->left == NULL || rule->right == NULL)
+	{
+		free(rule->left);
+		free(rule->right);
+		free(rule);
+		return NULL;
+	}
 	rule->cost = cost;
 	rule->flag = flag;
+	rule->left_len = wcslen(left);
+	rule->right_len = wcslen(right);
+	rule->free_pos = rule->right_len;
+	for (size_t i = 0; i < rule->right_len; i++)
+	{
+		if (iswdigit(right[i]) && wcschr(left, right[i]) == NULL)
+			rule->free_pos = i;
+	}
+	if (!compile_rule(rule))
+	{
+		free_rule(rule);
+		return NULL;
+	}
 	return rule;
 }
 
+/**
+	Dodaje regułę do słownika i do automatu lewych stron reguł.
+	@param[in,out] dict Słownik.
+	@param[in] left Lewa strona reguły.
+	@param[in] right Prawa strona reguły.
+	@param[in] cost Koszt reguły.
+	@param[in] flag Flaga reguły.
+	@return 0 jeśli się udało, -1 w p.p.
+ */
+static int add_rule(struct dictionary *dict, const wchar_t *left,
+		const wchar_t *right, int cost, enum rule_flag flag)
+{
+	struct rule *rule = create_rule(left, right, cost, flag);
+	if (rule == NULL)
+		return -1;
+	if (dict->matcher == NULL || rule_matcher_add(dict->matcher, rule->left) < 0)
+	{
+		free_rule(rule);
+		return -1;
+	}
+	rules_list_add(dict->rules, rule);
+	if (cost > dict->max_rule_cost)
+		dict->max_rule_cost = cost;
+	if (dict->min_rule_cost == 0 || cost < dict->min_rule_cost)
+		dict->min_rule_cost = cost;
+	if (flag == RULE_SPLIT)
+		dict->split_rules++;
+	int change = (int) rule->right_len - (int) rule->left_len;
+	if (change > 0 && change * dict->grow_cost > dict->grow_len * cost)
+	{
+		dict->grow_len = change;
+		dict->grow_cost = cost;
+	}
+	if (change < 0 && -change * dict->shrink_cost > dict->shrink_len * cost)
+	{
+		dict->shrink_len = -change;
+		dict->shrink_cost = cost;
+	}
+	return 0;
+}
+
 /**
 	Wczytuje kolejną liczbę z pliku.
 	@param[in] stream Plik, z którego czytamy.
@@ -453,7 +970,6 @@ static int rules_list_load(struct dictionary *dict, FILE *stream)
 		int cost = -1;
 		int flag = -1;
 		get_rule(&left, &right, &cost, &flag, stream);
-		fprintf(stderr, "%ls %ls %d %d\n", left, right, cost, flag);
 		if (left[0] == L'*')
 			left[0] = L'\0';
 		if (right[0] == L'*')
@@ -498,7 +1014,6 @@ static int rules_list_save(struct rules_list *list, FILE *stream)
  */
 static int count_variables(const wchar_t *left, const wchar_t *right)
 {
-	fprintf(stderr, "porownuje: %ls i %ls\n", left, right);
 	int variables_left[10];
 	int variables_right[10];
 	for (int i = 0; i < DIGITS; i++)
@@ -527,58 +1042,128 @@ static int count_variables(const wchar_t *left, const wchar_t *right)
 }
 
 /**
-	Dokonuje preprocessingu dla danego sufixu słowa word.
-	Wybiera reguły, które można zastosować.
-	@param[in] dict Słownik, którego reguły rozpatrujemy.
-	@param[in] word Słowo, do którego sufixu szukamy reguł.
-	@param[in] pos Pozycja początku sufixu.
-	@return Lista reguł, które można zastosować, bądź NULL jeżeli nie ma żadnej.
+	Dopasowuje lewą stronę reguły do początku sufiksu słowa.
+	Ta sama cyfra musi wszędzie oznaczać tę samą literę.
+	Wykonuje instrukcje lewej strony, patrz compile_rule().
+	@param[in] rule Reguła.
+	@param[in] suffix Sufiks słowa.
+	@param[in] suffix_len Długość sufiksu.
+	@param[out] variables Litery podstawione pod zmienne lewej strony,
+	pozostałe zmienne mają nieokreśloną wartość.
+	@return true jeśli lewa strona pasuje, false w p.p.
  */
-static struct rules_list * find_rules(struct dictionary *dict, wchar_t *word, size_t pos)
+static bool match_left(const struct rule *rule, const wchar_t *suffix,
+		size_t suffix_len, wchar_t *variables)
 {
-	size_t word_len = wcslen(word) - pos;
-	size_t rules_num = rules_list_size((void *)dict->rules);
-	struct rule **array = (struct rule **) rules_list_get((void *) dict->rules);
-	if (word_len == 0)
-		return NULL;
-	struct rules_list * pre_rules = malloc(sizeof(struct rules_list));
-	rules_list_init(pre_rules);
-	for (size_t i = 0; i < rules_num; i++)
+	if (rule->left_len > suffix_len)
+		return false;
+	const struct rule_op *end = rule->program + rule->left_ops;
+	for (const struct rule_op *op = rule->program; op < end; op++)
 	{
-		size_t len = wcslen(array[i]->left);
-		if (len == 0)
-		{
-			rules_list_add(pre_rules, (void *) array[i]);
-			fprintf(stderr, "dadaje pustą regułe\n");
-		}
-		else if (word[pos] == array[i]->left[0])
-		{
-			if (len <= word_len && wcsncmp(array[i]->left, word+pos, len) == 0)
-				rules_list_add(pre_rules, (void *) array[i]);
-		}
-		else if (iswdigit(array[i]->left[0]) && len <= word_len)
+		switch (op->code)
 		{
-			size_t idx = 0;
-			while (idx < len && (iswdigit(array[i]->left[idx]) || word[pos + idx] == array[i]->left[idx]))
-			{
-				idx++;
-			}
-			if (idx == len)
-				rules_list_add(pre_rules, (void *) array[i]);
+		case OP_LITERAL:
+			if (wmemcmp(rule->left + op->pos, suffix + op->pos, op->len) != 0)
+				return false;
+			break;
+		case OP_BIND:
+			variables[op->variable] = suffix[op->pos];
+			break;
+		case OP_CHECK:
+			if (variables[op->variable] != suffix[op->pos])
+				return false;
+			break;
+		default:
+			break;
 		}
 	}
-	fprintf(stderr, "find_rules, dla słowa: %ls mam %d pozycji\n", word+pos, (int)rules_list_size(pre_rules));
-	for (size_t i = 0; i < rules_list_size(pre_rules); i++)
-		fprintf(stderr, "find_rules: %ls %ls %d %d\n", ((struct rule*)pre_rules->array[i])->left,
-				((struct rule*)pre_rules->array[i])->right, ((struct rule*)pre_rules->array[i])->cost,
-				((struct rule*)pre_rules->array[i])->flag);
-	if (rules_list_size(pre_rules) == 0)
+	return true;
+}
+
+/**
+	Wyznacza prawą stronę reguły z podstawionymi zmiennymi.
+	Wykonuje instrukcje prawej strony, patrz compile_rule().
+	@param[in] rule Reguła.
+	@param[in] variables Litery podstawione pod zmienne przez match_left().
+	@param[out] buffer Bufor na right_len + 1 znaków.
+	@return Prawa strona, rule->right jeśli nie zawiera zmiennych, buffer w p.p.,
+	wtedy litera zmiennej występującej tylko po prawej jest nieokreślona.
+ */
+static wchar_t *substitute_right(const struct rule *rule, const wchar_t *variables,
+		wchar_t *buffer)
+{
+	if (!rule->variable_right)
+		return rule->right;
+	const struct rule_op *end = rule->program + rule->ops;
+	for (const struct rule_op *op = rule->program + rule->left_ops; op < end; op++)
+	{
+		if (op->code == OP_LITERAL)
+			wmemcpy(buffer + op->pos, rule->right + op->pos, op->len);
+		else if (op->code == OP_EMIT)
+			buffer[op->pos] = variables[op->variable];
+	}
+	buffer[rule->right_len] = L'\0';
+	return buffer;
+}
+
+/**
+	Zwraca automat lewych stron reguł słownika.
+	Krawędzie automatu są uzupełniane przy pierwszym zapytaniu po
+	dodaniu reguł.
+	@param[in] dict Słownik.
+	@return Automat, NULL jeśli zabrakło pamięci.
+ */
+static struct rule_matcher *get_matcher(const struct dictionary *dict)
+{
+	struct dictionary *cache = (struct dictionary *) dict;
+	if (cache->matcher == NULL)
+		return NULL;
+	pthread_mutex_lock(&cache->matcher_lock);
+	int success = rule_matcher_prepare(cache->matcher);
+	pthread_mutex_unlock(&cache->matcher_lock);
+	return success == 0 ? cache->matcher : NULL;
+}
+
+/**
+	Zwraca listę reguł o danym koszcie pasujących do sufiksu słowa.
+	@param[in] query Zapytanie.
+	@param[in] pos Pozycja początku sufiksu.
+	@param[in] cost Koszt reguł, od 1 do query->max_cost.
+	@return Wskaźnik na listę, która jest NULL, jeśli nie ma takich reguł.
+ */
+static struct rules_list **suffix_rules(const struct hints_query *query, size_t pos, int cost)
+{
+	return &query->rules[pos * query->max_cost + cost - 1];
+}
+
+/**
+	Sprawdza dopasowanie znalezione przez automat i dodaje regułę
+	do listy reguł sufiksu, od którego pasuje.
+	@param[in] pattern Indeks reguły w liście reguł słownika.
+	@param[in] pos Pozycja początku sufiksu.
+	@param[in,out] data Zapytanie.
+ */
+static void add_matched_rule(size_t pattern, size_t pos, void *data)
+{
+	struct hints_query *query = data;
+	struct rule *rule = (struct rule *) rules_list_get(query->dict->rules)[pattern];
+	wchar_t variables[DIGITS];
+	if (rule->flag == RULE_BEGIN && pos != 0)
+		return;
+	if (rule->flag == RULE_END && pos + rule->left_len != query->len)
+		return;
+	if (rule->cost > query->max_cost)
+		return;
+	if (!match_left(rule, query->word + pos, query->len - pos, variables))
+		return;
+	struct rules_list **rules = suffix_rules(query, pos, rule->cost);
+	if (*rules == NULL)
 	{
-		rules_list_done(pre_rules, DEL_NO);
-		free(pre_rules);
-		pre_rules = NULL;
+		*rules = arena_alloc(query->arena, sizeof(struct rules_list));
+		rules_list_init_arena(*rules, query->arena);
 	}
-	return pre_rules;
+	rules_list_add(*rules, rule);
+	query->matched[pos] = true;
 }
 
 /**
@@ -586,26 +1171,123 @@ static struct rules_list * find_rules(struct dictionary *dict, wchar_t *word, si
  * Otóż, aby za każdym razem nie próbować dla danego stanu (suf, node) wszystkich reguł,
  * których może być sporo, a większość z nich i tak nie daje się zastosować,
  * należy przed przystąpieniem do generowania podpowiedzi dla słowa w stablicować trochę informacji.
- * Mianowicie dla każdego niepustego sufiksu suf słowa w robimy listę reguł r takich, że lewa strona r daje się przypasować do początku suf.
+ * Mianowicie dla każdego sufiksu suf słowa w robimy listę reguł r takich, że lewa strona r daje się przypasować do początku suf.
  * W ten sposób ograniczamy znacznie liczbę reguł przeglądanych w pętli reguł.
+ * Listy dla wszystkich sufiksów wyznaczamy jednym przejściem automatu
+ * lewych stron reguł po słowie. Każdą listę dzielimy jeszcze według
+ * kosztu reguł, tak aby warstwa przeglądała tylko reguły, które w niej
+ * mogą się zastosować.
  */
 /**
 	Funkcja zwraca zbiór reguł, które można zastosować do sufixów danego słowa.
-	@param[in] dict Słownik, na którym operujemy.
-	@param[in] word Słowo, dla którego szukamy reguł.
-	@param[in, out] Tablica, w której zapisywane są znalezione reguły.
-	@return Tablica, w której zapisywane są znalezione reguły.
+	@param[in,out] query Zapytanie.
+	@return Tablica list reguł indeksowana pozycją początku sufiksu i kosztem,
+	patrz suffix_rules().
  */
-static struct rules_list **preprocess_rules(struct dictionary *dict, wchar_t *word, struct rules_list **preprocess)
+static struct rules_list **preprocess_rules(struct hints_query *query)
 {
-	size_t word_len = wcslen(word);
-	for (size_t i = 0; i < word_len; i++)
-	{
-		preprocess[i] = find_rules(dict, word, i);
-		fprintf(stderr, "preprocess_rules dla %ls\n", word+i);
-	}
-	fprintf(stderr, "wskaźnik od preprocess: %p i size: %d\n", preprocess, rules_list_size(preprocess[0]));
-	return preprocess;
+	size_t lists = (query->len + 1) * query->max_cost;
+	query->rules = arena_alloc(query->arena, sizeof(struct rules_list *) * (lists + 1));
+	for (size_t i = 0; i < lists; i++)
+		query->rules[i] = NULL;
+	query->matched = arena_alloc(query->arena, sizeof(bool) * (query->len + 1));
+	memset(query->matched, 0, sizeof(bool) * (query->len + 1));
+	struct rule_matcher *matcher = get_matcher(query->dict);
+	if (matcher != NULL)
+		rule_matcher_run(matcher, query->word, query->len, add_matched_rule, query);
+	return query->rules;
+}
+
+/**
+	Dodaje nowy stan do zbioru stanów zapytania.
+	Wątek zbierający stany sprawdza też stany wcześniejszych warstw,
+	które w tym czasie nie są zmieniane.
+	@param[in,out] query Zapytanie.
+	@param[in] state Stan.
+	@return true jeśli stan jest nowy, false w p.p.
+ */
+static bool add_seen(struct hints_query *query, struct state *state)
+{
+	if (query->shared != NULL && state_set_find(query->shared, state->pos,
+			state->node, state->start) != NULL)
+		return false;
+	return state_set_add(&query->seen, state);
+}
+
+/**
+	Sprawdza, czy zapytanie przekroczyło ograniczenia wyszukiwania.
+	Wątek zbierający stany liczy stany wcześniejszych warstw i swoje,
+	a pamięć tylko swojej areny. Między warstwami liczymy pamięć
+	zapytania razem z arenami wątków.
+	@param[in,out] query Zapytanie.
+	@return true jeśli trzeba przerwać wyszukiwanie, false w p.p.
+ */
+static bool query_exceeded(struct hints_query *query)
+{
+	if (query->budget.limits == NULL)
+		return false;
+	size_t states = query->seen.size;
+	size_t bytes = arena_used(query->arena);
+	if (query->shared != NULL)
+		states += query->shared->size;
+	else if (query->workers != NULL)
+		for (int i = 0; i < query->threads; i++)
+			bytes += arena_used(&query->workers[i].arena);
+	return budget_exceeded(&query->budget, states, bytes);
+}
+
+/**
+	Wyznacza najmniejszy koszt reguł, które razem zmieniają długość
+	słowa o change liter, jeśli każda reguła zmienia ją o co najwyżej
+	len liter na cost kosztu.
+	@param[in] change Potrzebna zmiana długości.
+	@param[in] len Licznik największej zmiany długości.
+	@param[in] cost Mianownik największej zmiany długości.
+	@return Koszt, INT_MAX jeśli żadna reguła nie zmienia długości.
+ */
+static int change_cost(size_t change, int len, int cost)
+{
+	if (len == 0)
+		return INT_MAX;
+	size_t total = (change * cost + len - 1) / len;
+	return total > INT_MAX ? INT_MAX : (int) total;
+}
+
+/**
+	Wyznacza dolne ograniczenie kosztu dokończenia słowa podpowiedzi
+	w poddrzewie węzła, z ograniczeń poddrzewa (patrz struct nodeInfo).
+	Słowo poddrzewa krótsze od reszty słowa wymaga reguł skracających,
+	a dłuższe wydłużających, co najmniej o różnicę długości. Litera reszty
+	słowa, której nie ma w poddrzewie, wymaga co najmniej jednej reguły.
+	Przy regułach z flagą s reszta słowa może należeć do następnych słów,
+	więc zostaje tylko ograniczenie najkrótszym słowem poddrzewa.
+	W sesji podpowiedzi słowo może się jeszcze wydłużyć, więc tam nie
+	ograniczamy kosztu.
+	Przejście litery bez zmian nie zmniejsza ograniczenia, a reguła
+	zmniejsza je co najwyżej o swój koszt, więc nadaje się ono do A*.
+	@param[in] query Zapytanie.
+	@param[in] pos Pozycja w słowie.
+	@param[in] node Węzeł drzewa.
+	@param[in] ahead Liczba liter, które zostaną jeszcze dopisane do
+	podpowiedzi przed dojściem do pozycji pos, schodząc w dół od węzła.
+	@return Dolne ograniczenie kosztu, INT_MAX jeśli słowa nie da się dokończyć.
+ */
+static int subtree_cost(const struct hints_query *query, size_t pos,
+		const struct nodeInfo *node, size_t ahead)
+{
+	const struct dictionary *dict = query->dict;
+	if (query->session)
+		return 0;
+	size_t rest = query->len - pos + ahead;
+	if (node->min_depth == TRIE_UNBOUNDED)
+		return INT_MAX;
+	if (node->min_depth > rest)
+		return change_cost(node->min_depth - rest, dict->grow_len, dict->grow_cost);
+	if (dict->split_rules > 0)
+		return 0;
+	if (node->max_depth < rest)
+		return change_cost(rest - node->max_depth, dict->shrink_len, dict->shrink_cost);
+	return (query->letters[pos] & ~node->letters) != 0 ? query->min_cost : 0;
 }
 
 /**
@@ -616,428 +1298,577 @@ static struct rules_list **preprocess_rules(struct dictionary *dict, wchar_t *wo
 	Mianowicie bierzemy pierwszą literę a sufiksu suf, patrzymy,
 	czy istnieje dziecko node o etykiecie a i jeśli tak to generujemy nowy stan odcinając a z suf
 	i biorąc to dziecko node. Proces ten powtarzamy dla nowego stanu tak długo jak możemy.
-	Tę procedurę nazwiemy Rozwiń(stan). Dla danego stanu stan w wyniku daje wszystkie stany,
-	do których można dojść przez przechodzenie liter bez ich zmieniania.
 	Będzie co najwyżej |suf| + 1 takich stanów, gdzie |suf| jest długością suf.
-	Stany o koszcie zero uzyskujemy uruchamiając Rozwiń(stan początkowy).
+	Tworzymy tylko stany, do których pasuje jakaś reguła, oraz stan
+	końcowy, bo z pozostałych można tylko przejść dalej. Litery
+	pominiętych stanów trafiają do fragmentu następnego utworzonego
+	stanu i wskazują na słowo, więc nic nie jest kopiowane.
+	Jeśli trafimy na stan, który już był, to przerywamy, bo jego
+	rozwinięcie też już było. Przerywamy też, gdy ograniczenia poddrzewa
+	nie pozwalają dokończyć słowa, bo dalej mogą tylko rosnąć.
+	@param[in,out] query Zapytanie.
+	@param[in,out] vec Lista, do której dodawane są stany.
+	@param[in] state Rozwijany stan.
  */
-static void expand_state(struct rules_list *vec, struct state *state)
+static void expand_state(struct hints_query *query, struct rules_list *vec,
+		struct state *state)
 {
-	bool end = false;
-	while (!end)
+	struct nodeInfo *node = state->node;
+	size_t from = state->pos;
+	for (size_t pos = state->pos; pos < query->len; )
 	{
-		if (at(state->node->children, state->word[0]) != NULL
-				&& (wcslen(state->word) > 1 || (wcslen(state->word) == 1
-				&& at(state->node->children, state->word[0])->node->number == WORD)))
-		{
-			fprintf(stderr, "expand state zabieram: %lc\n", state->word[0]);
-			wchar_t change[2] = { state->word[0], L'\0' };
-			struct state *nstate = create_state(state->word, 1, 1, state->cost, change,
-						at(state->node->children, state->word[0])->node, state, 0);
-			rules_list_add(vec, (void *) nstate);
-			state = nstate;
-		}
-		else
-			end = true;
+		vectorItem *child = at(trie_children(node), query->word[pos]);
+		if (child == NULL)
+			break;
+		node = child->node;
+		if (subtree_cost(query, ++pos, node, 0) > query->dict->cost - state->cost)
+			break;
+		if (pos < query->len && !query->matched[pos])
+			continue;
+		state = create_state(query->arena, pos, node, state->cost, state,
+				query->word + from, pos - from, state->start);
+		from = pos;
+		if (!add_seen(query, state))
+			break;
+		rules_list_add(vec, state);
 	}
 }
 
-static wchar_t *get_right(struct state *state, struct rule *rule, int *pos, bool *found)
+/**
+	Przechodzi po drzewie resztę słowa od stanu, bez żadnych zmian.
+	Do tej samej pozycji i węzła dochodzimy wieloma drogami, więc wynik
+	dłuższych przejść zapamiętujemy. Pierwsze MEMO_WALK liter przechodzimy
+	zawsze, bo krótkie przejście taniej powtórzyć niż szukać w pamięci.
+	@param[in,out] query Zapytanie.
+	@param[in] state Stan.
+	@return Węzeł, do którego doszliśmy, NULL jeśli nie ma takiej ścieżki.
+ */
+static struct nodeInfo *follow_word(struct hints_query *query,
+		const struct state *state)
 {
-	fprintf(stderr, "getright\n");
-	wchar_t variables[DIGITS];
-	for (int i = 0; i < DIGITS; i++)
-		variables[i] = L'\0';
-	size_t left_len = wcslen(rule->left);
-	size_t right_len = wcslen(rule->right);
-	size_t i = 0;
-	while (i < left_len)
-	{
-		if (iswdigit(rule->left[i]))
-			variables[rule->left[i] - L'0'] = state->word[i];
-		i++;
+	struct nodeInfo *node = state->node;
+	size_t pos = state->pos;
+	for (; pos < query->len && pos < state->pos + MEMO_WALK; pos++)
+	{
+		vectorItem *child = at(trie_children(node), query->word[pos]);
+		if (child == NULL)
+			return NULL;
+		node = child->node;
 	}
-	i = 0;
-	wchar_t *change = malloc(sizeof(wchar_t) * (right_len + 1));
-	memset(change, L'\0', sizeof(wchar_t) * (right_len + 1));
-	while (i < right_len)
+	if (pos == query->len)
+		return node;
+	const struct walk *walk = walk_memo_find(&query->walks, pos, node);
+	if (walk == NULL)
 	{
-		if (iswdigit(rule->right[i]))
+		struct nodeInfo *from = node;
+		size_t begin = pos;
+		for (; pos < query->len; pos++)
 		{
-			if (variables[rule->right[i] - L'0'] == L'\0')
-			{
-				*found = true;
-				*pos = i;
-			}
-			else
-			{
-				change[i] = variables[rule->right[i] - L'0'];
-
-			}
+			vectorItem *child = at(trie_children(node), query->word[pos]);
+			if (child == NULL)
+				break;
+			node = child->node;
 		}
-		else
+		walk_memo_add(&query->walks, begin, from, node, pos - begin);
+		return pos == query->len ? node : NULL;
+	}
+	return walk->pos + walk->len == query->len ? walk->end : NULL;
+}
+
+/**
+	Wyznacza dolne ograniczenie kosztu dojścia ze stanu do stanu końcowego.
+	Jeśli przechodząc kolejne litery bez zmian dojdziemy do końca słowa
+	na słowie ze słownika, to ograniczeniem jest 0, w p.p. potrzebna jest
+	jeszcze co najmniej jedna reguła. Przejście litery bez zmian nic nie
+	kosztuje, więc silniejsze ograniczenie, np. koszt reguły na każdą
+	pozostałą literę, mogłoby pominąć podpowiedzi. Ograniczenie może
+	jeszcze podnieść subtree_cost().
+	@param[in] query Zapytanie.
+	@param[in] state Stan.
+	@param[in] end Węzeł zwrócony przez follow_word() dla stanu.
+	@return Dolne ograniczenie kosztu, INT_MAX jeśli słowa nie da się dokończyć.
+ */
+static int remaining_cost(const struct hints_query *query, const struct state *state,
+		const struct nodeInfo *end)
+{
+	if (end != NULL && end->number == WORD)
+		return 0;
+	int bound = subtree_cost(query, state->pos, state->node, 0);
+	return bound > query->min_cost ? bound : query->min_cost;
+}
+
+/**
+	Wstawia do kolejki nowy stan razem z jego rozwinięciem, o ile mogą
+	one prowadzić do podpowiedzi o koszcie nie większym niż maksymalny.
+	Wszystkie stany rozwinięcia leżą na tej samej ścieżce liter bez zmian,
+	więc mają to samo dolne ograniczenie.
+	Jeśli do stanu nie da się już zastosować żadnej reguły, to z całego
+	rozwinięcia liczy się tylko stan końcowy i tylko on jest tworzony
+	i dodawany do zbioru stanów, z resztą słowa jako jednym fragmentem.
+	Stan, który był już wcześniej, trafiłby na ten sam stan końcowy.
+	@param[in,out] query Zapytanie.
+	@param[in] state Nowy stan.
+	@param[in] check Czy sprawdzać, czy stan już był.
+ */
+static void push_state(struct hints_query *query, struct state *state, bool check)
+{
+	struct nodeInfo *end = follow_word(query, state);
+	int bound = remaining_cost(query, state, end);
+	if (bound > query->dict->cost - state->cost)
+		return;
+	int priority = state->cost + bound;
+	if (state->cost + query->min_cost > query->dict->cost)
+	{
+		if (state->pos < query->len)
 		{
-			change[i] = rule->right[i];
+			state = create_state(query->arena, query->len, end, state->cost, state,
+					query->word + state->pos, query->len - state->pos, state->start);
+			check = true;
 		}
-		i++;
+		if (!check || state_set_add(&query->seen, state))
+			state_queue_push(query->queue, state, priority);
+		return;
 	}
-	return change;
+	if (check && !state_set_add(&query->seen, state))
+		return;
+	struct rules_list chain;
+	rules_list_init_arena(&chain, query->arena);
+	rules_list_add(&chain, state);
+	expand_state(query, &chain, state);
+	struct state **states = (struct state **) rules_list_get(&chain);
+	for (size_t i = 0; i < rules_list_size(&chain); i++)
+		state_queue_push(query->queue, states[i], priority);
 }
 
-///@todo dodaj obslugę flag
-static struct rules_list *traverse(struct dictionary *dict, struct state *state, struct rule *rule, int word_len)
+/**
+	Tworzy stan po zastosowaniu reguły i go rozwija.
+	Stan, który już był, jest odrzucany. W algorytmie best-first stan
+	trafia do kolejki i jest rozwijany dopiero po wyjęciu z niej.
+	@param[in,out] query Zapytanie.
+	@param[in] state Stan, do którego zastosowano regułę.
+	@param[in] rule Zastosowana reguła.
+	@param[in] right Prawa strona reguły z podstawionymi zmiennymi.
+	@param[in] node Węzeł, do którego doszliśmy prawą stroną reguły.
+	@param[in,out] states Lista, do której dodawane są nowe stany,
+	nieużywana w algorytmie best-first.
+ */
+static void add_rule_state(struct hints_query *query, struct state *state,
+		const struct rule *rule, const wchar_t *right, struct nodeInfo *node,
+		struct rules_list *states)
 {
+	size_t pos = state->pos + rule->left_len;
+	int cost = state->cost + rule->cost;
+	bool split = rule->flag == RULE_SPLIT;
+	// Reguła z flagą s kończy słowo, więc musimy dojść do końca słowa.
+	if (split && node->number != WORD)
+		return;
+	size_t fragment_len = rule->right_len + (split ? 1 : 0);
+	wchar_t *fragment = L"";
+	if (fragment_len > 0)
+	{
+		fragment = arena_alloc(query->arena, sizeof(wchar_t) * fragment_len);
+		wmemcpy(fragment, right, rule->right_len);
+		if (split)
+			fragment[rule->right_len] = L' ';
+	}
 	struct state *nstate;
-	struct rules_list *states = malloc(sizeof(struct rules_list));
-	rules_list_init(states);
-	size_t right_len = wcslen(rule->right);
-	size_t left_len = wcslen(rule->left);
-	size_t i = 0;
-	struct nodeInfo *node = state->node;
-	bool found_new = false;
-	bool end = false;
-	int pos_new = -1;
-	wchar_t *change = get_right(state, rule, &pos_new, &found_new);
-	fprintf(stderr, "traverse i change: %ls found_new: %d\n", change, (int) found_new);
-	bool can_add;
-	if (!found_new)
-	{
-		i = 0;
-		while (i < right_len && !end)
-		{
-			if (at(node->children, change[i]) == NULL)
-				end = true;
-			else
-				node = at(node->children, change[i])->node;
-			i++;
-		}
-		if (!end)
+	if (split)
+	{
+		// Następne słowo zaczyna się od korzenia.
+		nstate = create_state(query->arena, pos, query->dict->root, cost, state,
+				fragment, fragment_len, NULL);
+		nstate->start = nstate;
+		if (query->pieces != NULL)
 		{
-			can_add = rule->flag == RULE_BEGIN && word_len == wcslen(state->word) && state->node->number == ROOT;
-			can_add = can_add || (rule->flag == RULE_END && wcslen(state->word) == left_len && node->number == WORD);
-			can_add = can_add || (rule->flag == RULE_SPLIT && node->number == WORD);
-			can_add = can_add || rule->flag == RULE_NORMAL;
-			if (can_add)
-			{
-				fprintf(stderr, "hurray1");
-				if (rule->flag == RULE_SPLIT)
-				{
-					append(change, L" ", wcslen(change)+1);
-					nstate = create_state(state->word, left_len, right_len, state->cost + rule->cost, change, dict->root, state, 1);
-				}
-				else
-					nstate = create_state(state->word, left_len, right_len, state->cost + rule->cost, change, node, state, 0);
-				rules_list_add(states, (void *)nstate);
-				expand_state(states, nstate);
-				// to niżej to niepotrzebne
-//				fprintf(stderr, "****DEBUG****\n");
-//				nstate = create_state(state->word, left_len, right_len, state->cost + rule->cost + 1, change, node, state, 0);
-//				rules_list_add(states, (void *)nstate);
-//				expand_state(states, nstate);
-//				fprintf(stderr, "****END_DEBUG****\n");
-			}
+			rules_list_add(query->pieces, nstate);
+			return;
 		}
-		free(change);
 	}
 	else
+		nstate = create_state(query->arena, pos, node, cost, state,
+				fragment, fragment_len, state->start);
+	if (query->session)
 	{
-		size_t j = 0;
-		wchar_t * next = malloc(sizeof(wchar_t) * (wcslen(change)+1));
-		wcscpy(next, change);
-		fprintf(stderr, "tyle mam synów: %d\n", size(state->node->children));
-		if (change != NULL)
-		{
-			free(change);
-			change = NULL;
-		}
-
-		for (j = 0; j < size(state->node->children); j++)
-		{
-			fprintf(stderr, "sprawedzam: %d\n", j);
-			i = 0;
-			end = false;
-			node = state->node;
-			change = malloc(sizeof(wchar_t) * (wcslen(next)+1));
-			wcscpy(change, next);
-			fprintf(stderr, "moj change: %ls\n", change);
-			while (i < right_len && !end)
-			{
-				if (pos_new == i)
-				{
-					if (at_pos(node->children, j) == NULL)
-						end = true;
-					else
-					{
-						fprintf(stderr, "!!!!%ls, %d, pos_new: %d\n", change, wcslen(change), pos_new);
-						vectorItem *n = at_pos(node->children, j);
-						wchar_t str[2] = { n->symbol, L'\0' };
-						if (wcslen(change) == 0)
-						{
-							change = malloc(sizeof(wchar_t) * 2);
-							change[0] = n->symbol;
-							change[1] = L'\0';
-						}
-						else {
-						assert(change != NULL);
-						append(change, str, pos_new);
-						}
-						node = n->node;
-						fprintf(stderr, "2moj change: %ls\n", change);
-					}
-				}
-				else
-				{
-					if (at(node->children, change[i]) == NULL)
-						end = true;
-					else
-						node = at(node->children, change[i])->node;
-				}
-				i++;
-				if (!end)
-				{
-					fprintf(stderr, "hurray2");
-					can_add = rule->flag == RULE_BEGIN && word_len == wcslen(state->word) && state->node->number == ROOT;
-					can_add = can_add || (rule->flag == RULE_END && wcslen(state->word) == left_len && node->number == WORD);
-					can_add = can_add || (rule->flag == RULE_SPLIT && node->number == WORD);
-					can_add = can_add || rule->flag == RULE_NORMAL;
-					fprintf(stderr, "3moj change: %ls\n", change);
-					nstate = create_state(state->word, left_len, right_len, state->cost + rule->cost, change, node, state, 0);
-					if (rule->flag == RULE_SPLIT)
-					{
-						append(change, L" ", wcslen(change)+1);
-						nstate = create_state(state->word, left_len, right_len, state->cost + rule->cost, change, dict->root, state, 1);
-					}
-					rules_list_add(states, (void *)nstate);
-					expand_state(states, nstate);
-					//// hejahej
-	//				fprintf(stderr, "****DEBUG****\n");
-	//				nstate = create_state(state->word, left_len, right_len, state->cost + rule->cost + 1, change, node, state, 0);
-	//				rules_list_add(states, (void *)nstate);
-	//				expand_state(states, nstate);
-	//				fprintf(stderr, "****END_DEBUG****\n");
-				}
-			}
-		}
-		if (change != NULL)
-		{
-			free(change);
-			change = NULL;
-		}
-		if (next != NULL)
-		{
-			free(next);
-			next = NULL;
-		}
+		state_queue_push(query->queue, nstate, nstate->cost);
+		return;
+	}
+	// Stan po regule z flagą s zaczyna nowe słowo, więc zawsze jest nowy.
+	if (query->queue != NULL)
+	{
+		push_state(query, nstate, !split);
+		return;
 	}
-	return states;
+	if (subtree_cost(query, pos, nstate->node, 0) > query->dict->cost - cost
+			|| (!split && !add_seen(query, nstate)))
+		return;
+	rules_list_add(states, nstate);
+	expand_state(query, states, nstate);
 }
 
 /**
-	ZbierzStany(k)
-	warstwa[k] ← ∅
-	dla i = 1, ..., k
-	dla każdego stanu stan ∈ warstawa[k - i]
-	dla każdej reguły r o koszcie i, która stosuje się do stanu stan // pętla reguł
-	warstwa[k] ← warstwa[k] ∪ Rozwiń(stan otrzymany po przejściu z stan regułą r)
-	Dodaje do listy stany o koszcie cost.
-	@param[in] cost Koszt stanów, które zbieramy.
-
+	Przechodzi po drzewie prawą stroną reguły.
+	Na pozycji zmiennej niewystępującej po lewej stronie reguły
+	próbujemy kolejno wszystkich dzieci bieżącego węzła. Poddrzewa,
+	w których nie da się dokończyć słowa, pomijamy.
+	@param[in,out] query Zapytanie.
+	@param[in] state Stan, do którego stosujemy regułę.
+	@param[in] rule Stosowana reguła.
+	@param[in,out] right Prawa strona reguły z podstawionymi zmiennymi.
+	@param[in] from Pozycja w right, od której przechodzimy.
+	@param[in] node Węzeł, do którego doszliśmy pierwszymi from literami right.
+	@param[in,out] states Lista, do której dodawane są nowe stany.
  */
-static void collect_states(struct dictionary *dict, int cost, int word_len, struct rules_list **layers, struct rules_list **rules)
+static void traverse(struct hints_query *query, struct state *state,
+		const struct rule *rule, wchar_t *right, size_t from,
+		struct nodeInfo *node, struct rules_list *states)
 {
-	fprintf(stderr, "======================\ncollect states dla kosztu: %d\n", cost);
-	for (size_t i = 1; i <= cost; i++)
+	if (subtree_cost(query, state->pos + rule->left_len, node, rule->right_len - from)
+			> query->dict->cost - state->cost - rule->cost)
+		return;
+	for (size_t i = from; i < rule->right_len; i++)
 	{
-		size_t layer_len = rules_list_size(layers[cost - i]);
-		struct state **layer_states = (struct state **) rules_list_get(layers[cost-i]);
-		fprintf(stderr, "koszt: %d tyle mam stanów dla warstwy %d: %d\n", cost, cost - (int)i, (int)layer_len);
-//	dla każdego stanu stan ∈ warstawa[k - i]
-		for (size_t j = 0; j < layer_len; j++)
+		vector *children = trie_children(node);
+		if (i == rule->free_pos)
 		{
-			struct state *state = layer_states[j];
-			if (state != NULL)
+			for (int j = 0; j < size(children); j++)
 			{
-				//tu zmieniłam && na ||
-				fprintf(stderr, "pozycja w tablicy stanów: word_len: %d, długoś słowa w stanie: %d, róznica: %d\n", word_len, (int)wcslen(state->word), word_len - (int)wcslen(state->word));
-				if (!(wcslen(state->word) == 0 || state->node->number == WORD))
-				{
-					struct rule **state_rules = (struct rule **)rules_list_get(rules[word_len - wcslen(state->word)]);
-					size_t rules_len = rules_list_size(rules[word_len - wcslen(state->word)]);
-		//			dla każdej reguły r o koszcie i, która stosuje się do stanu stan // pętla reguł
-					fprintf(stderr, "tyle reguł: %d dla stanu z warstwy %d\n", (int)rules_len, cost-(int) i);
-					for (size_t k = 0; k < rules_len; k++)
-					{
-						if (state_rules[k]->cost == i)
-						{
-							fprintf(stderr, "znalazło regułe o danym koszcie: %d: %ls -> %ls\n", state_rules[k]->cost, state_rules[k]->left, state_rules[k]->right);
-							struct rules_list *next = traverse(dict, state, state_rules[k], word_len);
-							fprintf(stderr, "lista stanów:  %d\n", (int)rules_list_size(next));
-							for (size_t l = 0; l < rules_list_size(next); l++)
-							{
-								fprintf(stderr, "taki stan: word:%ls change:%ls %d %d\n", ((struct state *)rules_list_get(next)[l])->word,
-										((struct state *)rules_list_get(next)[l])->change, ((struct state *)rules_list_get(next)[l])->cost,
-										((struct state *)rules_list_get(next)[l])->node->number);
-								rules_list_add(layers[cost], rules_list_get(next)[l]);
-							}
-							rules_list_done(next, DEL_NO);
-							free(next);
-							fprintf(stderr, "----Stany z warstwy o koszcie: %d----\n", cost);
-							for (size_t l = 0; l < rules_list_size(layers[cost]); l++)
-								fprintf(stderr, "taki stan: word:%ls change:%ls %d %d\n", ((struct state *)rules_list_get(layers[cost])[l])->word,
-								((struct state *)rules_list_get(layers[cost])[l])->change, ((struct state *)rules_list_get(layers[cost])[l])->cost,
-								((struct state *)rules_list_get(layers[cost])[l])->node->number);
-
-						}
-					}
-				}
+				vectorItem *child = at_pos(children, j);
+				right[i] = child->symbol;
+				traverse(query, state, rule, right, i + 1, child->node, states);
 			}
+			return;
 		}
+		vectorItem *child = at(children, right[i]);
+		if (child == NULL)
+			return;
+		node = child->node;
 	}
-	fprintf(stderr, "=============================\n");
+	add_rule_state(query, state, rule, right, node, states);
 }
 
 /**
-	Funkcja porównująca do sortowania.
-	@param[in] a Pierwszy element do porównania.
-	@param[in] b Drugi element.
-	@return -1, jeżeli a < b, 0, gdy a == b, 1, gdy a > b.
+	Stosuje regułę do stanu.
+	Lewa strona reguły pasuje do sufiksu stanu, co sprawdził find_rules().
+	@param[in,out] query Zapytanie.
+	@param[in] state Stan, do którego stosujemy regułę.
+	@param[in] rule Stosowana reguła.
+	@param[in,out] states Lista, do której dodawane są nowe stany.
  */
-static int my_compare (const void * a, const void * b)
+static void apply_rule(struct hints_query *query, struct state *state,
+		const struct rule *rule, struct rules_list *states)
 {
-    struct state *_a = **(struct state ***)a;
-    struct state *_b = **(struct state ***)b;
-//    fprintf(stderr, "a: %ls, b: %ls\n", _a->word, _b->word);
-    int res_w = wcscoll(_a->word, _b->word);
-    if (res_w < 0)
-    	return -1;
-    else if (res_w == 0)
-    {
-    	int res_c = wcscoll(_a->change, _b->change);
-    	if (res_c < 0)
-    		return -1;
-    	else if (res_c == 0)
-    	{
-    		if (_a->cost < _b->cost)
-    			return -1;
-    		else if (_a->cost == _b->cost)
-				return 0;
-			else return 1;
-    	}
-    }
-    else return 1;
+	wchar_t variables[DIGITS];
+	wchar_t buffer[rule->right_len + 1];
+	match_left(rule, query->word + state->pos, query->len - state->pos, variables);
+	traverse(query, state, rule, substitute_right(rule, variables, buffer), 0,
+			state->node, states);
 }
 
 /**
-	FiltrujStany(k)
-	tablica ← ∅
-	dla i = 0, ..., k
-	 dla każdego stanu stan ∈ warstawa[i]
-		 // w tablica zbieramy pary (stan, koszt tego stanu)
-		 tablica ← tablica ∪ {(stan, i)}
-	// Sortujemy tablica leksykograficznie
-	Sortuj(tablica)
-	// Wśród par w tablica, które zgadzają się na pierwszej współrzędnej zostawiamy tylko jeden o najmniejszej drugiej współrzędnej
-	Unique(tablica)
-	warstwa[k] ← {stan | (stan, k) ∈ tablica}
+	Stosuje do stanu wszystkie pasujące reguły o danym koszcie.
+	@param[in,out] query Zapytanie.
+	@param[in] state Stan.
+	@param[in] cost Koszt reguł.
+	@param[in,out] states Lista, do której dodawane są nowe stany.
+ */
+static void apply_rules(struct hints_query *query, struct state *state, int cost,
+		struct rules_list *states)
+{
+	struct rules_list *rules = *suffix_rules(query, state->pos, cost);
+	struct rule **state_rules = (struct rule **) rules_list_get(rules);
+	for (size_t k = 0; k < rules_list_size(rules); k++)
+		apply_rule(query, state, state_rules[k], states);
+}
 
-	Usuwa z listy stanów o koszcie cost duplikaty.
-	@param[in] cost Koszt stanów.
-	@param[in, out] Tablica warstw.
-	@param[in, out] Tablica stanów.
+/**
+	Zbiera stany przydzielone wątkowi.
+	Stany warstw źródłowych są ponumerowane kolejno, od warstwy cost - 1
+	(reguły o koszcie 1) do warstwy cost - max_rule. Wątki pobierają
+	po STATES_CHUNK kolejnych numerów, więc szybszy wątek przejmuje
+	pracę, której nie zdążyły zacząć pozostałe.
+	@param[in,out] arg Wspólny stan wątków, struct collect_job.
+	@return NULL.
  */
-static void filter_states(int cost, struct rules_list **layers, struct rules_list *states)
+static void *collect_thread(void *arg)
 {
-	for (size_t i = 0; i <= cost; i++)
+	struct collect_job *job = arg;
+	struct hints_query *query = job->query;
+	struct collect_worker *worker =
+			&query->workers[__sync_fetch_and_add(&job->started, 1)];
+	size_t begin;
+	while (!query_exceeded(&worker->query)
+			&& (begin = __sync_fetch_and_add(&job->next, STATES_CHUNK)) < job->count)
 	{
-		size_t layer_len = rules_list_size(layers[i]);
-		struct state **layer_states = (struct state **) rules_list_get(layers[i]);
-		fprintf(stderr, "tyle mam stanów dla warstwy %d: %d\n", (int)i, (int)layer_len);
-//	dla każdego stanu stan ∈ warstawa[k - i]
-		for (size_t j = 0; j < layer_len; j++)
+		size_t end = begin + STATES_CHUNK < job->count ? begin + STATES_CHUNK : job->count;
+		size_t first = 0;
+		for (int i = 1; i <= job->max_rule && begin < end; i++)
 		{
-			if (layer_states[j] != NULL)
-			{
-				rules_list_add(states, &(layer_states[j]));
-				fprintf(stderr, "dodaje\n");
-				fprintf(stderr, "word: %ls, change: %ls, prev: %p\n", layer_states[j]->word, layer_states[j]->change, layer_states[j]->prev);
-			}
+			struct rules_list *layer = query->layers[job->cost - i];
+			struct state **layer_states = (struct state **) rules_list_get(layer);
+			size_t last = first + rules_list_size(layer);
+			for (; begin < end && begin < last && !query_exceeded(&worker->query); begin++)
+				apply_rules(&worker->query, layer_states[begin - first], i,
+						&worker->states);
+			first = last;
 		}
 	}
-	// Sortujemy tablica leksykograficznie
-	assert(rules_list_size(states) != 0);
-	for (size_t k = 0; k < rules_list_size(states); k++)
+	return NULL;
+}
+
+/**
+	Przenosi do zbioru stanów zapytania stany zebrane przez kolejne
+	nieprzydzielone wątki. Stan utworzony przez kilka wątków zostaje
+	dodany tylko raz.
+	@param[in,out] arg Wspólny stan wątków, struct collect_job.
+	@return NULL.
+ */
+static void *merge_thread(void *arg)
+{
+	struct collect_job *job = arg;
+	struct hints_query *query = job->query;
+	int i;
+	while ((i = __sync_fetch_and_add(&job->merged, 1)) < job->started)
+	{
+		struct collect_worker *worker = &query->workers[i];
+		struct state **states = (struct state **) rules_list_get(&worker->states);
+		for (size_t j = 0; j < rules_list_size(&worker->states); j++)
+			if (state_set_add_shared(&query->seen, states[j]))
+				rules_list_add(&worker->kept, states[j]);
+	}
+	return NULL;
+}
+
+/**
+	Wykonuje funkcję w kilku wątkach, bieżący wątek również ją wykonuje.
+	@param[in] worker Funkcja wątku, sama przydziela sobie pracę.
+	@param[in,out] job Wspólny stan wątków.
+	@param[in] threads Liczba wątków.
+ */
+static void run_workers(void *(*worker)(void *), void *job, int threads)
+{
+	pthread_t ids[MAX_THREADS];
+	int started = 0;
+	while (started + 1 < threads
+			&& pthread_create(&ids[started], NULL, worker, job) == 0)
+		started++;
+	worker(job);
+	for (int i = 0; i < started; i++)
+		pthread_join(ids[i], NULL);
+}
+
+/**
+	Zbiera stany warstwy w kilku wątkach.
+	Każdy wątek tworzy stany we własnej arenie i odrzuca stany, które
+	były we wcześniejszych warstwach albo które sam już utworzył.
+	Następnie wątki równocześnie dodają swoje stany do zbioru stanów
+	zapytania, który na ten czas powiększamy tak, żeby zmieścił
+	wszystkie zebrane stany. Stany utworzone przez kilka wątków trafiają
+	do warstwy raz.
+	@param[in,out] query Zapytanie.
+	@param[in] cost Koszt stanów, które zbieramy.
+	@param[in] max_rule Największy koszt stosowanych reguł.
+	@param[in] count Łączna liczba stanów warstw źródłowych.
+ */
+static void collect_parallel(struct hints_query *query, int cost, int max_rule,
+		size_t count)
+{
+	int threads = query->threads;
+	size_t chunks = (count + STATES_CHUNK - 1) / STATES_CHUNK;
+	if ((size_t) threads > chunks)
+		threads = chunks > 0 ? (int) chunks : 1;
+	if (query->workers == NULL)
+	{
+		query->workers = arena_alloc(query->arena,
+				sizeof(struct collect_worker) * query->threads);
+		for (int i = 0; i < query->threads; i++)
 		{
-			 fprintf(stderr, "word: %ls, cost: %d\n", (*((struct state **)states->array[k]))->word, (*((struct state **)states->array[k]))->cost);
+			struct collect_worker *worker = &query->workers[i];
+			arena_init(&worker->arena);
+			state_set_init(&worker->query.seen, &worker->arena);
 		}
-
-	qsort(rules_list_get(states), rules_list_size(states), sizeof(void *), my_compare);
-	for (size_t k = 0; k < rules_list_size(states); k++)
+	}
+	for (int i = 0; i < threads; i++)
 	{
-		 fprintf(stderr, "word: %ls, cost: %d\n", (*((struct state **)states->array[k]))->word, (*((struct state **)states->array[k]))->cost);
+		struct collect_worker *worker = &query->workers[i];
+		// Zbiór stanów wątku zachowuje rozmiar z poprzedniej warstwy.
+		struct state_set seen = worker->query.seen;
+		state_set_clear(&seen);
+		worker->query = *query;
+		worker->query.arena = &worker->arena;
+		worker->query.shared = &query->seen;
+		worker->query.seen = seen;
+		rules_list_init_arena(&worker->states, &worker->arena);
+		rules_list_init_arena(&worker->kept, &worker->arena);
 	}
-	size_t k = 1;
-	while (k < rules_list_size(states))
+	struct collect_job job = { query, cost, max_rule, count, 0, 0, 0 };
+	run_workers(collect_thread, &job, threads);
+	// Stany zebrane przed przekroczeniem ograniczeń zostają w warstwie.
+	for (int i = 0; i < job.started && query->budget.status == HINTS_COMPLETE; i++)
+		query->budget.status = query->workers[i].query.budget.status;
+	size_t found = query->seen.size;
+	for (int i = 0; i < job.started; i++)
+		found += rules_list_size(&query->workers[i].states);
+	if (state_set_reserve(&query->seen, found))
+		run_workers(merge_thread, &job, threads);
+	struct rules_list *states = query->layers[cost];
+	for (int i = 0; i < job.started; i++)
 	{
-		fprintf(stderr, "PORÓWNUJE1: word: %ls, change: %ls cost: %d\n", (*((struct state **)states->array[k-1]))->word, (*((struct state **)states->array[k-1]))->change, (*((struct state **)states->array[k-1]))->cost);
-		fprintf(stderr, "PORÓWNUJE2: word: %ls, change: %ls cost: %d\n", (*((struct state **)states->array[k]))->word, (*((struct state **)states->array[k]))->change, (*((struct state **)states->array[k]))->cost);
-		if (!wcscmp((*(struct state **)rules_list_get(states)[k-1])->word,(*(struct state **)rules_list_get(states)[k])->word)
-				&& !wcscmp((*(struct state **)rules_list_get(states)[k-1])->change,(*(struct state **)rules_list_get(states)[k])->change))
+		struct collect_worker *worker = &query->workers[i];
+		// Bez miejsca w zbiorze stanów dodajemy je w jednym wątku.
+		for (size_t j = 0; job.merged == 0 && j < rules_list_size(&worker->states); j++)
 		{
-			fprintf(stderr, "USUWAM\n");
-			struct state ** st = (struct state **)rules_list_get(states)[k];
-			rules_list_delete(states, k);
-			assert(*st == NULL);
-//			assert((*st)->word == NULL);
-			*st = NULL;
-			st = NULL;
-
+			struct state *state = rules_list_get(&worker->states)[j];
+			if (state_set_add(&query->seen, state))
+				rules_list_add(&worker->kept, state);
 		}
-//		else if (((*(struct state **)rules_list_get(states)[k-1])->word == L"\0" && (*(struct state **)rules_list_get(states)[k])->word == L"0"
-//				&& !wcscmp((*(struct state **)rules_list_get(states)[k-1])->change,(*(struct state **)rules_list_get(states)[k])->change))
-//			|| ((*(struct state **)rules_list_get(states)[k-1])->change == L"\0" && (*(struct state **)rules_list_get(states)[k])->change == L"0"
-//			&& !wcscmp((*(struct state **)rules_list_get(states)[k-1])->word,(*(struct state **)rules_list_get(states)[k])->word)))
-//		{
-//			fprintf(stderr, "USUWAM\n");
-//			rules_list_delete(states, k);
-//		}
-		else
-			k++;
+		struct rules_list *kept = &worker->kept;
+		struct state **kept_states = (struct state **) rules_list_get(kept);
+		for (size_t j = 0; j < rules_list_size(kept); j++)
+			rules_list_add(states, kept_states[j]);
 	}
-//	size_t layer_len = rules_list_size(layers[cost]);
-//	rules_list_done(layers[cost], DEL_STATE);
-//	rules_list_init(layers[cost]);
-	fprintf(stderr, "po usunięciu mam takie\n");
-	for (size_t k = 0; k < rules_list_size(states); k++)
+}
+
+/**
+	ZbierzStany(k)
+	warstwa[k] ← ∅
+	dla i = 1, ..., k
+	dla każdego stanu stan ∈ warstawa[k - i]
+	dla każdej reguły r o koszcie i, która stosuje się do stanu stan // pętla reguł
+	warstwa[k] ← warstwa[k] ∪ Rozwiń(stan otrzymany po przejściu z stan regułą r)
+
+	Warstwy wypełniamy w kolejności kosztów, więc stan, który już był,
+	ma koszt nie większy niż k. Takie stany odrzucamy od razu przy ich
+	tworzeniu i do warstwy trafiają tylko nowe stany.
+	Jeśli warstwy źródłowe mają co najmniej parallel_states stanów,
+	to pracę dzielimy między wątki, patrz collect_parallel().
+	Po przekroczeniu ograniczeń wyszukiwania warstwa zostaje niepełna.
+	@param[in,out] query Zapytanie.
+	@param[in] cost Koszt stanów, które zbieramy.
+ */
+static void collect_states(struct hints_query *query, int cost)
+{
+	int max_rule = cost < query->max_cost ? cost : query->max_cost;
+	size_t count = 0;
+	for (int i = 1; i <= max_rule; i++)
+		count += rules_list_size(query->layers[cost - i]);
+	TRACE(TRACE_DEBUG, "warstwa %d: %zu stanów źródłowych", cost, count);
+	if (query->threads > 1 && count >= query->dict->parallel_states)
 	{
-		 fprintf(stderr, "cost: %d, word: %ls, change: %ls, prev: %p\n", (*((struct state **)states->array[k]))->cost, (*((struct state **)states->array[k]))->word, (*((struct state **)states->array[k]))->change,
-				 (*((struct state **)states->array[k]))->prev);
-//		 if (((struct state *)rules_list_get(states)[k])->cost == cost) {
-//			 rules_list_copy(layers[cost], rules_list_get(states)[k]);
-//		fprintf(stderr, ">>po skopiowaniu: word: %ls, change: %ls, prev: %p\n",
-//					 ((struct state *)layers[cost]->array[k])->word,
-//					 ((struct state *)layers[cost]->array[k])->change, ((struct state *)layers[cost]->array[k])->prev);
-//		 }
+		collect_parallel(query, cost, max_rule, count);
+		return;
+	}
+	struct rules_list *states = query->layers[cost];
+	for (int i = 1; i <= max_rule; i++)
+	{
+		struct rules_list *layer = query->layers[cost - i];
+		struct state **layer_states = (struct state **) rules_list_get(layer);
+		for (size_t j = 0; j < rules_list_size(layer); j++)
+		{
+			if (query_exceeded(query))
+				return;
+			apply_rules(query, layer_states[j], i, states);
+		}
 	}
 }
 
 /**
-	Odwraca dany wyraz.
-	@param[in] str Wyraz do odwórcenia.
-	@retrun Odwrócony wyraz.
+	Odtwarza podpowiedź złożoną z kolejnych części, idąc od stanu
+	kończącego każdą część po wskaźnikach prev i sklejając dopisane
+	fragmenty.
+	@param[in,out] arena Arena zapytania.
+	@param[in] parts Stany kończące kolejne części.
+	@param[in] count Liczba części.
+	@return Podpowiedź.
  */
-static wchar_t *reverse(wchar_t *str) {
-	size_t len = wcslen(str);
-	size_t i;
-	wchar_t temp;
-	fprintf(stderr, "REVERSE: %d, %ls\n", len, str);
-	for (i = 0; i < (len / 2); i++)
+static wchar_t *build_parts(struct arena *arena, const struct state * const *parts,
+		size_t count)
+{
+	size_t len = 0;
+	for (size_t i = 0; i < count; i++)
+		for (const struct state *s = parts[i]; s != NULL; s = s->prev)
+			len += s->fragment_len;
+	wchar_t *hint = arena_alloc(arena, sizeof(wchar_t) * (len + 1));
+	hint[len] = L'\0';
+	for (size_t i = count; i-- > 0; )
+		for (const struct state *s = parts[i]; s != NULL; s = s->prev)
+		{
+			len -= s->fragment_len;
+			wmemcpy(hint + len, s->fragment, s->fragment_len);
+		}
+	return hint;
+}
+
+/**
+	Odtwarza podpowiedź, idąc od stanu końcowego po wskaźnikach prev
+	i sklejając dopisane fragmenty.
+	@param[in,out] arena Arena zapytania.
+	@param[in] state Stan końcowy.
+	@return Podpowiedź.
+ */
+static wchar_t *build_hint(struct arena *arena, const struct state *state)
+{
+	return build_parts(arena, &state, 1);
+}
+
+/**
+	Sprawdza, czy stan jest końcowy, czyli przeszedł całe słowo
+	i kończy się na słowie ze słownika.
+	@param[in] query Zapytanie.
+	@param[in] state Stan.
+	@return true jeśli stan jest końcowy, false w p.p.
+ */
+static bool is_final(const struct hints_query *query, const struct state *state)
+{
+	return state->pos == query->len && state->node->number == WORD;
+}
+
+/**
+	Zwraca częstość podpowiedzi, czyli najmniejszą częstość jej słów.
+	Słowa poza ostatnim kończą się na stanach poprzedzających stany
+	początkowe kolejnych słów.
+	@param[in] state Stan końcowy.
+	@return Częstość podpowiedzi.
+ */
+static uint32_t hint_frequency(const struct state *state)
+{
+	uint32_t frequency = state->node->frequency;
+	for (const struct state *s = state->start; s != NULL; s = s->prev->start)
+		if (s->prev->node->frequency < frequency)
+			frequency = s->prev->node->frequency;
+	return frequency;
+}
+
+/**
+	Dodaje podpowiedź ze stanu końcowego.
+	Podpowiedź jest tworzona tylko wtedy, gdy może zostać wybrana.
+	@param[in] query Zapytanie.
+	@param[in] state Stan końcowy.
+	@param[in,out] hints Wybrane podpowiedzi.
+ */
+static void add_hint(const struct hints_query *query, const struct state *state,
+		struct word_collector *hints)
+{
+	uint32_t frequency = hint_frequency(state);
+	if (word_collector_accepts(hints, state->cost, frequency))
+		word_collector_add(hints, build_hint(query->arena, state), state->cost,
+				frequency);
+}
+
+/**
+	Dodaje podpowiedzi ze stanów końcowych o danym koszcie.
+	@param[in] query Zapytanie.
+	@param[in] cost Koszt stanów.
+	@param[in,out] hints Wybrane podpowiedzi.
+ */
+static void collect_hints(const struct hints_query *query, int cost,
+		struct word_collector *hints)
+{
+	struct state **layer_states = (struct state **) rules_list_get(query->layers[cost]);
+	for (size_t i = 0; i < rules_list_size(query->layers[cost]); i++)
 	{
-	    char temp = str[len - i - 1];
-	    str[len - i - 1] = str[i];
-	    str[i] = temp;
+		if (is_final(query, layer_states[i]))
+			add_hint(query, layer_states[i], hints);
 	}
-	fprintf(stderr, "REVERSE_END: %d, %ls\n", len, str);
-	return str;
 }
 
 /*
@@ -1045,97 +1876,1070 @@ static wchar_t *reverse(wchar_t *str) {
 
 Tworzenie stanów o koszcie k ze stanów o koszcie mniejszym od k przez stosowanie reguł o dodatnim koszcie i rozwijanie tych stanów.
 Usuwanie z tak utworzonej listy stanów duplikatów i stanów, które pojawiły się już we wcześniejszych warstwach.
+Drugi krok wykonujemy od razu przy tworzeniu stanu, sprawdzając go w zbiorze
+wszystkich dotąd utworzonych stanów zapytania.
+ */
+/**
+	Przygotowuje zapytanie o podpowiedzi dla słowa.
+	@param[out] query Zapytanie.
+	@param[in] dict Słownik.
+	@param[in] word Słowo.
+	@param[in,out] arena Arena zapytania.
+	@param[in] limits Ograniczenia wyszukiwania, NULL jeśli ich nie ma.
+	@return Stan początkowy.
+ */
+static struct state *init_query(struct hints_query *query, const struct dictionary *dict,
+		const wchar_t *word, struct arena *arena, const struct hints_limits *limits)
+{
+	query->dict = dict;
+	query->word = word;
+	query->len = wcslen(word);
+	query->arena = arena;
+	query->max_cost = dict->max_rule_cost < dict->cost ? dict->max_rule_cost : dict->cost;
+	query->min_cost = dict->min_rule_cost;
+	query->threads = 1;
+	query->layers = NULL;
+	query->queue = NULL;
+	query->session = false;
+	query->pieces = NULL;
+	query->shared = NULL;
+	query->workers = NULL;
+	budget_init(&query->budget, limits, 1);
+	state_set_init(&query->seen, arena);
+	walk_memo_init(&query->walks, arena);
+	query->rules = preprocess_rules(query);
+	query->letters = arena_alloc(arena, sizeof(uint64_t) * (query->len + 1));
+	query->letters[query->len] = 0;
+	for (size_t i = query->len; i-- > 0; )
+		query->letters[i] = query->letters[i + 1] | TRIE_LETTER(word[i]);
+	struct state *begin = create_state(arena, 0, dict->root, 0, NULL, L"", 0, NULL);
+	state_set_add(&query->seen, begin);
+	return begin;
+}
+
+/**
+	Wyszukuje podpowiedzi dla słowa według reguł słownika,
+	budując kolejne warstwy stanów.
+	@param[in] dict Słownik.
+	@param[in] word Słowo.
+	@param[in,out] list Lista podpowiedzi.
+	@param[in,out] arena Arena zapytania.
+	@param[in] threads Liczba wątków zbierających stany warstwy.
+	@param[in] limits Ograniczenia wyszukiwania, NULL jeśli ich nie ma.
+	@return HINTS_COMPLETE albo powód przerwania wyszukiwania.
  */
-static void get_hints(struct dictionary *dict, wchar_t *word, struct state *begin, struct word_list *list)
+static enum hints_status get_hints(const struct dictionary *dict, const wchar_t *word,
+		struct word_list *list, struct arena *arena, int threads,
+		const struct hints_limits *limits)
 {
-	size_t len = wcslen(word);
-	struct rules_list **rules = malloc(sizeof(struct rules_list *) * wcslen(word));
-	rules = preprocess_rules(dict, word, rules);
-	fprintf(stderr, "get_hints, %p mam tyle reguł dla pełnego słowa: %d\n", rules, (int)rules_list_size(rules[0]));
-	struct rules_list **states = malloc(sizeof(struct rules_list *) * (dict->cost + 1));
-	for(int i = 0; i <= dict->cost; i++)
+	struct hints_query query;
+	struct state *begin = init_query(&query, dict, word, arena, limits);
+	query.threads = threads;
+	query.layers = arena_alloc(arena, sizeof(struct rules_list *) * (dict->cost + 1));
+	for (int i = 0; i <= dict->cost; i++)
 	{
-		states[i] = malloc(sizeof(struct rules_list));
-		rules_list_init(states[i]);
+		query.layers[i] = arena_alloc(arena, sizeof(struct rules_list));
+		rules_list_init_arena(query.layers[i], arena);
 	}
-	rules_list_add(states[0], begin);
-	expand_state(states[0], begin);
-	for (int i = 1; i <= dict->cost; i++)
+	struct word_collector hints;
+	if (word_collector_init(&hints, DICTIONARY_MAX_HINTS) != 0)
+		return HINTS_NO_MEMORY;
+	rules_list_add(query.layers[0], begin);
+	expand_state(&query, query.layers[0], begin);
+	collect_hints(&query, 0, &hints);
+	for (int i = 1; i <= dict->cost && !word_collector_full(&hints); i++)
 	{
-		collect_states(dict, i, (int) wcslen(word), states, rules);
-		struct rules_list *filtered = malloc(sizeof(struct rules_list));
-		rules_list_init(filtered);
-		filter_states(i, states, filtered);
-		rules_list_done(filtered, DEL_NO);
-		free(filtered);
+		collect_states(&query, i);
+		// Stany niepełnej warstwy mają dokładnie koszt i, więc jej
+		// podpowiedzi też są najtańsze.
+		collect_hints(&query, i, &hints);
+		if (query.budget.status != HINTS_COMPLETE)
+			break;
 	}
-	fprintf(stderr, "-----------------------\nusuwam tmp\n");
-	for(int i = 0; i <= dict->cost; i++)
+	word_collector_finish(&hints, list);
+	word_collector_done(&hints);
+	TRACE(TRACE_DEBUG, "%ls: %zu stanów, %zu przejść", word,
+			query.seen.size, query.walks.size);
+	if (query.workers != NULL)
+		for (int i = 0; i < threads; i++)
+			arena_done(&query.workers[i].arena);
+	return query.budget.status;
+}
+
+/**
+	Stosuje do stanu wyjętego z kolejki wszystkie pasujące reguły,
+	po których koszt nie przekroczy maksymalnego.
+	@param[in,out] query Zapytanie.
+	@param[in] state Stan.
+ */
+static void step_state(struct hints_query *query, struct state *state)
+{
+	for (int i = 1; i <= query->max_cost && state->cost + i <= query->dict->cost; i++)
 	{
-		struct state ** s = (struct state **)rules_list_get(states[i]);
-		for (size_t k = 0; k < rules_list_size(states[i]); k++)
+		struct rules_list *rules = *suffix_rules(query, state->pos, i);
+		struct rule **state_rules = (struct rule **) rules_list_get(rules);
+		for (size_t k = 0; k < rules_list_size(rules); k++)
+			apply_rule(query, state, state_rules[k], NULL);
+	}
+}
+
+/**
+	Wyszukuje podpowiedzi dla słowa według reguł słownika, przeglądając
+	stany w kolejności kosztu powiększonego o dolne ograniczenie kosztu
+	dojścia do stanu końcowego (A*). Stany końcowe o koszcie k wychodzą
+	z kolejki przed wszystkimi stanami o priorytecie większym niż k, więc
+	gdy priorytet przekroczy k, znamy wszystkie podpowiedzi o koszcie k.
+	Kończymy, gdy po którymś koszcie mamy już DICTIONARY_MAX_HINTS
+	podpowiedzi. Wynik jest taki sam jak w get_hints().
+	@param[in] dict Słownik.
+	@param[in] word Słowo.
+	@param[in,out] list Lista podpowiedzi.
+	@param[in,out] arena Arena zapytania.
+	@param[in] limits Ograniczenia wyszukiwania, NULL jeśli ich nie ma.
+	@return HINTS_COMPLETE albo powód przerwania wyszukiwania.
+ */
+static enum hints_status get_hints_best_first(const struct dictionary *dict,
+		const wchar_t *word, struct word_list *list, struct arena *arena,
+		const struct hints_limits *limits)
+{
+	struct hints_query query;
+	struct state_queue queue;
+	struct state *begin = init_query(&query, dict, word, arena, limits);
+	state_queue_init(&queue, dict->cost, arena);
+	query.queue = &queue;
+	struct word_collector hints;
+	if (word_collector_init(&hints, DICTIONARY_MAX_HINTS) != 0)
+		return HINTS_NO_MEMORY;
+	push_state(&query, begin, false);
+	int level = 0;
+	struct state_entry entry;
+	while (state_queue_pop(&queue, &entry))
+	{
+		struct state *state = entry.state;
+		if (entry.priority > level)
 		{
-			fprintf(stderr, "==========================\n");
-			if (s[k] != NULL) {
-				assert(s[k] != NULL);
-				assert(s[k]->node != NULL);
-				assert(s[k]->word != NULL);
-				if (s[k]->node->number == WORD){
-					fprintf(stderr, "taką znalazłam podpowiedź: %ls\n", s[k]->change);
-
-					//					struct state *prev = s[k];
-//					bool finish = false;
-//					wchar_t *res = malloc(sizeof(wchar_t));
-//					res[0] = '\0';
-//					assert(prev != NULL);
-//					while (prev != NULL && prev->word != NULL) {
-//						fprintf(stderr, "1prev->word: %p\n", prev->word);
-//
-//						assert(prev != NULL);
-//						assert(prev->word != NULL);
-//						fprintf(stderr, "2prev->word: %p\n", prev->word);
-//
-//						assert(prev->word != L"\0");
-//						res = realloc(res, sizeof(wchar_t) * (wcslen(res) + wcslen(prev->change) + 1));
-//						fprintf(stderr, "word: %ls, change: %ls\n", prev->word, prev->change);
-//						if (wcslen(res) == 0)
-//							wcscpy(res, prev->change);
-//						else if (wcslen(prev->change) != 0)
-//						{
-//							wchar_t *cpy = malloc(sizeof(wchar_t) * (wcslen(prev->change) + 1));
-//							wcscpy(cpy, prev->change);
-//							wcscat(res, reverse(cpy));
-//							fprintf(stderr, "^^^^ %ls i change: %ls\n", res, prev->change);
-//							free(cpy);
-//						}
-//						prev = prev->prev;
-//					}
-//					fprintf(stderr, "taką znalazłam podpowiedź: %ls dl: %d\n", res, (int)wcslen(res));
-//					res = reverse(res);
-//					fprintf(stderr, "taką znalazłam podpowiedź: %ls\n", res);
-//					word_list_add(list, res);
-//					free(res);
-				}
+			if (word_collector_full(&hints))
+				break;
+			level = entry.priority;
+		}
+		// Pomijamy stany zastąpione później tańszymi. Stany po regule
+		// z flagą s nie są w zbiorze, bo zawsze są nowe.
+		if (state->start != state && state_set_find(&query.seen, state->pos,
+				state->node, state->start) != state)
+			continue;
+		if (is_final(&query, state))
+			add_hint(&query, state, &hints);
+		if (query_exceeded(&query))
+			break;
+		step_state(&query, state);
+	}
+	TRACE(TRACE_DEBUG, "%ls: %zu stanów, %zu przejść", word,
+			query.seen.size, query.walks.size);
+	word_collector_finish(&hints, list);
+	word_collector_done(&hints);
+	return query.budget.status;
+}
+
+/**
+	Wyszukuje według reguł wszystkie części zaczynające się na pozycji
+	from, o koszcie nie większym niż max_cost. Stany budujemy warstwami
+	jak w get_hints(), ale stany po regule z flagą s zamiast do warstw
+	trafiają do listy części. Początek części jest początkiem swojego
+	słowa, więc stany różnych części są w zbiorze stanów różne.
+	@param[in,out] query Zapytanie.
+	@param[in] from Pozycja początku części.
+	@param[in] max_cost Największy koszt części.
+	@param[out] parts Lista, do której dodawane są stany kończące części.
+ */
+static void search_parts(struct hints_query *query, size_t from, int max_cost,
+		struct rules_list *parts)
+{
+	struct state *begin = create_state(query->arena, from, query->dict->root, 0,
+			NULL, L"", 0, NULL);
+	begin->start = begin;
+	state_set_add(&query->seen, begin);
+	query->pieces = parts;
+	query->layers = arena_alloc(query->arena, sizeof(struct rules_list *) * (max_cost + 1));
+	for (int i = 0; i <= max_cost; i++)
+	{
+		query->layers[i] = arena_alloc(query->arena, sizeof(struct rules_list));
+		rules_list_init_arena(query->layers[i], query->arena);
+	}
+	rules_list_add(query->layers[0], begin);
+	expand_state(query, query->layers[0], begin);
+	for (int cost = 0; cost <= max_cost; cost++)
+	{
+		if (cost > 0)
+			collect_states(query, cost);
+		struct state **states = (struct state **) rules_list_get(query->layers[cost]);
+		for (size_t i = 0; i < rules_list_size(query->layers[cost]); i++)
+			if (is_final(query, states[i]))
+				rules_list_add(parts, states[i]);
+		if (query->budget.status != HINTS_COMPLETE)
+			break;
+	}
+}
+
+/**
+	Wylicza podziały słowa od pozycji pos i dodaje podpowiedzi z nich.
+	Podział pomijamy, gdy nawet najtańsze dokończenie przekroczy
+	maksymalny koszt albo nie zmieści się wśród wybranych podpowiedzi.
+	@param[in,out] segments Dane wyliczania podziałów.
+	@param[in] pos Pozycja w słowie.
+	@param[in] depth Liczba części przed pozycją pos.
+	@param[in] cost Koszt części przed pozycją pos.
+	@param[in] frequency Najmniejsza częstość słów przed pozycją pos.
+ */
+static void walk_segments(struct segment_query *segments, size_t pos, size_t depth,
+		int cost, uint32_t frequency)
+{
+	const struct hints_query *query = segments->query;
+	struct rules_list *parts = &segments->parts[pos];
+	struct state **part_states = (struct state **) rules_list_get(parts);
+	for (size_t i = 0; i < rules_list_size(parts); i++)
+	{
+		const struct state *part = part_states[i];
+		int total = cost + part->cost;
+		segments->path[depth] = part;
+		if (is_final(query, part))
+		{
+			uint32_t last = part->node->frequency < frequency ? part->node->frequency
+					: frequency;
+			if (total <= query->dict->cost
+					&& word_collector_accepts(segments->hints, total, last))
+				word_collector_add(segments->hints, build_parts(query->arena,
+						segments->path, depth + 1), total, last);
+			continue;
+		}
+		int tail = segments->tails[part->pos];
+		if (tail == INT_MAX || total + tail > query->dict->cost
+				|| !word_collector_accepts(segments->hints, total + tail, UINT32_MAX))
+			continue;
+		// Jak w hint_frequency(), słowo kończy stan, do którego zastosowano regułę.
+		uint32_t word = part->prev->node->frequency;
+		walk_segments(segments, part->pos, depth + 1, total,
+				word < frequency ? word : frequency);
+	}
+}
+
+/**
+	Wyszukuje podpowiedzi dla słowa według reguł słownika z regułami
+	z flagą s, dzieląc słowo na części programowaniem dynamicznym.
+	W get_hints() i get_hints_best_first() każdy podział początku słowa
+	ma własny stan początku następnego słowa, więc resztę słowa
+	przeszukujemy osobno dla każdego podziału, czyli wykładniczo wiele
+	razy. Tutaj części zaczynające się na danej pozycji wyszukujemy raz,
+	przechodząc pozycje od lewej i pamiętając najmniejszy koszt dojścia
+	do każdej z nich. Następnie od prawej liczymy najmniejszy koszt
+	dokończenia podpowiedzi od pozycji i wyliczamy tylko te podziały,
+	które mogą dać wybraną podpowiedź. Wynik jest taki sam jak
+	w get_hints().
+	@param[in] dict Słownik.
+	@param[in] word Słowo.
+	@param[in,out] list Lista podpowiedzi.
+	@param[in,out] arena Arena zapytania.
+	@param[in] limits Ograniczenia wyszukiwania, NULL jeśli ich nie ma.
+	@return HINTS_COMPLETE albo powód przerwania wyszukiwania.
+ */
+static enum hints_status get_hints_segmented(const struct dictionary *dict,
+		const wchar_t *word, struct word_list *list, struct arena *arena,
+		const struct hints_limits *limits)
+{
+	struct hints_query query;
+	struct word_collector hints;
+	if (word_collector_init(&hints, DICTIONARY_MAX_HINTS) != 0)
+		return HINTS_NO_MEMORY;
+	init_query(&query, dict, word, arena, limits);
+	struct segment_query segments;
+	segments.query = &query;
+	segments.hints = &hints;
+	segments.parts = arena_alloc(arena, sizeof(struct rules_list) * (query.len + 1));
+	segments.tails = arena_alloc(arena, sizeof(int) * (query.len + 1));
+	// Każda część poza ostatnią kosztuje co najmniej tyle, co reguła z flagą s.
+	segments.path = arena_alloc(arena, sizeof(struct state *) * (dict->cost + 1));
+	int *reach = arena_alloc(arena, sizeof(int) * (query.len + 1));
+	for (size_t i = 0; i <= query.len; i++)
+	{
+		rules_list_init_arena(&segments.parts[i], arena);
+		reach[i] = i == 0 ? 0 : INT_MAX;
+	}
+	for (size_t i = 0; i <= query.len && query.budget.status == HINTS_COMPLETE; i++)
+	{
+		if (reach[i] > dict->cost)
+			continue;
+		struct rules_list *parts = &segments.parts[i];
+		search_parts(&query, i, dict->cost - reach[i], parts);
+		struct state **part_states = (struct state **) rules_list_get(parts);
+		for (size_t j = 0; j < rules_list_size(parts); j++)
+		{
+			const struct state *part = part_states[j];
+			if (!is_final(&query, part) && part->pos > i
+					&& reach[i] + part->cost < reach[part->pos])
+				reach[part->pos] = reach[i] + part->cost;
+		}
+	}
+	for (size_t i = query.len + 1; i-- > 0; )
+	{
+		segments.tails[i] = INT_MAX;
+		struct state **part_states = (struct state **) rules_list_get(&segments.parts[i]);
+		for (size_t j = 0; j < rules_list_size(&segments.parts[i]); j++)
+		{
+			const struct state *part = part_states[j];
+			int tail = part->cost;
+			if (!is_final(&query, part))
+			{
+				if (part->pos <= i || segments.tails[part->pos] == INT_MAX)
+					continue;
+				tail += segments.tails[part->pos];
 			}
+			if (tail < segments.tails[i])
+				segments.tails[i] = tail;
+		}
+	}
+	walk_segments(&segments, 0, 0, 0, UINT32_MAX);
+	TRACE(TRACE_DEBUG, "%ls: %zu stanów przy podziale słowa", word, query.seen.size);
+	word_collector_finish(&hints, list);
+	word_collector_done(&hints);
+	return query.budget.status;
+}
+
+/**
+	Wyszukuje podpowiedzi dla słowa algorytmem wybranym dla słownika.
+	@param[in] dict Słownik.
+	@param[in] word Słowo.
+	@param[out] list Lista podpowiedzi.
+	@param[in,out] arena Arena zapytania, po wywołaniu trzeba ją wyczyścić.
+	@param[in] threads Liczba wątków zbierających stany warstwy.
+	@param[in] limits Ograniczenia wyszukiwania, NULL jeśli ich nie ma.
+	@return HINTS_COMPLETE albo powód przerwania wyszukiwania.
+ */
+static enum hints_status find_hints(const struct dictionary *dict,
+		const wchar_t *word, struct word_list *list, struct arena *arena,
+		int threads, const struct hints_limits *limits)
+{
+	enum hints_status status;
+	word_list_init(list);
+	// Słownik bez reguł podpowiada słowa odległe o kilka zmian liter.
+	if (rules_list_size(dict->rules) == 0 || dict->engine == HINTS_LEVENSHTEIN)
+		status = hints_by_distance(dict, word, list, arena, limits);
+	else if (dict->engine == HINTS_SEGMENTED && dict->split_rules > 0)
+		status = get_hints_segmented(dict, word, list, arena, limits);
+	else if (dict->engine == HINTS_BEST_FIRST || dict->engine == HINTS_SEGMENTED)
+		status = get_hints_best_first(dict, word, list, arena, limits);
+	else
+		status = get_hints(dict, word, list, arena, threads, limits);
+	TRACE(TRACE_DEBUG, "%ls: %zu podpowiedzi, wynik %d", word,
+			word_list_size(list), (int) status);
+	return status;
+}
+
+/**
+	Zwraca stany sesji na danej pozycji słowa.
+	@param[in] session Sesja.
+	@param[in] pos Pozycja, od 0 do długości słowa.
+	@return Stany pozycji.
+ */
+static struct session_position *session_position(const struct hints_session *session,
+		size_t pos)
+{
+	return rules_list_get(&session->positions)[pos];
+}
+
+/**
+	Zapamiętuje regułę znalezioną przez automat, jeśli jej lewa strona
+	kończy się na końcu słowa sesji.
+	@param[in] pattern Indeks reguły w liście reguł słownika.
+	@param[in] pos Pozycja początku lewej strony.
+	@param[in,out] data Sesja.
+ */
+static void add_session_match(size_t pattern, size_t pos, void *data)
+{
+	struct hints_session *session = data;
+	struct hints_query *query = &session->query;
+	struct session_position *position = session_position(session, query->len);
+	struct rule *rule = (struct rule *) rules_list_get(query->dict->rules)[pattern];
+	wchar_t variables[DIGITS];
+	if (pos + rule->left_len != query->len || rule->cost > query->max_cost)
+		return;
+	if (rule->flag == RULE_BEGIN && pos != 0)
+		return;
+	if (!match_left(rule, query->word + pos, query->len - pos, variables))
+		return;
+	struct session_match *match = arena_alloc(&position->arena,
+			sizeof(struct session_match));
+	match->rule = rule;
+	match->pos = pos;
+	if (rule->flag == RULE_END)
+		rules_list_add(&position->end, match);
+	else if (rule->left_len == 0)
+		rules_list_add(&position->empty, match);
+	else
+		rules_list_add(&position->moves, match);
+}
+
+/**
+	Stosuje reguły do stanów pozycji, od której pasują.
+	Nowe stany trafiają do kolejki zapytania.
+	@param[in,out] session Sesja.
+	@param[in] matches Dopasowania reguł.
+	@param[in] skip_empty Czy pomijać reguły o pustej lewej stronie.
+ */
+static void session_apply(struct hints_session *session,
+		const struct rules_list *matches, bool skip_empty)
+{
+	struct hints_query *query = &session->query;
+	struct session_match **match = (struct session_match **) rules_list_get(matches);
+	for (size_t i = 0; i < rules_list_size(matches); i++)
+	{
+		const struct rule *rule = match[i]->rule;
+		if (skip_empty && rule->left_len == 0)
+			continue;
+		struct rules_list *states = &session_position(session, match[i]->pos)->states;
+		struct state **state = (struct state **) rules_list_get(states);
+		for (size_t j = 0; j < rules_list_size(states)
+				&& state[j]->cost + rule->cost <= query->dict->cost; j++)
+			apply_rule(query, state[j], rule, NULL);
+	}
+}
+
+/**
+	Stosuje do stanu reguły o pustej lewej stronie.
+	@param[in,out] query Zapytanie sesji.
+	@param[in] state Stan na końcu słowa.
+	@param[in] matches Dopasowania reguł, inne są pomijane.
+ */
+static void apply_empty(struct hints_query *query, struct state *state,
+		const struct rules_list *matches)
+{
+	struct session_match **match = (struct session_match **) rules_list_get(matches);
+	for (size_t i = 0; i < rules_list_size(matches); i++)
+	{
+		const struct rule *rule = match[i]->rule;
+		if (rule->left_len == 0 && state->cost + rule->cost <= query->dict->cost)
+			apply_rule(query, state, rule, NULL);
+	}
+}
+
+/**
+	Wyjmuje z kolejki zapytania stany końca słowa w kolejności kosztu
+	i stosuje do nich reguły o pustej lewej stronie. Z równych stanów
+	zostaje pierwszy, czyli najtańszy.
+	@param[in,out] query Zapytanie sesji.
+	@param[in,out] seen Stany, które już wyjęto.
+	@param[out] states Lista, do której trafiają wyjęte stany.
+	@param[in] position Stany końca słowa.
+	@param[in] base Stany, do których reguły bez flagi e już zastosowano,
+	NULL gdy stosujemy tylko reguły bez flagi e.
+ */
+static void session_close(struct hints_query *query, struct state_set *seen,
+		struct rules_list *states, const struct session_position *position,
+		const struct state_set *base)
+{
+	struct state_entry entry;
+	while (state_queue_pop(query->queue, &entry))
+	{
+		struct state *state = entry.state;
+		if (!state_set_add(seen, state))
+			continue;
+		rules_list_add(states, state);
+		if (base == NULL || state_set_find(base, state->pos, state->node,
+				state->start) != state)
+			apply_empty(query, state, &position->empty);
+		if (base != NULL)
+			apply_empty(query, state, &position->end);
+	}
+}
+
+/**
+	Wyznacza stany kończące się na nowej, ostatniej pozycji słowa sesji.
+	Powstają one ze stanów poprzedniej pozycji przez literę bez zmian,
+	ze stanów wcześniejszych pozycji przez reguły, których lewa strona
+	kończy się na nowej pozycji, a następnie przez reguły o pustej
+	lewej stronie. Reguły z flagą e stosujemy dopiero w podpowiedziach,
+	bo przestają pasować po dopisaniu znaku.
+	@param[in,out] session Sesja.
+	@return 0 jeśli się udało, -1 jeśli zabrakło pamięci.
+ */
+static int session_fill(struct hints_session *session)
+{
+	struct hints_query *query = &session->query;
+	size_t len = query->len;
+	struct session_position *position;
+	if (rules_list_size(&session->positions) > len)
+		position = session_position(session, len);
+	else
+	{
+		position = malloc(sizeof(struct session_position));
+		if (position == NULL)
+			return -1;
+		arena_init(&position->arena);
+		if (!rules_list_add(&session->positions, position))
+		{
+			free(position);
+			return -1;
+		}
+	}
+	struct arena *arena = &position->arena;
+	state_set_init(&position->seen, arena);
+	rules_list_init_arena(&position->states, arena);
+	rules_list_init_arena(&position->moves, arena);
+	rules_list_init_arena(&position->empty, arena);
+	rules_list_init_arena(&position->end, arena);
+	struct rule_matcher *matcher = get_matcher(query->dict);
+	if (matcher != NULL)
+		rule_matcher_run(matcher, query->word, len, add_session_match, session);
+	struct state_queue queue;
+	state_queue_init(&queue, query->dict->cost, arena);
+	query->queue = &queue;
+	query->arena = arena;
+	if (len == 0)
+		state_queue_push(&queue, create_state(arena, 0, query->dict->root, 0, NULL,
+				L"", 0, NULL), 0);
+	else
+	{
+		struct rules_list *previous = &session_position(session, len - 1)->states;
+		struct state **states = (struct state **) rules_list_get(previous);
+		for (size_t i = 0; i < rules_list_size(previous); i++)
+		{
+			vectorItem *child = at(trie_children(states[i]->node), query->word[len - 1]);
+			if (child != NULL)
+				state_queue_push(&queue, create_state(arena, len, child->node,
+						states[i]->cost, states[i], query->word + len - 1, 1,
+						states[i]->start), states[i]->cost);
+		}
+		session_apply(session, &position->moves, false);
+	}
+	session_close(query, &position->seen, &position->states, position, NULL);
+	TRACE(TRACE_DEBUG, "%ls: pozycja %zu, %zu stanów", query->word, len,
+			rules_list_size(&position->states));
+	return 0;
+}
+
+/**
+	Wybiera podpowiedzi ze stanów końca słowa sesji.
+	Jeśli na końcu słowa pasują reguły z flagą e, to stany końca słowa
+	uzupełniamy o stany po tych regułach, tworzone w osobnej arenie.
+	@param[in,out] session Sesja.
+	@param[in,out] hints Wybrane podpowiedzi.
+ */
+static void session_collect(struct hints_session *session,
+		struct word_collector *hints)
+{
+	struct hints_query *query = &session->query;
+	struct session_position *position = session_position(session, query->len);
+	struct rules_list *finals = &position->states;
+	struct state_queue queue;
+	struct state_set seen;
+	struct rules_list states;
+	query->arena = &session->scratch;
+	if (rules_list_size(&position->end) > 0)
+	{
+		state_queue_init(&queue, query->dict->cost, query->arena);
+		state_set_init(&seen, query->arena);
+		rules_list_init_arena(&states, query->arena);
+		query->queue = &queue;
+		struct state **base = (struct state **) rules_list_get(finals);
+		for (size_t i = 0; i < rules_list_size(finals); i++)
+			state_queue_push(&queue, base[i], base[i]->cost);
+		session_apply(session, &position->end, true);
+		session_close(query, &seen, &states, position, &position->seen);
+		finals = &states;
+	}
+	struct state **final = (struct state **) rules_list_get(finals);
+	for (size_t i = 0; i < rules_list_size(finals); i++)
+		if (is_final(query, final[i]))
+			add_hint(query, final[i], hints);
+}
+
+/**
+	Porównuje słowa zapytania alfabetycznie, a równe według pozycji.
+	@param[in] a Pierwsze słowo, struct batch_word.
+	@param[in] b Drugie słowo, struct batch_word.
+	@return Wynik porównania jak w qsort().
+ */
+static int batch_word_compare(const void *a, const void *b)
+{
+	const struct batch_word *first = a;
+	const struct batch_word *second = b;
+	int compare = wcscmp(first->word, second->word);
+	if (compare != 0)
+		return compare;
+	return first->index < second->index ? -1 : first->index > second->index;
+}
+
+/**
+	Wyszukuje podpowiedzi dla kolejnych nieprzydzielonych słów.
+	Wszystkie słowa wątku korzystają z tej samej areny.
+	@param[in,out] arg Wspólny stan wątków, struct batch_job.
+	@return NULL.
+ */
+static void *batch_thread(void *arg)
+{
+	struct batch_job *job = arg;
+	struct arena *arena = arena_thread();
+	size_t i;
+	while ((i = __sync_fetch_and_add(&job->next, 1)) < job->count)
+	{
+		find_hints(job->dict, job->words[i].word, &job->lists[job->words[i].index],
+				arena, job->threads, NULL);
+		arena_reset(arena);
+	}
+	return NULL;
+}
+
+/**
+	Kopiuje listę podpowiedzi.
+	Słowa są dodawane od najlepszego, więc kopia ma ten sam porządek
+	word_list_ranked() co oryginał.
+	@param[out] list Nowa lista.
+	@param[in] source Kopiowana lista.
+ */
+static void copy_hints(struct word_list *list, const struct word_list *source)
+{
+	word_list_init(list);
+	for (size_t i = 0; i < word_list_size(source); i++)
+		word_list_add(list, word_list_ranked(source)[i]);
+}
+
+/**
+	Liczy skrót zawartości pliku.
+	@param[in] path Ścieżka pliku.
+	@param[out] hash Skrót zawartości.
+	@return 0 jeśli się udało, -1 w p.p.
+ */
+static int file_hash(const char *path, uint64_t *hash)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	if (st.st_size == 0)
+	{
+		close(fd);
+		*hash = dict_image_hash(NULL, 0);
+		return 0;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return -1;
+	*hash = dict_image_hash(data, st.st_size);
+	munmap(data, st.st_size);
+	return 0;
+}
+
+/// Funkcja zapisująca plik w CACHE_PATH.
+typedef int cache_writer(const struct dictionary *dict,
+		const struct dict_image_key *key, FILE *stream);
+
+/**
+	Zapisuje obraz słownika.
+	@param[in] dict Zapisywany słownik.
+	@param[in] key Klucz pliku źródłowego.
+	@param[in,out] stream Plik obrazu.
+	@return 0 jeśli się udało, -1 w p.p.
+ */
+static int image_writer(const struct dictionary *dict,
+		const struct dict_image_key *key, FILE *stream)
+{
+	return dict_image_save(dict->root, dict->alphabet, key, stream);
+}
+
+/**
+	Zapisuje indeks usunięć liter słownika.
+	@param[in] dict Zapisywany słownik.
+	@param[in] key Klucz pliku słownika.
+	@param[in,out] stream Plik indeksu.
+	@return 0 jeśli się udało, -1 w p.p.
+ */
+static int index_writer(const struct dictionary *dict,
+		const struct dict_image_key *key, FILE *stream)
+{
+	return delete_index_save(dict->index, key, stream);
+}
+
+/**
+	Zapisuje plik w CACHE_PATH.
+	Plik jest zapisywany do pliku tymczasowego i podmieniany atomowo,
+	więc inne procesy widzą albo stary, albo nowy plik.
+	@param[in] dict Zapisywany słownik.
+	@param[in] path Ścieżka pliku.
+	@param[in] key Klucz pliku źródłowego.
+	@param[in] writer Funkcja zapisująca zawartość pliku.
+	@return 0 jeśli się udało, -1 w p.p.
+ */
+static int write_cached(const struct dictionary *dict, const char *path,
+		const struct dict_image_key *key, cache_writer *writer)
+{
+	if (create_directory(CONF_PATH) != 0 || create_directory(CACHE_PATH) != 0)
+		return -1;
+	char *tmp = create_temp_path(path);
+	int fd = mkstemp(tmp);
+	if (fd < 0)
+	{
+		free(tmp);
+		return -1;
+	}
+	FILE *fp = fdopen(fd, "wb");
+	int result = -1;
+	if (fp != NULL)
+	{
+		result = writer(dict, key, fp);
+		if (fflush(fp) != 0 || fsync(fd) != 0)
+			result = -1;
+		if (fclose(fp) != 0)
+			result = -1;
+	}
+	else
+		close(fd);
+	if (result == 0 && rename(tmp, path) != 0)
+		result = -1;
+	if (result != 0)
+		unlink(tmp);
+	free(tmp);
+	return result;
+}
+
+/**
+	Tworzy ścieżkę pliku języka w CACHE_PATH.
+	@param[in] lang Nazwa języka.
+	@param[in] suffix Rozszerzenie pliku.
+	@return Ścieżka pliku.
+ */
+static char *create_cache_path(const char *lang, const char *suffix)
+{
+	char *name = malloc(strlen(lang) + strlen(suffix) + 1);
+	strcpy(name, lang);
+	strcat(name, suffix);
+	char *path = create_file_path(CACHE_PATH, name);
+	free(name);
+	return path;
+}
+
+/**
+	Wyznacza klucz pliku z jego rozmiaru i czasu modyfikacji.
+	@param[in] path Ścieżka pliku.
+	@param[out] key Klucz, bez skrótu zawartości.
+	@return 0 jeśli się udało, -1 w p.p.
+ */
+static int file_key(const char *path, struct dict_image_key *key)
+{
+	struct stat st;
+	if (stat(path, &st) < 0)
+		return -1;
+	key->size = st.st_size;
+	key->mtime_sec = st.st_mtim.tv_sec;
+	key->mtime_nsec = st.st_mtim.tv_nsec;
+	key->hash = 0;
+	key->collation = 0;
+	return 0;
+}
+
+/**
+	Dodaje do indeksu wszystkie słowa z poddrzewa węzła.
+	@param[in,out] index Indeks.
+	@param[in] node Węzeł.
+	@param[in,out] word Bufor ze ścieżką do węzła.
+	@param[in,out] capacity Rozmiar bufora.
+	@param[in] depth Długość ścieżki do węzła.
+	@return 0 jeśli się udało, -1 jeśli zabrakło pamięci.
+ */
+static int index_words(struct delete_index *index, struct nodeInfo *node,
+		wchar_t **word, size_t *capacity, size_t depth)
+{
+	if (node->number == WORD)
+	{
+		(*word)[depth] = L'\0';
+		if (delete_index_add(index, *word) != 0)
+			return -1;
+	}
+	vector *children = trie_children(node);
+	for (int i = 0; i < size(children); i++)
+	{
+		vectorItem *child = at_pos(children, i);
+		if (depth + 2 > *capacity)
+		{
+			wchar_t *grown = realloc(*word, sizeof(wchar_t) * *capacity * 2);
+			if (grown == NULL)
+				return -1;
+			*word = grown;
+			*capacity *= 2;
+		}
+		(*word)[depth] = child->symbol;
+		if (index_words(index, child->node, word, capacity, depth + 1) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+/**
+	Wczytuje słownik z obrazu w CACHE_PATH.
+	Obraz jest aktualny, jeśli zgadza się rozmiar i czas modyfikacji
+	pliku źródłowego, albo skrót jego zawartości. Dzieci węzłów są
+	zapisane w porządku liter, więc obraz zapisany przy innym
+	LC_COLLATE traktujemy jak nieistniejący. Nieaktualny obraz
+	jest tworzony na nowo z pliku źródłowego.
+	@param[in] lang Nazwa języka.
+	@param[in] file Ścieżka pliku źródłowego.
+	@return Wczytany słownik lub NULL, jeśli operacja się nie powiedzie.
+ */
+static struct dictionary *load_cached(const char *lang, const char *file)
+{
+	struct dict_image_key key;
+	if (file_key(file, &key) != 0)
+		return NULL;
+	key.collation = dict_image_collation();
+	struct dict_image_key cached;
+	char *path = create_cache_path(lang, IMAGE_SUFFIX);
+	bool exists = dict_image_key_read(path, &cached) == 0
+			&& cached.collation == key.collation;
+	bool fresh = exists && cached.size == key.size
+			&& cached.mtime_sec == key.mtime_sec
+			&& cached.mtime_nsec == key.mtime_nsec;
+	if (!fresh && file_hash(file, &key.hash) != 0)
+	{
+		free(path);
+		return NULL;
+	}
+	if (fresh)
+		key.hash = cached.hash;
+	struct dictionary *dict = NULL;
+	if (exists && cached.size == key.size && cached.hash == key.hash)
+	{
+		dict = dictionary_new();
+		if (dict_image_load(dict->root, dict->alphabet, path) != 0)
+		{
+			dictionary_done(dict);
+			dict = NULL;
+		}
+		else if (fresh)
+		{
+			free(path);
+			return dict;
+		}
+	}
+	if (dict == NULL)
+		dict = dictionary_load_file(file);
+	if (dict != NULL)
+		write_cached(dict, path, &key, image_writer);
+	free(path);
+	return dict;
+}
+
+/**
+	Szuka poddrzewa w tablicy poddrzew czytanych przez zapisy w tle.
+	Wywoływana pod saving_lock.
+	@param[in] dict Słownik.
+	@param[in] node Korzeń poddrzewa.
+	@return Wpis poddrzewa lub NULL, jeśli żaden zapis go nie czyta.
+ */
+static struct frozen_subtree *find_frozen(struct dictionary *dict,
+		const struct nodeInfo *node)
+{
+	for (size_t i = 0; i < dict->frozen_len; i++)
+		if (dict->frozen[i].node == node)
+			return &dict->frozen[i];
+	return NULL;
+}
+
+/**
+	Tworzy zrzut słownika dla zapisu w tle.
+	Zrzut ma własny korzeń i alfabet, a poddrzewa korzenia współdzieli
+	ze słownikiem, więc jego utworzenie kosztuje tyle, ile liter ma
+	korzeń. Zmiany słownika nie czekają na zapis, patrz unshare_subtree().
+	@param[in,out] dict Słownik.
+	@return Zrzut słownika, NULL jeśli słownika nie da się zapisać.
+ */
+static struct dictionary *snapshot_dictionary(struct dictionary *dict)
+{
+	vector *children = trie_children(dict->root);
+	if (trie_load_failed(dict->root))
+		return NULL;
+	struct dictionary *snapshot = dictionary_new();
+	snapshot->root->number = dict->root->number;
+	snapshot->root->frequency = dict->root->frequency;
+	reserve(snapshot->alphabet, size(dict->alphabet));
+	for (int i = 0; i < size(dict->alphabet); i++)
+		push_back(snapshot->alphabet,
+				create_vectorItem(NULL, at_pos(dict->alphabet, i)->symbol));
+	reserve(snapshot->root->children, size(children));
+	pthread_mutex_lock(&dict->saving_lock);
+	if (dict->frozen_max < dict->frozen_len + size(children))
+	{
+		dict->frozen_max = 2 * (dict->frozen_len + size(children));
+		dict->frozen = realloc(dict->frozen,
+				sizeof(struct frozen_subtree) * dict->frozen_max);
+	}
+	for (int i = 0; i < size(children); i++)
+	{
+		vectorItem *item = at_pos(children, i);
+		push_back(snapshot->root->children,
+				create_vectorItem(item->node, item->symbol));
+		struct frozen_subtree *frozen = find_frozen(dict, item->node);
+		if (frozen == NULL)
+		{
+			frozen = &dict->frozen[dict->frozen_len++];
+			frozen->node = item->node;
+			frozen->snapshots = 0;
+			frozen->detached = false;
 		}
+		frozen->snapshots++;
+	}
+	dict->saving++;
+	pthread_mutex_unlock(&dict->saving_lock);
+	trie_update_bounds(snapshot->root);
+	return snapshot;
+}
+
+/**
+	Zwalnia zrzut słownika, gdy zapis w tle przestał go czytać.
+	Poddrzewa zastąpione już w słowniku kopią zwalnia ostatni zrzut,
+	który je czytał.
+	@param[in,out] dict Słownik.
+	@param[in,out] snapshot Zrzut słownika.
+ */
+static void release_snapshot(struct dictionary *dict, struct dictionary *snapshot)
+{
+	vector *children = snapshot->root->children;
+	pthread_mutex_lock(&dict->saving_lock);
+	for (int i = 0; i < size(children); i++)
+	{
+		vectorItem *item = at_pos(children, i);
+		struct frozen_subtree *frozen = find_frozen(dict, item->node);
+		if (--frozen->snapshots > 0 || !frozen->detached)
+			item->node = NULL;
+		if (frozen->snapshots == 0)
+			*frozen = dict->frozen[--dict->frozen_len];
 	}
-	for(int i = 0; i <= dict->cost; i++)
+	if (--dict->saving == 0)
+		pthread_cond_broadcast(&dict->saved);
+	pthread_mutex_unlock(&dict->saving_lock);
+	for (int i = 0; i < size(children); i++)
+		if (at_pos(children, i)->node != NULL)
+			trie_clear(at_pos(children, i)->node);
+	delete_all(children);
+	snapshot->root->children = init();
+	dictionary_free(snapshot);
+}
+
+/**
+	Przygotowuje do zmiany poddrzewo korzenia, w którym leży słowo.
+	Poddrzewo czytane przez zapis w tle jest zastępowane kopią, więc
+	zmiana czeka co najwyżej na skopiowanie jednego poddrzewa, i to tylko
+	przy pierwszej zmianie tego poddrzewa w czasie zapisu.
+	@param[in,out] dict Słownik.
+	@param[in] word Zmieniane słowo.
+ */
+static void unshare_subtree(struct dictionary *dict, const wchar_t *word)
+{
+	if (word[0] == L'\0')
+		return;
+	pthread_mutex_lock(&dict->saving_lock);
+	if (dict->frozen_len > 0)
 	{
+		vectorItem *item = at(trie_children(dict->root), word[0]);
+		struct frozen_subtree *frozen =
+				item != NULL ? find_frozen(dict, item->node) : NULL;
+		if (frozen != NULL && !frozen->detached)
+		{
+			// Kopiujemy pod blokadą, żeby ostatni zrzut nie zwolnił oryginału.
+			item->node = trie_copy(item->node, dict->root);
+			frozen->detached = true;
+		}
+	}
+	pthread_mutex_unlock(&dict->saving_lock);
+}
+
+/**
+	Czeka, aż zapisy w tle skończą czytać słownik.
+	Wywoływana przed zwolnieniem słownika i odmapowaniem jego pliku.
+	@param[in,out] dict Słownik.
+ */
+static void wait_for_saves(struct dictionary *dict)
+{
+	pthread_mutex_lock(&dict->saving_lock);
+	while (dict->saving > 0)
+		pthread_cond_wait(&dict->saved, &dict->saving_lock);
+	pthread_mutex_unlock(&dict->saving_lock);
+}
 
-//		if (i <= 1)
-			rules_list_done(states[i], DEL_STATE);
-//		else
-//			rules_list_done(states[i], DEL_NO);
-		free(states[i]);
-		fprintf(stderr, "koniec obrotu: %d\n", i);
+/**
+	Zapisuje słownik w tle: serializuje zrzut słownika do pamięci, zapisuje
+	go do pliku tymczasowego, który po synchronizacji na dysk podmienia plik
+	słownika, i zapisuje indeks usunięć liter. Indeks jest budowany od nowa
+	ze zrzutu, bo indeks słownika mógł się już zmienić.
+	@param[in] arg Zapis do wykonania, struct save_task.
+	@return NULL.
+ */
+static void *async_save_worker(void *arg)
+{
+	struct save_task *task = arg;
+	char *path = create_file_path(CONF_PATH, task->lang);
+	char *tmp = create_temp_path(path);
+	char *text = NULL;
+	size_t total = 0;
+	FILE *stream = open_memstream(&text, &total);
+	int result = stream != NULL ? dictionary_save_parallel(task->snapshot, stream, true) : -1;
+	if (stream != NULL && fclose(stream) != 0)
+		result = -1;
+	int fd = result == 0 ? mkstemp(tmp) : -1;
+	if (fd < 0 || fchmod(fd, FILE_MODE) != 0)
+		result = -1;
+	size_t written = 0;
+	while (result == 0 && written < total)
+	{
+		size_t chunk = total - written;
+		if (chunk > SAVE_CHUNK)
+			chunk = SAVE_CHUNK;
+		ssize_t len = write(fd, text + written, chunk);
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len < 0)
+			result = -1;
+		else
+		{
+			written += len;
+			if (task->callback != NULL)
+				task->callback(written, total, false, 0, task->data);
+		}
 	}
-	fprintf(stderr, "kfsjakf\n");
-	for (size_t i = 0; i < len; i++){
-		rules_list_done(rules[i], DEL_NO);
-		free(rules[i]);
+	if (fd >= 0 && ((result == 0 && fsync(fd) != 0) || close(fd) != 0))
+		result = -1;
+	free(text);
+	// Zmiana nazwy zachowuje rozmiar i czas modyfikacji, więc klucz jest już znany.
+	struct dict_image_key key;
+	if (result == 0 && task->index && file_key(tmp, &key) == 0
+			&& dictionary_index(task->snapshot, true) == 0)
+	{
+		char *index_path = create_cache_path(task->lang, INDEX_SUFFIX);
+		write_cached(task->snapshot, index_path, &key, index_writer);
+		free(index_path);
 	}
-	free(states);
-	free(rules);
+	release_snapshot(task->dict, task->snapshot);
+	pthread_mutex_lock(&save_lock);
+	if (result == 0 && rename(tmp, path) != 0)
+		result = -1;
+	if (result == 0 && !is_in_list(task->lang))
+		result = add_dict_to_list(task->lang);
+	pthread_mutex_unlock(&save_lock);
+	if (result != 0 && fd >= 0)
+		unlink(tmp);
+	if (task->callback != NULL)
+		task->callback(written, total, true, result, task->data);
+	free(tmp);
+	free(path);
+	free(task->lang);
+	free(task);
+	pthread_mutex_lock(&save_lock);
+	if (--saves_running == 0)
+		pthread_cond_broadcast(&save_done);
+	pthread_mutex_unlock(&save_lock);
+	return NULL;
 }
 
 /**@}*/
@@ -1151,11 +2955,36 @@ struct dictionary * dictionary_new()
     dict->rules = malloc(sizeof(struct rules_list));
     rules_list_init(dict->rules);
     dict->cost = 6;
+    dict->image = NULL;
+    dict->image_len = 0;
+    dict->matcher = rule_matcher_new();
+    dict->max_rule_cost = 0;
+    dict->min_rule_cost = 0;
+    dict->split_rules = 0;
+    dict->grow_len = 0;
+    dict->grow_cost = 1;
+    dict->shrink_len = 0;
+    dict->shrink_cost = 1;
+    dict->engine = HINTS_BEST_FIRST;
+    dict->max_distance = 1;
+    dict->index = NULL;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    dict->threads = cpus > MAX_THREADS ? MAX_THREADS : (cpus > 0 ? (int) cpus : 1);
+    dict->parallel_states = PARALLEL_STATES;
+    pthread_mutex_init(&dict->matcher_lock, NULL);
+    pthread_mutex_init(&dict->saving_lock, NULL);
+    pthread_cond_init(&dict->saved, NULL);
+    dict->saving = 0;
+    dict->frozen = NULL;
+    dict->frozen_len = 0;
+    dict->frozen_max = 0;
     return dict;
 }
 
 void dictionary_done(struct dictionary *dict)
 {
+    if (dict != NULL)
+        wait_for_saves(dict);
     dictionary_free(dict);
 }
 
@@ -1163,7 +2992,17 @@ int dictionary_insert(struct dictionary *dict, const wchar_t *word)
 {
 	if (dict == NULL)
 		return 0;
-	return trie_insert(dict->root, word, dict->alphabet);
+	if (trie_find(dict->root, word))
+		return 0;
+	unshare_subtree(dict, word);
+	int inserted = trie_insert(dict->root, word, dict->alphabet);
+	// Niepełny indeks dawałby złe podpowiedzi, więc go wyłączamy.
+	if (inserted && dict->index != NULL && delete_index_add(dict->index, word) != 0)
+	{
+		delete_index_free(dict->index);
+		dict->index = NULL;
+	}
+	return inserted;
 }
 
 
@@ -1173,9 +3012,12 @@ int dictionary_delete(struct dictionary *dict, const wchar_t *word)
 		return 0;
 	if (dictionary_find(dict, word))
 	{
+		unshare_subtree(dict, word);
 		int i = 0;
 		int success = 0;
 		trie_clear_path(dict->root, word, &i, &success);
+		if (dict->index != NULL && !dictionary_find(dict, word))
+			delete_index_remove(dict->index, word);
 		return (success && !i);
 	}
 	else
@@ -1189,6 +3031,26 @@ bool dictionary_find(const struct dictionary *dict, const wchar_t* word)
 	return trie_find(dict->root, word);
 }
 
+int dictionary_set_frequency(struct dictionary *dict, const wchar_t *word,
+		uint32_t frequency)
+{
+	if (dict == NULL)
+		return 0;
+	if (trie_find_word(dict->root, word) == NULL)
+		return 0;
+	unshare_subtree(dict, word);
+	trie_find_word(dict->root, word)->frequency = frequency;
+	return 1;
+}
+
+uint32_t dictionary_frequency(const struct dictionary *dict, const wchar_t *word)
+{
+	if (dict == NULL)
+		return 0;
+	struct nodeInfo *node = trie_find_word(dict->root, word);
+	return node != NULL ? node->frequency : 0;
+}
+
 int dictionary_save(const struct dictionary *dict, FILE* stream)
 {
 	if (dict == NULL)
@@ -1212,6 +3074,25 @@ int dictionary_save(const struct dictionary *dict, FILE* stream)
 
 }
 
+int dictionary_save_parallel(const struct dictionary *dict, FILE *stream,
+		bool offsets)
+{
+	if (dict == NULL)
+		return -1;
+	char symbol[MB_LEN_MAX];
+	mbstate_t ps;
+	memset(&ps, 0, sizeof(ps));
+	for (int i = 0; i < size(dict->alphabet); i++)
+	{
+		size_t len = wcrtomb(symbol, at_pos(dict->alphabet, i)->symbol, &ps);
+		if (len == (size_t) -1 || fwrite(symbol, 1, len, stream) != len)
+			return -1;
+	}
+	if (fputc('\n', stream) == EOF)
+		return -1;
+	return trie_parallel_save(dict->root, stream, offsets);
+}
+
 struct dictionary * dictionary_load(FILE *stream)
 {
 	struct dictionary *dict = dictionary_new();
@@ -1223,11 +3104,10 @@ struct dictionary * dictionary_load(FILE *stream)
     if ((check = fgetwc(stream)) != L'0')
     {
     	assert(check != EOF);
-    	fprintf(stderr, "mam znak: %lc\n", check);
+    	TRACE(TRACE_ERROR, "niepoprawny znak po alfabecie: %lc", check);
     	dictionary_done(dict);
     	return NULL;
     }
-    fprintf(stderr, "wczytany alfabet\n");
     trie_dfs_load(dict->root, stream, END_DFS);
     if (ferror(stream))
     {
@@ -1240,15 +3120,183 @@ struct dictionary * dictionary_load(FILE *stream)
 void dictionary_hints(const struct dictionary *dict, const wchar_t* word,
 		struct word_list *list)
 {
-	if (dict != NULL)
+	dictionary_hints_limited(dict, word, NULL, list);
+}
+
+enum hints_status dictionary_hints_limited(const struct dictionary *dict,
+		const wchar_t *word, const struct hints_limits *limits,
+		struct word_list *list)
+{
+	if (dict == NULL)
 	{
 		word_list_init(list);
-//		hints_by_delete(dict, word, list);
-//		hints_by_replace(dict, word, list);
-//		hints_by_add(dict, word, list);
-		struct state *begin = create_state((wchar_t *)word, 0, 0, 0, L"", dict->root, NULL, 0);
-		get_hints((struct dictionary *)dict, (wchar_t *)word, begin, list);
+		return HINTS_COMPLETE;
 	}
+	struct arena *arena = arena_thread();
+	enum hints_status status = find_hints(dict, word, list, arena, dict->threads,
+			limits);
+	arena_reset(arena);
+	return status;
+}
+
+int dictionary_hints_batch(const struct dictionary *dict,
+		const wchar_t * const *words, size_t n, struct word_list *lists)
+{
+	if (dict == NULL)
+		return -1;
+	struct batch_word *sorted = malloc(sizeof(struct batch_word) * (n + 1));
+	size_t *first = malloc(sizeof(size_t) * (n + 1));
+	if (sorted == NULL || first == NULL)
+	{
+		free(sorted);
+		free(first);
+		return -1;
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		sorted[i].word = words[i];
+		sorted[i].index = i;
+	}
+	qsort(sorted, n, sizeof(struct batch_word), batch_word_compare);
+	// Każde słowo wyszukujemy raz, dla jego pierwszego wystąpienia.
+	size_t count = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (count == 0 || wcscmp(sorted[count - 1].word, sorted[i].word) != 0)
+			sorted[count++] = sorted[i];
+		first[sorted[i].index] = sorted[count - 1].index;
+	}
+	// Automat reguł przygotowujemy przed uruchomieniem wątków.
+	get_matcher(dict);
+	int threads = dict->threads;
+	if ((size_t) threads > count)
+		threads = count > 0 ? (int) count : 1;
+	// Wątki dzielą się słowami, więc pojedyncze słowo nie potrzebuje
+	// już własnych wątków.
+	struct batch_job job = { dict, sorted, count, 0, threads > 1 ? 1 : dict->threads,
+		lists };
+	run_workers(batch_thread, &job, threads);
+	for (size_t i = 0; i < n; i++)
+		if (first[i] != i)
+			copy_hints(&lists[i], &lists[first[i]]);
+	free(sorted);
+	free(first);
+	return 0;
+}
+
+struct hints_session *hints_session_new(const struct dictionary *dict)
+{
+	struct hints_session *session = malloc(sizeof(struct hints_session));
+	if (session == NULL)
+		return NULL;
+	arena_init(&session->arena);
+	arena_init(&session->scratch);
+	rules_list_init(&session->positions);
+	session->word = arena_alloc(&session->arena, sizeof(wchar_t) * (SESSION_WORD + 1));
+	if (session->word == NULL || session->positions.array == NULL)
+	{
+		hints_session_done(session);
+		return NULL;
+	}
+	session->word[0] = L'\0';
+	session->max_len = SESSION_WORD;
+	session->by_rules = rules_list_size(dict->rules) > 0
+			&& dict->engine != HINTS_LEVENSHTEIN;
+	struct hints_query *query = &session->query;
+	memset(query, 0, sizeof(struct hints_query));
+	query->dict = dict;
+	query->word = session->word;
+	query->len = 0;
+	query->max_cost = dict->max_rule_cost < dict->cost ? dict->max_rule_cost : dict->cost;
+	query->min_cost = dict->min_rule_cost;
+	query->threads = 1;
+	query->session = true;
+	if (session->by_rules && session_fill(session) != 0)
+	{
+		hints_session_done(session);
+		return NULL;
+	}
+	return session;
+}
+
+void hints_session_done(struct hints_session *session)
+{
+	if (session == NULL)
+		return;
+	for (size_t i = 0; i < rules_list_size(&session->positions); i++)
+	{
+		arena_done(&session_position(session, i)->arena);
+		free(session_position(session, i));
+	}
+	rules_list_done(&session->positions, DEL_NO);
+	arena_done(&session->arena);
+	arena_done(&session->scratch);
+	free(session);
+}
+
+int hints_session_push_char(struct hints_session *session, wchar_t ch)
+{
+	struct hints_query *query = &session->query;
+	if (query->len == session->max_len)
+	{
+		wchar_t *word = arena_alloc(&session->arena,
+				sizeof(wchar_t) * (2 * session->max_len + 1));
+		if (word == NULL)
+			return -1;
+		wmemcpy(word, session->word, query->len + 1);
+		session->word = word;
+		session->max_len *= 2;
+		query->word = word;
+	}
+	session->word[query->len++] = ch;
+	session->word[query->len] = L'\0';
+	if (session->by_rules && session_fill(session) != 0)
+	{
+		session->word[--query->len] = L'\0';
+		return -1;
+	}
+	return 0;
+}
+
+int hints_session_pop_char(struct hints_session *session)
+{
+	struct hints_query *query = &session->query;
+	if (query->len == 0)
+		return -1;
+	if (session->by_rules)
+		arena_reset(&session_position(session, query->len)->arena);
+	session->word[--query->len] = L'\0';
+	return 0;
+}
+
+void hints_session_clear(struct hints_session *session)
+{
+	while (hints_session_pop_char(session) == 0)
+		;
+}
+
+const wchar_t *hints_session_word(const struct hints_session *session)
+{
+	return session->word;
+}
+
+void hints_session_hints(struct hints_session *session, struct word_list *list)
+{
+	if (!session->by_rules)
+	{
+		dictionary_hints(session->query.dict, session->word, list);
+		return;
+	}
+	word_list_init(list);
+	struct word_collector hints;
+	if (word_collector_init(&hints, DICTIONARY_MAX_HINTS) != 0)
+		return;
+	session_collect(session, &hints);
+	word_collector_finish(&hints, list);
+	word_collector_done(&hints);
+	arena_reset(&session->scratch);
+	TRACE(TRACE_DEBUG, "%ls: %zu podpowiedzi w sesji", session->word,
+			word_list_size(list));
 }
 
 int dictionary_lang_list(char **list, size_t *list_len)
@@ -1260,25 +3308,126 @@ int dictionary_lang_list(char **list, size_t *list_len)
 	return read_list(list, list_len, NULL, 0);
 }
 
+struct dictionary * dictionary_load_file(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size == 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	void *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED)
+		return NULL;
+	struct dictionary *dict = dictionary_new();
+	dict->image = image;
+	dict->image_len = st.st_size;
+	const char *end = (const char *) image + st.st_size;
+	const char *text = image_load_alphabet(dict, image, end);
+	if (text == NULL || text >= end || *text != '0'
+			|| !trie_image_load_parallel(dict->root, text + 1, end,
+					DICTIONARY_LAZY_DEPTH))
+	{
+		dictionary_done(dict);
+		return NULL;
+	}
+	if (DICTIONARY_LAZY_DEPTH == 0)
+	{
+		munmap(dict->image, dict->image_len);
+		dict->image = NULL;
+		dict->image_len = 0;
+	}
+	return dict;
+}
+
+struct dictionary * dictionary_import(const char *path)
+{
+	struct import_result result;
+	if (import_word_list(path, &result) != 0)
+		return NULL;
+	struct dictionary *dict = dictionary_new();
+	reserve(dict->alphabet, result.alphabet_size);
+	for (size_t i = 0; i < result.alphabet_size; i++)
+		push_back(dict->alphabet, create_vectorItem(NULL, result.alphabet[i]));
+	struct trie_builder builder;
+	trie_builder_init(&builder, dict->root);
+	size_t capacity = WORD_SIZE;
+	wchar_t *word = malloc(sizeof(wchar_t) * capacity);
+	for (size_t i = 0; i < result.count; i++)
+	{
+		size_t len = 0;
+		for (const uint16_t *letter = result.words[i]; *letter != 0; letter++)
+		{
+			if (len == capacity)
+			{
+				capacity *= 2;
+				word = realloc(word, sizeof(wchar_t) * capacity);
+			}
+			word[len++] = result.alphabet[*letter - 1];
+		}
+		trie_builder_add(&builder, word, len, result.frequencies[i]);
+	}
+	free(word);
+	trie_builder_done(&builder);
+	import_result_done(&result);
+	return dict;
+}
+
+void dictionary_stats(const struct dictionary *dict,
+		struct dictionary_stats *stats)
+{
+	stats->nodes = 0;
+	stats->pending = 0;
+	stats->bytes = 0;
+	stats->index_bytes = 0;
+	if (dict != NULL)
+	{
+		trie_stats(dict->root, &stats->nodes, &stats->pending, &stats->bytes);
+		stats->index_bytes = delete_index_bytes(dict->index);
+	}
+}
+
 struct dictionary * dictionary_load_lang(const char *lang)
 {
 	char *file = create_file_path(CONF_PATH, lang);
-	FILE *fp = fopen(file, "r");
 	struct dictionary *new_dict;
-    if (!fp || !(new_dict = dictionary_load(fp)))
-    {
-    	fclose(fp);
-		free(file);
-    	return NULL;
-    }
-	fclose(fp);
+	// Obraz zawiera całe drzewo, więc przy leniwym wczytywaniu go pomijamy.
+	if (DICTIONARY_LAZY_DEPTH > 0 || (new_dict = load_cached(lang, file)) == NULL)
+		new_dict = dictionary_load_file(file);
+	// Indeks zapisany razem ze słownikiem, o ile słownik się od tego czasu nie zmienił.
+	struct dict_image_key key;
+	if (new_dict != NULL && file_key(file, &key) == 0)
+	{
+		char *path = create_cache_path(lang, INDEX_SUFFIX);
+		new_dict->index = delete_index_load(path, &key);
+		free(path);
+	}
+	TRACE(TRACE_INFO, "%s: %s%s", lang, new_dict != NULL ? "wczytany" : "błąd",
+			new_dict != NULL && new_dict->index != NULL ? ", z indeksem" : "");
 	free(file);
 	return new_dict;
 }
 
-int dictionary_save_lang(const struct dictionary *dict, const char *lang)
+int dictionary_save_lang(struct dictionary *dict, const char *lang)
 {
 	int success;
+	if (dict != NULL && dict->image != NULL)
+	{
+		// Plik może być nadpisywany, więc najpierw wczytujemy wszystko.
+		// Zapis w tle może jeszcze czytać poddrzewa ze zmapowanego pliku.
+		wait_for_saves(dict);
+		// Niepoprawnego poddrzewa nie da się odtworzyć, a zapis bez niego
+		// nadpisałby plik słownika bez części słów.
+		if (trie_load_all(dict->root) != 0)
+			return -1;
+		munmap(dict->image, dict->image_len);
+		dict->image = NULL;
+		dict->image_len = 0;
+	}
 	if ((success = create_directory(CONF_PATH)) != 0)
 		return success;
 	char *path = create_file_path(CONF_PATH, lang);
@@ -1286,14 +3435,67 @@ int dictionary_save_lang(const struct dictionary *dict, const char *lang)
 	FILE *fp = open_file(path, &exists, "w");
 	if (fp == NULL)
 		return -1;
-	success = dictionary_save(dict, fp);
+	success = dictionary_save_parallel(dict, fp, true);
+	pthread_mutex_lock(&save_lock);
 	if (!is_in_list((char *)lang))
 		success += add_dict_to_list(lang);
+	pthread_mutex_unlock(&save_lock);
 	fclose(fp);
+	// Indeks dostaje klucz zapisanego pliku, więc późniejsze zmiany pliku go unieważniają.
+	struct dict_image_key key;
+	if (success == 0 && dict->index != NULL && file_key(path, &key) == 0)
+	{
+		char *index_path = create_cache_path(lang, INDEX_SUFFIX);
+		write_cached(dict, index_path, &key, index_writer);
+		free(index_path);
+	}
 	free(path);
 	return success;
 }
 
+int dictionary_save_async(struct dictionary *dict, const char *lang,
+		dictionary_save_callback *callback, void *data)
+{
+	if (dict == NULL || create_directory(CONF_PATH) != 0)
+		return -1;
+	struct save_task *task = malloc(sizeof(struct save_task));
+	if (task == NULL)
+		return -1;
+	task->dict = dict;
+	task->snapshot = snapshot_dictionary(dict);
+	task->index = dict->index != NULL;
+	task->lang = strdup(lang);
+	task->callback = callback;
+	task->data = data;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_mutex_lock(&save_lock);
+	pthread_t id;
+	int result = task->lang != NULL && task->snapshot != NULL ? pthread_create(&id, &attr, async_save_worker, task) : -1;
+	if (result == 0)
+		saves_running++;
+	pthread_mutex_unlock(&save_lock);
+	pthread_attr_destroy(&attr);
+	if (result != 0)
+	{
+		if (task->snapshot != NULL)
+			release_snapshot(dict, task->snapshot);
+		free(task->lang);
+		free(task);
+		return -1;
+	}
+	return 0;
+}
+
+void dictionary_save_wait(void)
+{
+	pthread_mutex_lock(&save_lock);
+	while (saves_running > 0)
+		pthread_cond_wait(&save_done, &save_lock);
+	pthread_mutex_unlock(&save_lock);
+}
+
 int dictionary_hints_max_cost(struct dictionary *dict, int new_cost)
 {
 	int last_cost = dict->cost;
@@ -1301,6 +3503,50 @@ int dictionary_hints_max_cost(struct dictionary *dict, int new_cost)
 	return last_cost;
 }
 
+int dictionary_hints_max_distance(struct dictionary *dict, int new_distance)
+{
+	int last_distance = dict->max_distance;
+	dict->max_distance = new_distance;
+	return last_distance;
+}
+
+int dictionary_hints_threads(struct dictionary *dict, int threads)
+{
+	int last_threads = dict->threads;
+	if (threads < 1)
+		threads = 1;
+	dict->threads = threads > MAX_THREADS ? MAX_THREADS : threads;
+	return last_threads;
+}
+
+int dictionary_index(struct dictionary *dict, bool enable)
+{
+	delete_index_free(dict->index);
+	dict->index = NULL;
+	if (!enable)
+		return 0;
+	struct delete_index *index = delete_index_new(DICTIONARY_INDEX_DISTANCE);
+	size_t capacity = WORD_SIZE;
+	wchar_t *word = malloc(sizeof(wchar_t) * capacity);
+	int result = index != NULL && word != NULL ? 0 : -1;
+	if (result == 0)
+		result = index_words(index, dict->root, &word, &capacity, 0);
+	free(word);
+	if (result == 0)
+		dict->index = index;
+	else
+		delete_index_free(index);
+	return result;
+}
+
+enum hints_engine dictionary_hints_engine(struct dictionary *dict,
+		enum hints_engine engine)
+{
+	enum hints_engine last_engine = dict->engine;
+	dict->engine = engine;
+	return last_engine;
+}
+
 /**
    Usuwa wszystkie reguły ze słownika
    @param[in,out] dict Słownik.
@@ -1309,8 +3555,20 @@ void dictionary_rule_clear(struct dictionary *dict)
 {
 	if (dict != NULL)
 	{
-		rules_list_done(dict->rules, DEL_FREE);
-		free(dict->rules);
+		struct rule **rules = (struct rule **) rules_list_get(dict->rules);
+		for (size_t i = 0; i < rules_list_size(dict->rules); i++)
+			free_rule(rules[i]);
+		rules_list_done(dict->rules, DEL_NO);
+		rules_list_init(dict->rules);
+		rule_matcher_free(dict->matcher);
+		dict->matcher = rule_matcher_new();
+		dict->max_rule_cost = 0;
+		dict->min_rule_cost = 0;
+		dict->split_rules = 0;
+		dict->grow_len = 0;
+		dict->grow_cost = 1;
+		dict->shrink_len = 0;
+		dict->shrink_cost = 1;
 	}
 }
 
@@ -1325,17 +3583,18 @@ int dictionary_rule_add(struct dictionary *dict, const wchar_t *left,
 	bool same_length = wcslen(left) == wcslen(right);
 	if (same_length && wcslen(left) == 0 && flag != RULE_SPLIT)
 		return -1;
-	fprintf(stderr, "dodaje\n");
-	struct rule *rule = create_rule((wchar_t *)left, (wchar_t *)right, cost, flag);
-	if (rules_list_add(dict->rules, rule) != 1)
+	if (cost <= 0)
 		return -1;
+	if (add_rule(dict, left, right, cost, flag) < 0)
+		return -1;
+	TRACE(TRACE_DEBUG, "reguła %ls -> %ls, koszt %d, flaga %d%s", left, right,
+			cost, (int) flag, bidirectional ? ", obustronna" : "");
 	if (bidirectional)
 	{
-		if (count_variables(left, right) > 1)
-			return -1;
-		struct rule *rule2 = create_rule((wchar_t *)right, (wchar_t *)left, cost, flag);
-		if (rules_list_add(dict->rules, rule2) != 1)
-			return -1;
+		if (count_variables(right, left) > 1)
+			return 1;
+		if (add_rule(dict, right, left, cost, flag) < 0)
+			return 1;
 		return 2;
 	}
 	return 1;
@@ -16,6 +16,7 @@
 #include "word_list.h"
 #include "conf.h"
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <wchar.h>
 
@@ -24,6 +25,11 @@
   */
 struct dictionary;
 
+/**
+  Sesja podpowiedzi dla słowa wpisywanego znak po znaku.
+  */
+struct hints_session;
+
 
 /**
   Inicjalizacja słownika.
@@ -67,6 +73,28 @@ int dictionary_delete(struct dictionary *dict, const wchar_t* word);
 bool dictionary_find(const struct dictionary *dict, const wchar_t* word);
 
 
+/**
+  Ustawia częstość słowa ze słownika.
+  Słowa wstawione przez dictionary_insert() mają częstość 1.
+  Częstość jest zapisywana razem ze słownikiem.
+  @param[in,out] dict Słownik.
+  @param[in] word Słowo.
+  @param[in] frequency Nowa częstość słowa.
+  @return 1 jeśli słowo jest w słowniku, 0 w p.p.
+  */
+int dictionary_set_frequency(struct dictionary *dict, const wchar_t *word,
+                             uint32_t frequency);
+
+
+/**
+  Zwraca częstość słowa ze słownika.
+  @param[in] dict Słownik.
+  @param[in] word Słowo.
+  @return Częstość słowa, 0 jeśli słowa nie ma w słowniku.
+  */
+uint32_t dictionary_frequency(const struct dictionary *dict, const wchar_t *word);
+
+
 /**
   Zapisuje słownik.
   @param[in] dict Słownik.
@@ -76,6 +104,20 @@ bool dictionary_find(const struct dictionary *dict, const wchar_t* word);
 int dictionary_save(const struct dictionary *dict, FILE* stream);
 
 
+/**
+  Zapisuje słownik, zapisując poddrzewa równolegle.
+  Bez tablicy przesunięć wynik jest identyczny z dictionary_save().
+  Tablica przesunięć poddrzew pozwala dictionary_load_file() wczytywać
+  poddrzewa równolegle; pozostałe funkcje wczytujące ją pomijają.
+  @param[in] dict Słownik.
+  @param[in,out] stream Strumień, gdzie ma być zapisany słownik.
+  @param[in] offsets Czy dopisać tablicę przesunięć poddrzew.
+  @return <0 jeśli operacja się nie powiedzie, 0 w p.p.
+  */
+int dictionary_save_parallel(const struct dictionary *dict, FILE *stream,
+                             bool offsets);
+
+
 /**
   Inicjuje i wczytuje słownik.
   Słownik ten należy zniszczyć za pomocą dictionary_done().
@@ -85,11 +127,64 @@ int dictionary_save(const struct dictionary *dict, FILE* stream);
 struct dictionary * dictionary_load(FILE* stream);
 
 
+/**
+  Inicjuje i wczytuje słownik z pliku o podanej ścieżce.
+  Plik jest mapowany do pamięci. Jeśli DICTIONARY_LAZY_DEPTH jest dodatnie,
+  od razu tworzone są tylko górne poziomy drzewa, a głębsze poddrzewa
+  są wczytywane z pliku przy pierwszym odwołaniu.
+  Słownik ten należy zniszczyć za pomocą dictionary_done().
+  @param[in] path Ścieżka do pliku słownika.
+  @return Wczytany słownik lub NULL, jeśli operacja się nie powiedzie.
+  */
+struct dictionary * dictionary_load_file(const char *path);
+
+
+/**
+  Tworzy słownik z listy słów (jedno słowo w linii).
+  Za słowem może być podana, po spacji, jego częstość, domyślnie 1.
+  Częstości powtórzonych słów są sumowane.
+  Alfabet słownika to litery występujące w słowach. Słowa są zamieniane
+  na małe litery, linie zawierające inne znaki są pomijane.
+  Słownik ten należy zniszczyć za pomocą dictionary_done().
+  @param[in] path Ścieżka do pliku z listą słów.
+  @return Utworzony słownik lub NULL, jeśli operacja się nie powiedzie.
+  */
+struct dictionary * dictionary_import(const char *path);
+
+
+/**
+  Statystyki pamięci zajmowanej przez słownik.
+  */
+struct dictionary_stats
+{
+    size_t nodes;	///< Liczba wczytanych węzłów drzewa.
+    size_t pending;	///< Liczba poddrzew jeszcze niewczytanych z pliku.
+    size_t bytes;	///< Przybliżona liczba bajtów zajętych przez węzły.
+    size_t index_bytes;	///< Liczba bajtów zajętych przez indeks usunięć liter.
+};
+
+
+/**
+  Zbiera statystyki pamięci słownika.
+  Nie powoduje wczytania niewczytanych poddrzew.
+  @param[in] dict Słownik.
+  @param[out] stats Zebrane statystyki.
+  */
+void dictionary_stats(const struct dictionary *dict,
+                      struct dictionary_stats *stats);
+
+
 /**
   Tworzy możliwe podpowiedzi dla zadanego słowa.
   Jeżeli pojedyncza podpowiedź składa się z kilku słów,
   wtedy powinien być to jeden łańcuch znaków,
   w którym słowa są pooddzielane pojedynczymi spacjami.
+  Wybieranych jest co najwyżej DICTIONARY_MAX_HINTS podpowiedzi
+  o najmniejszym koszcie (bez reguł kosztem jest odległość edycyjna),
+  a spośród podpowiedzi o równym koszcie te o większej częstości
+  (dla kilku słów najmniejszej z ich częstości), potem wcześniejsze
+  alfabetycznie. Lista jest posortowana alfabetycznie, a w tej kolejności,
+  od najlepszej, podpowiedzi zwraca word_list_ranked().
   @param[in] dict Słownik.
   @param[in] word Szukane słowo.
   @param[in,out] list Lista, w której zostaną umieszczone podpowiedzi.
@@ -97,6 +192,131 @@ struct dictionary * dictionary_load(FILE* stream);
 void dictionary_hints(const struct dictionary *dict, const wchar_t* word,
                       struct word_list *list);
 
+/**
+  Ograniczenia jednego wyszukiwania podpowiedzi.
+  Pole równe 0 oznacza brak danego ograniczenia.
+  */
+struct hints_limits
+{
+    unsigned long time_us;	///< Czas wyszukiwania w mikrosekundach.
+    size_t max_states;	///< Liczba różnych stanów wyszukiwania.
+    size_t max_bytes;	///< Liczba bajtów pamięci przydzielonej na stany.
+};
+
+/**
+  Wynik wyszukiwania podpowiedzi z ograniczeniami.
+  */
+enum hints_status
+{
+    HINTS_COMPLETE,	///< Wyszukiwanie się zakończyło, podpowiedzi są pełne.
+    HINTS_TIMEOUT,	///< Minął czas wyszukiwania, podpowiedzi są częściowe.
+    HINTS_STATE_LIMIT,	///< Utworzono za dużo stanów, podpowiedzi są częściowe.
+    HINTS_MEMORY_LIMIT,	///< Przydzielono za dużo pamięci, podpowiedzi są częściowe.
+    HINTS_NO_MEMORY	///< Zabrakło pamięci, lista podpowiedzi jest pusta.
+};
+
+/**
+  Tworzy podpowiedzi dla słowa jak dictionary_hints(), przerywając
+  wyszukiwanie po przekroczeniu ograniczeń.
+  Po przerwaniu lista zawiera najlepsze z dotąd znalezionych podpowiedzi.
+  Algorytm warstwowy i best-first znajdują podpowiedzi w kolejności
+  kosztu, więc są one najtańszymi podpowiedziami słowa, choć może
+  ich być mniej niż bez ograniczeń. HINTS_SEGMENTED zwraca wtedy
+  podziały złożone z dotąd znalezionych słów, które nie muszą być
+  najtańsze. Bez reguł liczbą stanów jest
+  liczba odwiedzonych węzłów drzewa, a pamięć jest przydzielana
+  z góry i nie jest ograniczana. Wyszukiwania w indeksie usunięć
+  liter nie przerywamy, bo nie tworzy ono stanów.
+  Ograniczenia są sprawdzane między krokami wyszukiwania, więc mogą
+  zostać nieznacznie przekroczone.
+  @param[in] dict Słownik.
+  @param[in] word Szukane słowo.
+  @param[in] limits Ograniczenia, NULL oznacza ich brak.
+  @param[out] list Lista, w której zostaną umieszczone podpowiedzi.
+  Trzeba ją zwolnić przez word_list_done(), także gdy wyszukiwanie
+  się nie powiodło.
+  @return HINTS_COMPLETE albo powód przerwania wyszukiwania.
+  */
+enum hints_status dictionary_hints_limited(const struct dictionary *dict,
+		const wchar_t *word, const struct hints_limits *limits,
+		struct word_list *list);
+
+/**
+  Tworzy podpowiedzi dla wielu słów naraz.
+  Listy są takie same jak dla kolejnych wywołań dictionary_hints().
+  Powtórzone słowa są wyszukiwane raz, a różne słowa są rozdzielane
+  między wątki, których liczbę ustawia dictionary_hints_threads().
+  @param[in] dict Słownik.
+  @param[in] words Słowa.
+  @param[in] n Liczba słów.
+  @param[out] lists Tablica n list, w i-tej liście zostaną umieszczone
+  podpowiedzi dla i-tego słowa. Każdą listę trzeba zwolnić przez
+  word_list_done().
+  @return 0 jeśli się udało, -1 jeśli zabrakło pamięci i listy nie
+  zostały utworzone.
+  */
+int dictionary_hints_batch(const struct dictionary *dict,
+		const wchar_t * const *words, size_t n, struct word_list *lists);
+
+/**
+  Rozpoczyna sesję podpowiedzi dla słowa wpisywanego znak po znaku,
+  np. w edytorze podpowiadającym w trakcie pisania.
+  Sesja pamięta stany wyszukiwania dla kolejnych pozycji słowa, więc
+  po dopisaniu znaku wyznacza tylko stany kończące się na nowej pozycji.
+  W trakcie sesji nie można zmieniać słownika (słów, reguł, kosztu
+  ani algorytmu), można go za to czytać w innych wątkach. Dla słownika
+  bez reguł albo z algorytmem HINTS_LEVENSHTEIN sesja pamięta tylko
+  słowo, a podpowiedzi wyszukuje od nowa.
+  Sesję należy zakończyć przez hints_session_done().
+  @param[in] dict Słownik.
+  @return Nowa sesja z pustym słowem, NULL jeśli zabrakło pamięci.
+  */
+struct hints_session *hints_session_new(const struct dictionary *dict);
+
+/**
+  Kończy sesję podpowiedzi i zwalnia jej pamięć.
+  @param[in] session Sesja, może być NULL.
+  */
+void hints_session_done(struct hints_session *session);
+
+/**
+  Dopisuje znak na końcu słowa sesji.
+  @param[in,out] session Sesja.
+  @param[in] ch Dopisywany znak.
+  @return 0 jeśli się udało, -1 jeśli zabrakło pamięci i słowo się nie zmieniło.
+  */
+int hints_session_push_char(struct hints_session *session, wchar_t ch);
+
+/**
+  Usuwa ostatni znak słowa sesji.
+  Stany pozostałych pozycji zostają, więc nic nie jest liczone od nowa.
+  @param[in,out] session Sesja.
+  @return 0 jeśli się udało, -1 jeśli słowo było puste.
+  */
+int hints_session_pop_char(struct hints_session *session);
+
+/**
+  Usuwa całe słowo sesji, np. po przejściu do następnego słowa.
+  @param[in,out] session Sesja.
+  */
+void hints_session_clear(struct hints_session *session);
+
+/**
+  Zwraca słowo sesji.
+  @param[in] session Sesja.
+  @return Słowo, ważne do następnej zmiany słowa.
+  */
+const wchar_t *hints_session_word(const struct hints_session *session);
+
+/**
+  Tworzy podpowiedzi dla słowa sesji.
+  Lista jest taka sama jak z dictionary_hints() dla tego słowa.
+  @param[in,out] session Sesja.
+  @param[out] list Lista, w której zostaną umieszczone podpowiedzi.
+  Trzeba ją zwolnić przez word_list_done().
+  */
+void hints_session_hints(struct hints_session *session, struct word_list *list);
+
 
 /**
   Zwraca nazwy języków, dla których dostępne są słowniki.
@@ -120,6 +340,9 @@ int dictionary_lang_list(char **list, size_t *list_len);
 
 /**
   Inicjuje i wczytuje słownik dla zadanego języka.
+  Jeśli DICTIONARY_LAZY_DEPTH wynosi 0, słownik jest wczytywany z obrazu
+  w pamięci podręcznej, o ile ten jest aktualny. W przeciwnym razie obraz
+  jest pomijany, a plik słownika wczytywany leniwie.
   Słownik ten należy zniszczyć za pomocą dictionary_done().
   @param[in] lang Nazwa języka, patrz dictionary_lang_list().
   @return Słownik dla danego języka lub NULL, jeśli operacja się nie powiedzie.
@@ -129,11 +352,55 @@ struct dictionary * dictionary_load_lang(const char *lang);
 
 /**
   Zapisuje słownik jak słownik dla ustalonego języka.
-  @param[in] dict Słownik.
+  Słownik wczytany leniwie jest najpierw wczytywany w całości, a jego plik
+  przestaje być zmapowany, bo może być właśnie nadpisywany. Słownik jest
+  więc zmieniany i, jak przy innych zmianach, nie wolno go w tym czasie
+  używać w innych wątkach.
+  @param[in,out] dict Słownik.
   @param[in] lang Nazwa języka, patrz dictionary_lang_list().
   @return <0 jeśli operacja się nie powiedzie, 0 w p.p.
   */
-int dictionary_save_lang(const struct dictionary *dict, const char *lang);
+int dictionary_save_lang(struct dictionary *dict, const char *lang);
+
+
+/**
+  Funkcja informująca o postępie zapisu słownika w tle.
+  Jest wywoływana w wątku zapisu, a nie w wątku, który rozpoczął zapis.
+  @param[in] written Liczba bajtów zapisanych do pliku.
+  @param[in] total Rozmiar zapisywanego pliku.
+  @param[in] done Czy zapis się zakończył, wtedy jest to ostatnie wywołanie.
+  @param[in] status Po zakończeniu: 0 jeśli zapis się powiódł, <0 w p.p.
+  @param[in] data Dane przekazane do dictionary_save_async().
+  */
+typedef void dictionary_save_callback(size_t written, size_t total, bool done,
+                                      int status, void *data);
+
+
+/**
+  Zapisuje słownik w tle, jak dictionary_save_lang(), razem z indeksem
+  usunięć liter, jeśli jest włączony. Zapisywany jest zrzut słownika
+  z chwili wywołania, który współdzieli ze słownikiem poddrzewa korzenia,
+  więc funkcja wraca od razu. Zmiany słownika nie czekają na zapis:
+  pierwsza zmiana poddrzewa czytanego przez zapis kopiuje tylko to
+  poddrzewo. Na koniec zapisu czekają dictionary_done() i
+  dictionary_save_lang() dla słownika wczytanego leniwie. Plik jest
+  zapisywany do pliku tymczasowego, synchronizowany na dysk i atomowo
+  podmieniany, więc w razie awarii zostaje stara albo nowa wersja.
+  @param[in,out] dict Słownik.
+  @param[in] lang Nazwa języka, patrz dictionary_lang_list().
+  @param[in] callback Funkcja informująca o postępie, może być NULL.
+  @param[in] data Dane przekazywane do funkcji callback.
+  @return <0 jeśli nie udało się rozpocząć zapisu, 0 w p.p.
+  */
+int dictionary_save_async(struct dictionary *dict, const char *lang,
+                          dictionary_save_callback *callback, void *data);
+
+
+/**
+  Czeka na zakończenie wszystkich zapisów rozpoczętych przez
+  dictionary_save_async(). Należy ją wywołać przed zakończeniem programu.
+  */
+void dictionary_save_wait(void);
 
 /**
 	Ustawia maksymalny koszt z jakim jest generowana podpowiedź.
@@ -143,6 +410,67 @@ int dictionary_save_lang(const struct dictionary *dict, const char *lang);
 */
 int dictionary_hints_max_cost(struct dictionary *dict, int new_cost);
 
+/**
+	Ustawia maksymalną odległość edycyjną podpowiedzi wyszukiwanych bez
+	reguł, czyli liczbę usunięć, zamian i dodań liter. Domyślnie 1.
+	@param[in,out] dict Słownik.
+	@param[in] new_distance Nowa maksymalna odległość.
+	@return Zwraca dotychczasową maksymalną odległość.
+*/
+int dictionary_hints_max_distance(struct dictionary *dict, int new_distance);
+
+/**
+	Ustawia liczbę wątków, w których algorytm HINTS_LAYERED zbiera
+	stany dużych warstw. Małe warstwy są zawsze zbierane w jednym wątku.
+	Tyle samo wątków wyszukuje podpowiedzi w dictionary_hints_batch().
+	Domyślnie tyle, ile jest procesorów, ale nie więcej niż 16.
+	@param[in,out] dict Słownik.
+	@param[in] threads Nowa liczba wątków, od 1 do 16.
+	@return Zwraca dotychczasową liczbę wątków.
+*/
+int dictionary_hints_threads(struct dictionary *dict, int threads);
+
+/**
+	Włącza albo wyłącza indeks usunięć liter.
+	Indeks przypisuje każdemu wariantowi słowa ze słownika powstałemu
+	przez usunięcie co najwyżej DICTIONARY_INDEX_DISTANCE liter słowa,
+	z których powstał. Podpowiedzi bez reguł w odległości nie większej
+	niż DICTIONARY_INDEX_DISTANCE są wtedy wyszukiwane w indeksie zamiast
+	w drzewie, kosztem dodatkowej pamięci (patrz dictionary_stats()).
+	Indeks jest aktualizowany przez dictionary_insert() i dictionary_delete()
+	i zapisywany przez dictionary_save_lang(), a dictionary_load_lang()
+	wczytuje go, jeśli plik słownika nie zmienił się od zapisu.
+	@param[in,out] dict Słownik.
+	@param[in] enable Czy indeks ma być włączony.
+	@return 0 jeśli się udało, -1 jeśli zabrakło pamięci.
+*/
+int dictionary_index(struct dictionary *dict, bool enable);
+
+/**
+	Algorytm wyszukiwania podpowiedzi.
+	Algorytmy według reguł dają te same podpowiedzi, domyślny jest
+	HINTS_BEST_FIRST. Słownik bez reguł zawsze korzysta z HINTS_LEVENSHTEIN.
+*/
+enum hints_engine
+{
+	HINTS_LAYERED,	///< Budowanie kolejnych warstw stanów o rosnącym koszcie.
+	HINTS_BEST_FIRST,	///< Przeglądanie stanów w kolejności kosztu (A*).
+	/// Słowa w odległości edycyjnej z dictionary_hints_max_distance(), bez reguł.
+	HINTS_LEVENSHTEIN,
+	/// Podział słowa na słowa ze słownika programowaniem dynamicznym,
+	/// dla słownika bez reguł z flagą s to samo co HINTS_BEST_FIRST.
+	HINTS_SEGMENTED
+};
+
+/**
+	Ustawia algorytm wyszukiwania podpowiedzi.
+	@param[in,out] dict Słownik.
+	@param[in] engine Nowy algorytm.
+	@return Zwraca dotychczasowy algorytm.
+*/
+enum hints_engine dictionary_hints_engine(struct dictionary *dict,
+		enum hints_engine engine);
+
 
 /**
    Usuwa wszystkie reguły ze słownika
@@ -176,7 +504,8 @@ enum rule_flag
    bloku na zawartość prawej strony. Lewa albo prawa strona może być
    ciągiem pustym, ale nie obie jednocześnie.
 
-   Koszt oznacza ile kosztuje zastosowanie tej reguły.
+   Koszt oznacza ile kosztuje zastosowanie tej reguły. Reguły o koszcie
+   niedodatnim są odrzucane.
 
    Ewentualna flaga może ograniczać zastosowanie reguły. Możliwe flagi to:
 
@@ -87,92 +87,99 @@ void dictionary_free_test(void **state)
 	dictionary_free(dict);
 }
 
-/// Tworzy środowisko do pomocniczych funckji hints.
-int word_setup(void **state)
-{
-	wchar_t *word = malloc (sizeof(wchar_t) * (wcslen(L"dictionary") + 1));
-	if (!word)
-		return -1;
-	wcscpy(word, L"dictionary");
-	*state = word;
-	return 0;
-}
-
-/// Niszczy środowisko do pomocniczych funckji hints.
-int word_teardown(void **state)
-{
-	wchar_t *word = *state;
-	free(word);
-	return 0;
-}
-
-/// Sprawdza 3 możliwe przypadki usuwania: początek, środek, koniec.
-void remove_char_test(void **state)
-{
-	wchar_t *word = *state;
-	remove_char(word, 1);
-	assert_int_equal(wcscmp(word, L"dctionary"), 0);
-	remove_char(word, 0);
-	assert_int_equal(wcscmp(word, L"ctionary"), 0);
-	remove_char(word, wcslen(word) - 1);
-	assert_int_equal(wcscmp(word, L"ctionar"), 0);
-}
-
-/// Sprawdza poprawność wywołania hints_by_delete. Patrz remove_char_test.
+/// Sprawdza podpowiedzi przez usunięcie litery.
 void hints_by_delete_test(void **state)
 {
 	struct dictionary *dict = *state;
 	struct word_list list;
 	word_list_init(&list);
-	hints_by_delete(dict, test, &list);
-	assert_int_equal(word_list_size(&list), 0);
-	dictionary_insert(dict, L"tes");
-	hints_by_delete(dict, test, &list);
+	hints_by_distance(dict, test, &list, arena_thread(), NULL);
 	assert_int_equal(word_list_size(&list), 1);
+	dictionary_insert(dict, L"tes");
+	word_list_done(&list);
+	word_list_init(&list);
+	hints_by_distance(dict, test, &list, arena_thread(), NULL);
+	assert_int_equal(word_list_size(&list), 2);
 	assert_int_equal(wcscmp(word_list_get(&list)[0], L"tes"), 0);
 	word_list_done(&list);
 }
 
-/// Sprawdza poprawność wywyołania hints_by_replace.
+/// Sprawdza podpowiedzi przez zamianę litery.
 void hints_by_replace_test(void **state)
 {
 	struct dictionary *dict =  *state;
 	struct word_list list;
 	word_list_init(&list);
-	hints_by_replace(dict, test, &list);
+	hints_by_distance(dict, test, &list, arena_thread(), NULL);
 	assert_int_equal(word_list_size(&list), 1);
 	dictionary_insert(dict, L"tess");
-	hints_by_replace(dict, test, &list);
+	hints_by_distance(dict, test, &list, arena_thread(), NULL);
 	assert_int_equal(word_list_size(&list), 2);
 	assert_int_equal(wcscmp(word_list_get(&list)[0], L"tess"), 0);
 	word_list_done(&list);
 }
 
-/// Sprawdza 3 przypdaki dodania litery: początek, środek, koniec.
-void append_test(void **state)
-{
-	wchar_t *word = malloc (sizeof(wchar_t) * (wcslen(L"dictionary") + 2));
-	wcscpy(word, L"dictionary");
-	append(word, L"a", 0);
-	assert_true(wcslen(word) == wcslen(L"adictionary"));
-	wcscpy(word, L"dictionary");
-	append(word, L"a", wcslen(L"dictionary"));
-	assert_true(wcscmp(word, L"dictionarya") == 0);
-	wcscpy(word, L"dictionary");
-	append(word, L"a", 4);
-	assert_true(wcscmp(word, L"dictaionary") == 0);
-	free(word);
-}
-
-/// Sprawdza poprawność wywołania hints_by_add. Patrz append_test.
+/// Sprawdza podpowiedzi przez dodanie litery.
 void hints_by_add_test(void **state)
 {
 	struct dictionary *dict = *state;
 	assert_non_null(dict);
 	struct word_list list;
 	word_list_init(&list);
-	hints_by_add(dict, second, &list);
+	hints_by_distance(dict, second, &list, arena_thread(), NULL);
+	assert_int_equal(word_list_size(&list), 1);
+	word_list_done(&list);
+}
+
+/// Sprawdza podpowiedzi w większej odległości edycyjnej.
+void hints_by_distance_test(void **state)
+{
+	struct dictionary *dict = *state;
+	struct word_list list;
+	dictionary_hints(dict, L"tst", &list);
 	assert_int_equal(word_list_size(&list), 1);
+	assert_int_equal(wcscmp(word_list_get(&list)[0], test), 0);
+	word_list_done(&list);
+	assert_int_equal(dictionary_hints_max_distance(dict, 2), 1);
+	dictionary_hints(dict, L"tst", &list);
+	assert_int_equal(word_list_size(&list), 2);
+	assert_int_equal(wcscmp(word_list_get(&list)[0], forth), 0);
+	assert_int_equal(wcscmp(word_list_get(&list)[1], test), 0);
+	word_list_done(&list);
+	// Z regułami ten algorytm trzeba wybrać jawnie.
+	dictionary_rule_add(dict, L"0", L"", false, 1, RULE_NORMAL);
+	dictionary_hints_engine(dict, HINTS_LEVENSHTEIN);
+	dictionary_hints(dict, L"tst", &list);
+	assert_int_equal(word_list_size(&list), 2);
+	word_list_done(&list);
+}
+
+/// Sprawdza podpowiedzi z indeksu usunięć liter i jego aktualizację.
+void dictionary_index_test(void **state)
+{
+	struct dictionary *dict = *state;
+	struct word_list list;
+	struct dictionary_stats stats;
+	assert_int_equal(dictionary_index(dict, true), 0);
+	dictionary_stats(dict, &stats);
+	assert_true(stats.index_bytes > 0);
+	dictionary_hints_max_distance(dict, 2);
+	dictionary_hints(dict, L"tst", &list);
+	assert_int_equal(word_list_size(&list), 2);
+	assert_int_equal(wcscmp(word_list_get(&list)[0], forth), 0);
+	assert_int_equal(wcscmp(word_list_get(&list)[1], test), 0);
+	word_list_done(&list);
+	dictionary_insert(dict, L"tast");
+	dictionary_delete(dict, test);
+	dictionary_hints(dict, L"tst", &list);
+	assert_int_equal(word_list_size(&list), 2);
+	assert_int_equal(wcscmp(word_list_get(&list)[1], L"tast"), 0);
+	word_list_done(&list);
+	assert_int_equal(dictionary_index(dict, false), 0);
+	dictionary_stats(dict, &stats);
+	assert_int_equal(stats.index_bytes, 0);
+	dictionary_hints(dict, L"tst", &list);
+	assert_int_equal(word_list_size(&list), 2);
 	word_list_done(&list);
 }
 
@@ -337,23 +344,512 @@ void dictionary_hints_test(void **state)
 	*state = dict;
 }
 
+/// Sprawdza podpowiedzi wyznaczane według reguł słownika.
+void dictionary_rule_hints_test(void **state)
+{
+	struct dictionary *dict = dictionary_new();
+	struct word_list list;
+	dictionary_insert(dict, L"ala");
+	dictionary_insert(dict, L"ma");
+	dictionary_insert(dict, L"kot");
+	dictionary_insert(dict, L"kota");
+	assert_int_equal(dictionary_rule_add(dict, L"00", L"0", false, 1, RULE_NORMAL), 1);
+	assert_int_equal(dictionary_rule_add(dict, L"", L"", false, 1, RULE_SPLIT), 1);
+	assert_true(dictionary_rule_add(dict, L"0", L"", false, 0, RULE_NORMAL) < 0);
+	dictionary_hints(dict, L"kkot", &list);
+	assert_int_equal(word_list_size(&list), 1);
+	assert_int_equal(wcscmp(word_list_get(&list)[0], L"kot"), 0);
+	word_list_done(&list);
+	dictionary_hints(dict, L"kotta", &list);
+	assert_int_equal(word_list_size(&list), 1);
+	assert_int_equal(wcscmp(word_list_get(&list)[0], L"kota"), 0);
+	word_list_done(&list);
+	// Zmienna 0 musi oznaczać dwa razy tę samą literę.
+	dictionary_hints(dict, L"kotka", &list);
+	assert_int_equal(word_list_size(&list), 0);
+	word_list_done(&list);
+	dictionary_hints(dict, L"alama", &list);
+	assert_int_equal(word_list_size(&list), 1);
+	assert_int_equal(wcscmp(word_list_get(&list)[0], L"ala ma"), 0);
+	word_list_done(&list);
+	assert_int_equal(dictionary_rule_add(dict, L"0", L"1", false, 1, RULE_NORMAL), 1);
+	assert_int_equal(dictionary_hints_max_cost(dict, 1), 6);
+	dictionary_hints(dict, L"kotx", &list);
+	assert_int_equal(word_list_size(&list), 1);
+	assert_int_equal(wcscmp(word_list_get(&list)[0], L"kota"), 0);
+	word_list_done(&list);
+	dictionary_rule_clear(dict);
+	dictionary_hints(dict, L"kotx", &list);
+	assert_int_equal(word_list_size(&list), 2);
+	assert_int_equal(wcscmp(word_list_get(&list)[0], L"kot"), 0);
+	assert_int_equal(wcscmp(word_list_get(&list)[1], L"kota"), 0);
+	word_list_done(&list);
+	dictionary_done(dict);
+}
+
+/// Sprawdza reguły, w których stronach litery przeplatają się ze zmiennymi.
+void dictionary_rule_program_test(void **state)
+{
+	struct dictionary *dict = dictionary_new();
+	struct word_list list;
+	dictionary_insert(dict, L"kot");
+	dictionary_insert(dict, L"tok");
+	dictionary_insert(dict, L"koc");
+	assert_int_equal(dictionary_rule_add(dict, L"k0t", L"t0k", false, 1, RULE_NORMAL), 1);
+	dictionary_hints(dict, L"kot", &list);
+	assert_int_equal(word_list_size(&list), 2);
+	assert_int_equal(wcscmp(word_list_get(&list)[0], L"kot"), 0);
+	assert_int_equal(wcscmp(word_list_get(&list)[1], L"tok"), 0);
+	word_list_done(&list);
+	// Litery między zmiennymi muszą się zgadzać.
+	dictionary_hints(dict, L"kox", &list);
+	assert_int_equal(word_list_size(&list), 0);
+	word_list_done(&list);
+	assert_int_equal(dictionary_rule_add(dict, L"0o1", L"1o0", false, 1, RULE_NORMAL), 1);
+	dictionary_hints(dict, L"cok", &list);
+	assert_int_equal(word_list_size(&list), 1);
+	assert_int_equal(wcscmp(word_list_get(&list)[0], L"koc"), 0);
+	word_list_done(&list);
+	dictionary_hints(dict, L"cxk", &list);
+	assert_int_equal(word_list_size(&list), 0);
+	word_list_done(&list);
+	dictionary_done(dict);
+}
+
+/// Sprawdza przerywanie wyszukiwania podpowiedzi po przekroczeniu ograniczeń.
+void dictionary_hints_limited_test(void **state)
+{
+	const wchar_t *words[] = { L"ala", L"ma", L"kot", L"kota", L"kotka", L"koty" };
+	const enum hints_engine engines[] = { HINTS_LAYERED, HINTS_BEST_FIRST, HINTS_LEVENSHTEIN,
+		HINTS_SEGMENTED };
+	struct dictionary *dict = dictionary_new();
+	struct word_list full, list;
+	for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+		dictionary_insert(dict, words[i]);
+	dictionary_rule_add(dict, L"0", L"1", false, 1, RULE_NORMAL);
+	dictionary_rule_add(dict, L"0", L"", true, 1, RULE_NORMAL);
+	dictionary_rule_add(dict, L"01", L"10", false, 1, RULE_NORMAL);
+	dictionary_rule_add(dict, L"", L"", false, 1, RULE_SPLIT);
+	dictionary_hints_max_cost(dict, 3);
+	for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++)
+	{
+		struct hints_limits limits = { 0, 0, 0 };
+		dictionary_hints_engine(dict, engines[i]);
+		dictionary_hints(dict, L"kotx", &full);
+		assert_int_equal(dictionary_hints_limited(dict, L"kotx", NULL, &list),
+				HINTS_COMPLETE);
+		assert_int_equal(word_list_size(&list), word_list_size(&full));
+		word_list_done(&list);
+		assert_int_equal(dictionary_hints_limited(dict, L"kotx", &limits, &list),
+				HINTS_COMPLETE);
+		assert_int_equal(word_list_size(&list), word_list_size(&full));
+		for (size_t j = 0; j < word_list_size(&full); j++)
+			assert_int_equal(wcscmp(word_list_get(&list)[j], word_list_get(&full)[j]), 0);
+		word_list_done(&list);
+		word_list_done(&full);
+		limits.max_states = 1;
+		assert_int_equal(dictionary_hints_limited(dict, L"kotx", &limits, &list),
+				HINTS_STATE_LIMIT);
+		word_list_done(&list);
+		if (engines[i] == HINTS_LEVENSHTEIN)
+			continue;
+		limits.max_states = 0;
+		limits.max_bytes = 1;
+		assert_int_equal(dictionary_hints_limited(dict, L"kotx", &limits, &list),
+				HINTS_MEMORY_LIMIT);
+		word_list_done(&list);
+		limits.max_bytes = 0;
+		limits.time_us = 1;
+		assert_int_equal(dictionary_hints_limited(dict, L"kotkakotkakotka", &limits,
+				&list), HINTS_TIMEOUT);
+		word_list_done(&list);
+	}
+	// Podpowiedzi znalezione przed przerwaniem są zwracane.
+	struct hints_limits limits = { 0, 1, 0 };
+	dictionary_hints_engine(dict, HINTS_LAYERED);
+	assert_int_equal(dictionary_hints_limited(dict, L"kot", &limits, &list),
+			HINTS_STATE_LIMIT);
+	assert_int_equal(word_list_size(&list), 1);
+	assert_int_equal(wcscmp(word_list_get(&list)[0], L"kot"), 0);
+	word_list_done(&list);
+	// Bez słownika lista jest pusta, ale zainicjowana.
+	assert_int_equal(dictionary_hints_limited(NULL, L"kot", NULL, &list),
+			HINTS_COMPLETE);
+	assert_int_equal(word_list_size(&list), 0);
+	word_list_done(&list);
+	dictionary_done(dict);
+}
+
+/// Sprawdza, czy algorytmy best-first i z podziałem słowa dają te same
+/// podpowiedzi co warstwowy.
+void dictionary_hints_engine_test(void **state)
+{
+	const wchar_t *words[] = { L"ala", L"ma", L"kot", L"kota", L"kotka", L"koty" };
+	const wchar_t *queries[] = { L"kkot", L"kotta", L"alama", L"kotx", L"otak", L"x",
+		L"alamakota", L"kotkota" };
+	struct dictionary *dict = dictionary_new();
+	struct word_list layered, best_first, segmented;
+	for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+		dictionary_insert(dict, words[i]);
+	dictionary_rule_add(dict, L"0", L"1", false, 1, RULE_NORMAL);
+	dictionary_rule_add(dict, L"0", L"", true, 1, RULE_NORMAL);
+	dictionary_rule_add(dict, L"01", L"10", false, 1, RULE_NORMAL);
+	dictionary_rule_add(dict, L"", L"", false, 1, RULE_SPLIT);
+	dictionary_hints_max_cost(dict, 3);
+	assert_int_equal(dictionary_hints_engine(dict, HINTS_LAYERED), HINTS_BEST_FIRST);
+	for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++)
+	{
+		dictionary_hints_engine(dict, HINTS_LAYERED);
+		dictionary_hints(dict, queries[i], &layered);
+		assert_int_equal(dictionary_hints_engine(dict, HINTS_BEST_FIRST), HINTS_LAYERED);
+		dictionary_hints(dict, queries[i], &best_first);
+		assert_true(word_list_size(&layered) > 0);
+		assert_int_equal(word_list_size(&best_first), word_list_size(&layered));
+		for (size_t j = 0; j < word_list_size(&layered); j++)
+			assert_int_equal(wcscmp(word_list_get(&best_first)[j],
+					word_list_get(&layered)[j]), 0);
+		dictionary_hints_engine(dict, HINTS_SEGMENTED);
+		dictionary_hints(dict, queries[i], &segmented);
+		assert_int_equal(word_list_size(&segmented), word_list_size(&layered));
+		for (size_t j = 0; j < word_list_size(&layered); j++)
+			assert_int_equal(wcscmp(word_list_get(&segmented)[j],
+					word_list_get(&layered)[j]), 0);
+		word_list_done(&layered);
+		word_list_done(&best_first);
+		word_list_done(&segmented);
+	}
+	dictionary_done(dict);
+}
+
+/// Sprawdza podpowiedzi dla reguł pasujących tylko w kilku miejscach słowa,
+/// gdy rozwinięcie pomija stany, do których nie pasuje żadna reguła.
+void dictionary_hints_sparse_rules_test(void **state)
+{
+	const wchar_t *words[] = { L"przyrzeczenie", L"chrząszcz", L"góra", L"gór" };
+	const wchar_t *queries[] = { L"przyżeczenie", L"hżąszcz", L"gura", L"góra" };
+	const wchar_t *hints[] = { L"przyrzeczenie", L"chrząszcz", L"góra", L"góra" };
+	struct dictionary *dict = dictionary_new();
+	struct word_list list;
+	for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+		dictionary_insert(dict, words[i]);
+	dictionary_rule_add(dict, L"ż", L"rz", false, 1, RULE_NORMAL);
+	dictionary_rule_add(dict, L"u", L"ó", false, 1, RULE_NORMAL);
+	dictionary_rule_add(dict, L"h", L"ch", false, 1, RULE_NORMAL);
+	dictionary_hints_max_cost(dict, 2);
+	for (int engine = HINTS_LAYERED; engine <= HINTS_BEST_FIRST; engine++)
+	{
+		dictionary_hints_engine(dict, engine);
+		for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++)
+		{
+			dictionary_hints(dict, queries[i], &list);
+			assert_int_equal(word_list_size(&list), 1);
+			assert_int_equal(wcscmp(word_list_get(&list)[0], hints[i]), 0);
+			word_list_done(&list);
+		}
+	}
+	dictionary_done(dict);
+}
+
+/**
+	Sprawdza, czy sesja podpowiada to samo co dictionary_hints().
+	@param[in,out] session Sesja.
+	@param[in] dict Słownik sesji.
+ */
+static void check_session_hints(struct hints_session *session,
+		const struct dictionary *dict)
+{
+	struct word_list incremental, full;
+	hints_session_hints(session, &incremental);
+	dictionary_hints(dict, hints_session_word(session), &full);
+	assert_int_equal(word_list_size(&incremental), word_list_size(&full));
+	for (size_t i = 0; i < word_list_size(&full); i++)
+		assert_int_equal(wcscmp(word_list_get(&incremental)[i],
+				word_list_get(&full)[i]), 0);
+	word_list_done(&incremental);
+	word_list_done(&full);
+}
+
+/// Sprawdza sesję podpowiedzi dla słowa wpisywanego znak po znaku.
+void dictionary_hints_session_test(void **state)
+{
+	const wchar_t *words[] = { L"ala", L"ma", L"kot", L"kota", L"kotka", L"koty",
+			L"góra", L"chrząszcz" };
+	const wchar_t *queries[] = { L"alamakota", L"kkota", L"gura", L"hżąszcz", L"otak" };
+	struct dictionary *dict = dictionary_new();
+	for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+		dictionary_insert(dict, words[i]);
+	// Bez reguł sesja wyszukuje podpowiedzi od nowa.
+	struct hints_session *session = hints_session_new(dict);
+	assert_non_null(session);
+	assert_int_equal(hints_session_pop_char(session), -1);
+	hints_session_push_char(session, L'k');
+	hints_session_push_char(session, L'o');
+	check_session_hints(session, dict);
+	hints_session_done(session);
+	dictionary_rule_add(dict, L"0", L"1", false, 1, RULE_NORMAL);
+	dictionary_rule_add(dict, L"01", L"10", false, 1, RULE_NORMAL);
+	dictionary_rule_add(dict, L"", L"", false, 1, RULE_SPLIT);
+	dictionary_rule_add(dict, L"ż", L"rz", false, 1, RULE_NORMAL);
+	dictionary_rule_add(dict, L"h", L"ch", false, 1, RULE_BEGIN);
+	dictionary_rule_add(dict, L"0", L"", false, 1, RULE_END);
+	dictionary_rule_add(dict, L"", L"a", false, 1, RULE_END);
+	dictionary_hints_max_cost(dict, 2);
+	for (int engine = HINTS_LAYERED; engine <= HINTS_BEST_FIRST; engine++)
+	{
+		dictionary_hints_engine(dict, engine);
+		session = hints_session_new(dict);
+		assert_non_null(session);
+		for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++)
+		{
+			for (const wchar_t *ch = queries[i]; *ch != L'\0'; ch++)
+			{
+				assert_int_equal(hints_session_push_char(session, *ch), 0);
+				check_session_hints(session, dict);
+			}
+			// Po usunięciu znaku i dopisaniu innego słowo jest poprawione.
+			assert_int_equal(hints_session_pop_char(session), 0);
+			check_session_hints(session, dict);
+			hints_session_push_char(session, L'x');
+			check_session_hints(session, dict);
+			hints_session_clear(session);
+			assert_int_equal(wcslen(hints_session_word(session)), 0);
+		}
+		hints_session_done(session);
+	}
+	dictionary_done(dict);
+}
+
+/// Sprawdza, czy stany zbierane w wielu wątkach dają te same podpowiedzi.
+void dictionary_hints_threads_test(void **state)
+{
+	const wchar_t *words[] = { L"ala", L"ma", L"kot", L"kota", L"kotka", L"koty" };
+	const wchar_t *queries[] = { L"kkot", L"kotta", L"alama", L"kotx", L"otak", L"x" };
+	struct dictionary *dict = dictionary_new();
+	struct word_list single, parallel;
+	for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+		dictionary_insert(dict, words[i]);
+	dictionary_rule_add(dict, L"0", L"1", false, 1, RULE_NORMAL);
+	dictionary_rule_add(dict, L"0", L"", true, 1, RULE_NORMAL);
+	dictionary_rule_add(dict, L"01", L"10", false, 2, RULE_NORMAL);
+	dictionary_rule_add(dict, L"", L"", false, 1, RULE_SPLIT);
+	dictionary_hints_max_cost(dict, 4);
+	dictionary_hints_engine(dict, HINTS_LAYERED);
+	// Każda warstwa jest zbierana w wielu wątkach.
+	dict->parallel_states = 0;
+	for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++)
+	{
+		dictionary_hints_threads(dict, 1);
+		dictionary_hints(dict, queries[i], &single);
+		assert_int_equal(dictionary_hints_threads(dict, 4), 1);
+		dictionary_hints(dict, queries[i], &parallel);
+		assert_true(word_list_size(&single) > 0);
+		assert_int_equal(word_list_size(&parallel), word_list_size(&single));
+		for (size_t j = 0; j < word_list_size(&single); j++)
+			assert_int_equal(wcscmp(word_list_get(&parallel)[j],
+					word_list_get(&single)[j]), 0);
+		word_list_done(&single);
+		word_list_done(&parallel);
+	}
+	dictionary_done(dict);
+}
+
+/// Sprawdza, czy podpowiedzi dla wielu słów, także powtórzonych, są takie same
+/// jak dla pojedynczych, w obu porządkach.
+void dictionary_hints_batch_test(void **state)
+{
+	const wchar_t *words[] = { L"ala", L"ma", L"kot", L"kota", L"kotka", L"koty" };
+	// Podpowiedzi "kotta" od najlepszej nie są w porządku alfabetycznym.
+	const wchar_t *queries[] = { L"kkot", L"kotta", L"kkot", L"x", L"kotta", L"otak",
+			L"kkot" };
+	size_t n = sizeof(queries) / sizeof(queries[0]);
+	struct dictionary *dict = dictionary_new();
+	struct word_list single, lists[n];
+	for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+		dictionary_insert(dict, words[i]);
+	dictionary_rule_add(dict, L"0", L"1", false, 1, RULE_NORMAL);
+	dictionary_rule_add(dict, L"0", L"", true, 1, RULE_NORMAL);
+	dictionary_rule_add(dict, L"", L"", false, 1, RULE_SPLIT);
+	dictionary_hints_max_cost(dict, 2);
+	for (int threads = 1; threads <= 4; threads += 3)
+	{
+		dictionary_hints_threads(dict, threads);
+		assert_int_equal(dictionary_hints_batch(dict, queries, n, lists), 0);
+		for (size_t i = 0; i < n; i++)
+		{
+			dictionary_hints(dict, queries[i], &single);
+			assert_int_equal(word_list_size(&lists[i]), word_list_size(&single));
+			for (size_t j = 0; j < word_list_size(&single); j++)
+			{
+				assert_int_equal(wcscmp(word_list_get(&lists[i])[j],
+						word_list_get(&single)[j]), 0);
+				assert_int_equal(wcscmp(word_list_ranked(&lists[i])[j],
+						word_list_ranked(&single)[j]), 0);
+			}
+			word_list_done(&single);
+			word_list_done(&lists[i]);
+		}
+	}
+	assert_int_equal(dictionary_hints_batch(dict, queries, 0, lists), 0);
+	dictionary_done(dict);
+}
+
+/**
+	Sprawdza, czy spośród podpowiedzi słowa "aa" w słowniku z 25 słowami
+	"aaa", ..., "aay" wybrano najczęstsze "aay" i 19 pierwszych alfabetycznie,
+	a od najlepszej pierwsza jest "aay".
+	@param[in] dict Słownik.
+ */
+static void check_frequency_hints(const struct dictionary *dict)
+{
+	struct word_list list;
+	dictionary_hints(dict, L"aa", &list);
+	assert_int_equal(word_list_size(&list), DICTIONARY_MAX_HINTS);
+	assert_int_equal(wcscmp(word_list_get(&list)[0], L"aaa"), 0);
+	assert_int_equal(wcscmp(word_list_get(&list)[DICTIONARY_MAX_HINTS - 2], L"aas"), 0);
+	assert_int_equal(wcscmp(word_list_get(&list)[DICTIONARY_MAX_HINTS - 1], L"aay"), 0);
+	assert_int_equal(wcscmp(word_list_ranked(&list)[0], L"aay"), 0);
+	assert_int_equal(wcscmp(word_list_ranked(&list)[1], L"aaa"), 0);
+	assert_int_equal(wcscmp(word_list_ranked(&list)[DICTIONARY_MAX_HINTS - 1], L"aas"), 0);
+	word_list_done(&list);
+}
+
+/// Sprawdza częstości słów i wybór podpowiedzi według częstości.
+void dictionary_frequency_test(void **state)
+{
+	struct dictionary *dict = dictionary_new();
+	wchar_t word[] = L"aa?";
+	for (wchar_t c = L'a'; c <= L'y'; c++)
+	{
+		word[2] = c;
+		dictionary_insert(dict, word);
+	}
+	assert_int_equal(dictionary_frequency(dict, L"aab"), DEFAULT_FREQUENCY);
+	assert_int_equal(dictionary_frequency(dict, L"aa"), 0);
+	assert_int_equal(dictionary_set_frequency(dict, L"aay", 100), 1);
+	assert_int_equal(dictionary_set_frequency(dict, L"aa", 100), 0);
+	assert_int_equal(dictionary_frequency(dict, L"aay"), 100);
+	check_frequency_hints(dict);
+	assert_int_equal(dictionary_index(dict, true), 0);
+	check_frequency_hints(dict);
+	dictionary_index(dict, false);
+	dictionary_rule_add(dict, L"", L"0", false, 1, RULE_NORMAL);
+	dictionary_hints_engine(dict, HINTS_LAYERED);
+	check_frequency_hints(dict);
+	dictionary_hints_engine(dict, HINTS_BEST_FIRST);
+	check_frequency_hints(dict);
+
+	char path[] = "/tmp/dict_frequency_testXXXXXX";
+	int fd = mkstemp(path);
+	assert_true(fd >= 0);
+	FILE *fp = fdopen(fd, "w");
+	assert_int_equal(dictionary_save_parallel(dict, fp, true), 0);
+	fclose(fp);
+	struct dictionary *loaded = dictionary_load_file(path);
+	assert_non_null(loaded);
+	assert_int_equal(dictionary_frequency(loaded, L"aay"), 100);
+	assert_int_equal(dictionary_frequency(loaded, L"aab"), DEFAULT_FREQUENCY);
+	check_frequency_hints(loaded);
+	dictionary_done(loaded);
+
+	fp = fopen(path, "w");
+	fputs("kot 5\nKot\t2\npies 10 \nlis 3x\nsowa 1 2\n", fp);
+	fclose(fp);
+	loaded = dictionary_import(path);
+	unlink(path);
+	assert_non_null(loaded);
+	assert_int_equal(dictionary_frequency(loaded, L"kot"), 7);
+	assert_int_equal(dictionary_frequency(loaded, L"pies"), 10);
+	assert_false(dictionary_find(loaded, L"lis"));
+	assert_false(dictionary_find(loaded, L"sowa"));
+	dictionary_done(loaded);
+	dictionary_done(dict);
+}
+
+/// Sprawdza, czy słownik odtworzony z obrazu zawiera te same słowa.
+void dict_image_test(void **state)
+{
+	struct dictionary *dict = *state;
+	struct dict_image_key key = { 1, 2, 3, dict_image_hash("abc", 3),
+			dict_image_collation() };
+	struct dict_image_key read_key;
+	char path[] = "/tmp/dict_image_testXXXXXX";
+	int fd = mkstemp(path);
+	assert_true(fd >= 0);
+	FILE *fp = fdopen(fd, "wb");
+	dictionary_set_frequency(dict, test, 42);
+	assert_int_equal(dict_image_save(dict->root, dict->alphabet, &key, fp), 0);
+	fclose(fp);
+	assert_int_equal(dict_image_key_read(path, &read_key), 0);
+	assert_int_equal(read_key.size, key.size);
+	assert_int_equal(read_key.hash, key.hash);
+	assert_int_equal(read_key.collation, key.collation);
+	struct dictionary *loaded = dictionary_new();
+	assert_int_equal(dict_image_load(loaded->root, loaded->alphabet, path), 0);
+	assert_int_equal(size(loaded->alphabet), size(dict->alphabet));
+	assert_true(dictionary_find(loaded, test));
+	assert_true(dictionary_find(loaded, third));
+	assert_true(dictionary_find(loaded, forth));
+	assert_false(dictionary_find(loaded, second));
+	assert_int_equal(dictionary_frequency(loaded, test), 42);
+	assert_int_equal(dictionary_frequency(loaded, forth), DEFAULT_FREQUENCY);
+	dictionary_done(loaded);
+	unlink(path);
+}
+
+/// Testuje import słownika z listy słów.
+void dictionary_import_test(void **state)
+{
+	char path[] = "/tmp/dict_import_testXXXXXX";
+	int fd = mkstemp(path);
+	assert_true(fd >= 0);
+	FILE *fp = fdopen(fd, "w");
+	fputs("tester\ncat\n  Test\r\ntes7\n\nabrakadabra\ncat\ntest\n", fp);
+	fclose(fp);
+	struct dictionary *dict = dictionary_import(path);
+	unlink(path);
+	assert_non_null(dict);
+	assert_true(dictionary_find(dict, test));
+	assert_true(dictionary_find(dict, first));
+	assert_true(dictionary_find(dict, third));
+	assert_true(dictionary_find(dict, forth));
+	assert_false(dictionary_find(dict, second));
+	assert_int_equal(size(dict->alphabet), 9);
+	assert_int_equal(at_pos(dict->alphabet, 0)->symbol, L'a');
+	assert_int_equal(at_pos(dict->alphabet, 8)->symbol, L't');
+	assert_true(dictionary_insert(dict, fifth));
+	assert_true(dictionary_find(dict, fifth));
+	dictionary_done(dict);
+	assert_null(dictionary_import("/nonexistent/dict_import_test"));
+}
+
 /// Wywołuje testów.
 int main(void)
 {
 	const struct CMUnitTest tests[] = {
 		cmocka_unit_test(dictionary_free_test),
-		cmocka_unit_test(append_test),
 		cmocka_unit_test(dictionary_new_test),
 		cmocka_unit_test(dictionary_load_test),
-		cmocka_unit_test_setup_teardown(remove_char_test, word_setup, word_teardown),
 		cmocka_unit_test_setup_teardown(hints_by_delete_test, dictionary_setup, dictionary_teardown),
 		cmocka_unit_test_setup_teardown(hints_by_replace_test, dictionary_setup, dictionary_teardown),
 		cmocka_unit_test_setup_teardown(hints_by_add_test, dictionary_setup, dictionary_teardown),
+		cmocka_unit_test_setup_teardown(hints_by_distance_test, dictionary_setup, dictionary_teardown),
+		cmocka_unit_test_setup_teardown(dictionary_index_test, dictionary_setup, dictionary_teardown),
 		cmocka_unit_test_setup_teardown(dictionary_done_test, NULL, NULL),
 		cmocka_unit_test_setup_teardown(dictionary_delete_test, dictionary_setup, dictionary_teardown),
 		cmocka_unit_test_setup_teardown(dictionary_find_test, dictionary_setup, dictionary_teardown),
 		cmocka_unit_test_setup_teardown(dictionary_hints_test, dictionary_setup, dictionary_teardown),
+		cmocka_unit_test(dictionary_rule_hints_test),
+		cmocka_unit_test(dictionary_rule_program_test),
+		cmocka_unit_test(dictionary_hints_engine_test),
+		cmocka_unit_test(dictionary_hints_limited_test),
+		cmocka_unit_test(dictionary_hints_sparse_rules_test),
+		cmocka_unit_test(dictionary_hints_threads_test),
+		cmocka_unit_test(dictionary_hints_session_test),
+		cmocka_unit_test(dictionary_hints_batch_test),
+		cmocka_unit_test(dictionary_frequency_test),
 		cmocka_unit_test_setup_teardown(dictionary_save_test, dictionary_setup, dictionary_teardown),
+		cmocka_unit_test_setup_teardown(dict_image_test, dictionary_setup, dictionary_teardown),
+		cmocka_unit_test(dictionary_import_test),
 	};
 
 	return cmocka_run_group_tests(tests, NULL, NULL);
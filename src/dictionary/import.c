@@ -0,0 +1,541 @@
+/** @file
+ Implementacja importu słownika z listy słów.
+
+ Import przebiega w kilku krokach:
+ - plik jest mapowany do pamięci i dzielony na części na granicach linii,
+ - w pierwszym przebiegu wątki zbierają litery występujące w swoich częściach,
+ - litery są sortowane (wcscoll), tak jak dzieci węzłów drzewa,
+ - w drugim przebiegu wątki zapisują słowa jako ciągi indeksów liter,
+ - słowa są sortowane sortowaniem pozycyjnym (MSD) i usuwane są powtórzenia.
+
+ Za każdym słowem w buforze wątku, po kończącym je zerze, zapisana jest
+ jego częstość jako dwie liczby 16-bitowe, młodsza połowa pierwsza.
+
+ @ingroup dictionary
+ @author Maja Zalewska <mz336088@students.mimuw.edu.pl>
+ @copyright Uniwerstet Warszawski
+ @date 2015-06-12
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <wctype.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "import.h"
+#include "trie.h"
+
+#define IMPORT_MAX_THREADS	16	///< Maksymalna liczba wątków importu.
+#define IMPORT_MIN_CHUNK	(1 << 20)	///< Minimalna liczba bajtów na wątek.
+#define CHAR_SET_SIZE	64	///< Początkowy rozmiar zbioru liter.
+#define BUFFER_SIZE	64	///< Początkowy rozmiar buforów.
+#define INSERTION_SORT_LIMIT	32	///< Poniżej tej liczby słów sortujemy przez wstawianie.
+#define MAX_LETTERS	UINT16_MAX	///< Limit liczby liter alfabetu.
+
+/// Zbiór liter z przypisanymi indeksami (adresowanie otwarte).
+struct char_set
+{
+	wchar_t *keys;	///< Litery, L'\0' oznacza wolne miejsce.
+	uint16_t *values;	///< Indeksy liter powiększone o 1.
+	size_t size;	///< Liczba liter.
+	size_t capacity;	///< Rozmiar tablic, potęga dwójki.
+};
+
+/// Praca jednego wątku importu.
+struct import_job
+{
+	const char *begin;	///< Początek przetwarzanej części pliku.
+	const char *end;	///< Koniec przetwarzanej części pliku.
+	int pass;	///< Numer przebiegu, 1 lub 2.
+	struct char_set letters;	///< Litery znalezione w pierwszym przebiegu.
+	const struct char_set *alphabet;	///< Indeksy liter w drugim przebiegu.
+	uint16_t *pool;	///< Zapisane słowa.
+	size_t pool_size;	///< Zajęta część bufora pool.
+	size_t pool_capacity;	///< Rozmiar bufora pool.
+	size_t *offsets;	///< Początki słów w pool.
+	size_t count;	///< Liczba słów.
+	size_t offsets_capacity;	///< Rozmiar tablicy offsets.
+	bool failed;	///< Czy zabrakło pamięci.
+};
+
+/** @name Funkcje pomocnicze
+ @{
+ */
+
+/**
+	Inicjuje zbiór liter.
+	@param[in,out] set Zbiór.
+	@param[in] capacity Rozmiar tablic, potęga dwójki.
+ */
+static void char_set_init(struct char_set *set, size_t capacity)
+{
+	set->keys = calloc(capacity, sizeof(wchar_t));
+	set->values = calloc(capacity, sizeof(uint16_t));
+	set->size = 0;
+	set->capacity = capacity;
+}
+
+/**
+	Zwalnia pamięć zbioru liter.
+	@param[in,out] set Zbiór.
+ */
+static void char_set_done(struct char_set *set)
+{
+	free(set->keys);
+	free(set->values);
+	set->keys = NULL;
+	set->values = NULL;
+	set->size = 0;
+	set->capacity = 0;
+}
+
+/**
+	Zwraca pozycję litery w tablicach zbioru.
+	@param[in] set Zbiór.
+	@param[in] c Litera.
+	@return Pozycja litery albo wolnego miejsca, gdzie powinna się znaleźć.
+ */
+static size_t char_set_find(const struct char_set *set, wchar_t c)
+{
+	size_t mask = set->capacity - 1;
+	size_t pos = ((uint32_t) c * 2654435761u) & mask;
+	while (set->keys[pos] != L'\0' && set->keys[pos] != c)
+		pos = (pos + 1) & mask;
+	return pos;
+}
+
+/**
+	Dodaje literę do zbioru.
+	@param[in,out] set Zbiór.
+	@param[in] c Litera.
+	@param[in] value Indeks litery.
+ */
+static void char_set_add(struct char_set *set, wchar_t c, uint16_t value)
+{
+	if (2 * (set->size + 1) > set->capacity)
+	{
+		struct char_set bigger;
+		char_set_init(&bigger, 2 * set->capacity);
+		for (size_t i = 0; i < set->capacity; i++)
+			if (set->keys[i] != L'\0')
+				char_set_add(&bigger, set->keys[i], set->values[i]);
+		char_set_done(set);
+		*set = bigger;
+	}
+	size_t pos = char_set_find(set, c);
+	if (set->keys[pos] == L'\0')
+	{
+		set->keys[pos] = c;
+		set->size++;
+	}
+	set->values[pos] = value;
+}
+
+/**
+	Zwraca indeks litery.
+	@param[in] set Zbiór.
+	@param[in] c Litera.
+	@return Indeks litery powiększony o 1, 0 jeśli litery nie ma w zbiorze.
+ */
+static uint16_t char_set_get(const struct char_set *set, wchar_t c)
+{
+	size_t pos = char_set_find(set, c);
+	return set->keys[pos] == c ? set->values[pos] : 0;
+}
+
+/**
+	Wczytuje słowo z kolejnej linii.
+	Pomija białe znaki na początku i końcu linii, zamienia litery na małe.
+	Za słowem może być oddzielona białymi znakami częstość słowa.
+	@param[in,out] text Początek linii, przesuwany za jej koniec.
+	@param[in] end Koniec przetwarzanej części pliku.
+	@param[in,out] buf Bufor na słowo.
+	@param[in,out] capacity Rozmiar bufora.
+	@param[out] frequency Częstość słowa, DEFAULT_FREQUENCY jeśli jej nie podano.
+	@return Długość słowa, 0 jeśli linia nie zawiera poprawnego słowa.
+ */
+static size_t read_word(const char **text, const char *end, wchar_t **buf,
+		size_t *capacity, uint32_t *frequency)
+{
+	const char *line = *text;
+	const char *line_end = memchr(line, '\n', end - line);
+	if (line_end == NULL)
+		line_end = end;
+	*text = line_end < end ? line_end + 1 : end;
+	mbstate_t ps;
+	memset(&ps, 0, sizeof(ps));
+	size_t len = 0;
+	bool trailing = false;
+	bool digits = false;
+	bool done = false;
+	*frequency = DEFAULT_FREQUENCY;
+	while (line < line_end)
+	{
+		wchar_t c;
+		size_t bytes = mbrtowc(&c, line, line_end - line, &ps);
+		if (bytes == 0 || bytes == (size_t) -1 || bytes == (size_t) -2)
+			return 0;
+		line += bytes;
+		if (iswspace(c))
+		{
+			trailing = len > 0;
+			done = digits;
+			continue;
+		}
+		if (trailing && !done && c >= L'0' && c <= L'9')
+		{
+			// Za duże częstości obcinamy do UINT32_MAX.
+			uint32_t digit = c - L'0';
+			if (!digits)
+				*frequency = 0;
+			digits = true;
+			*frequency = *frequency > (UINT32_MAX - digit) / 10 ? UINT32_MAX
+					: 10 * *frequency + digit;
+			continue;
+		}
+		if (trailing || !iswalpha(c))
+			return 0;
+		if (len + 1 >= *capacity)
+		{
+			*capacity *= 2;
+			*buf = realloc(*buf, sizeof(wchar_t) * *capacity);
+		}
+		(*buf)[len++] = towlower(c);
+	}
+	return len;
+}
+
+/**
+	Dopisuje słowo do bufora wątku.
+	@param[in,out] job Praca wątku.
+	@param[in] word Słowo.
+	@param[in] len Długość słowa.
+	@param[in] frequency Częstość słowa.
+ */
+static void job_add_word(struct import_job *job, const wchar_t *word, size_t len,
+		uint32_t frequency)
+{
+	if (job->pool_size + len + 3 > job->pool_capacity)
+	{
+		size_t capacity = 2 * (job->pool_size + len + 3);
+		uint16_t *pool = realloc(job->pool, sizeof(uint16_t) * capacity);
+		if (pool == NULL)
+		{
+			job->failed = true;
+			return;
+		}
+		job->pool = pool;
+		job->pool_capacity = capacity;
+	}
+	if (job->count == job->offsets_capacity)
+	{
+		size_t capacity = 2 * job->offsets_capacity;
+		size_t *offsets = realloc(job->offsets, sizeof(size_t) * capacity);
+		if (offsets == NULL)
+		{
+			job->failed = true;
+			return;
+		}
+		job->offsets = offsets;
+		job->offsets_capacity = capacity;
+	}
+	job->offsets[job->count++] = job->pool_size;
+	for (size_t i = 0; i < len; i++)
+		job->pool[job->pool_size++] = char_set_get(job->alphabet, word[i]);
+	job->pool[job->pool_size++] = 0;
+	job->pool[job->pool_size++] = (uint16_t) frequency;
+	job->pool[job->pool_size++] = (uint16_t) (frequency >> 16);
+}
+
+/**
+	Odczytuje częstość zapisaną za słowem.
+	@param[in] word Słowo w buforze wątku.
+	@return Częstość słowa.
+ */
+static uint32_t word_frequency(const uint16_t *word)
+{
+	while (*word != 0)
+		word++;
+	return (uint32_t) word[1] | (uint32_t) word[2] << 16;
+}
+
+/**
+	Przetwarza część pliku w jednym przebiegu.
+	@param[in,out] arg Praca wątku, struct import_job.
+	@return NULL.
+ */
+static void *import_worker(void *arg)
+{
+	struct import_job *job = arg;
+	size_t capacity = BUFFER_SIZE;
+	wchar_t *buf = malloc(sizeof(wchar_t) * capacity);
+	const char *text = job->begin;
+	uint32_t frequency;
+	while (text < job->end && !job->failed)
+	{
+		size_t len = read_word(&text, job->end, &buf, &capacity, &frequency);
+		if (len == 0)
+			continue;
+		if (job->pass == 1)
+		{
+			for (size_t i = 0; i < len; i++)
+				if (char_set_get(&job->letters, buf[i]) == 0)
+					char_set_add(&job->letters, buf[i], 1);
+		}
+		else
+			job_add_word(job, buf, len, frequency);
+	}
+	free(buf);
+	return NULL;
+}
+
+/**
+	Wykonuje przebieg importu na wszystkich częściach pliku.
+	@param[in,out] jobs Prace wątków.
+	@param[in] threads Liczba wątków.
+	@param[in] pass Numer przebiegu.
+ */
+static void run_pass(struct import_job *jobs, size_t threads, int pass)
+{
+	pthread_t ids[IMPORT_MAX_THREADS];
+	bool started[IMPORT_MAX_THREADS];
+	for (size_t i = 0; i < threads; i++)
+	{
+		jobs[i].pass = pass;
+		started[i] = i > 0
+				&& pthread_create(&ids[i], NULL, import_worker, &jobs[i]) == 0;
+	}
+	for (size_t i = 0; i < threads; i++)
+		if (!started[i])
+			import_worker(&jobs[i]);
+	for (size_t i = 1; i < threads; i++)
+		if (started[i])
+			pthread_join(ids[i], NULL);
+}
+
+/**
+	Porównuje litery według wcscoll, tak jak vector.
+	@param[in] a Pierwsza litera.
+	@param[in] b Druga litera.
+	@return Wynik porównania jak w wcscoll.
+ */
+static int letter_compare(const void *a, const void *b)
+{
+	wchar_t left[2] = { *(const wchar_t *) a, L'\0' };
+	wchar_t right[2] = { *(const wchar_t *) b, L'\0' };
+	return wcscoll(left, right);
+}
+
+/**
+	Porównuje słowa zapisane jako ciągi indeksów.
+	@param[in] a Pierwsze słowo.
+	@param[in] b Drugie słowo.
+	@return <0, 0, >0 jeśli a jest odpowiednio mniejsze, równe, większe od b.
+ */
+static int word_compare(const uint16_t *a, const uint16_t *b)
+{
+	while (*a != 0 && *a == *b)
+	{
+		a++;
+		b++;
+	}
+	return (int) *a - (int) *b;
+}
+
+/**
+	Sortuje słowa pozycyjnie, zaczynając od litery numer depth.
+	Wszystkie słowa mają jednakowe litery przed pozycją depth.
+	@param[in,out] keys Sortowane słowa.
+	@param[in,out] tmp Bufor pomocniczy tego samego rozmiaru.
+	@param[in] n Liczba słów.
+	@param[in] depth Pozycja litery, według której dzielimy słowa.
+	@param[in] buckets Liczba możliwych wartości litery (z zerem na końcu słowa).
+ */
+static void radix_sort(const uint16_t **keys, const uint16_t **tmp, size_t n,
+		size_t depth, size_t buckets)
+{
+	if (n <= INSERTION_SORT_LIMIT)
+	{
+		for (size_t i = 1; i < n; i++)
+		{
+			const uint16_t *key = keys[i];
+			size_t j = i;
+			while (j > 0 && word_compare(keys[j - 1] + depth, key + depth) > 0)
+			{
+				keys[j] = keys[j - 1];
+				j--;
+			}
+			keys[j] = key;
+		}
+		return;
+	}
+	size_t *start = calloc(buckets + 1, sizeof(size_t));
+	for (size_t i = 0; i < n; i++)
+		start[keys[i][depth] + 1]++;
+	for (size_t b = 1; b <= buckets; b++)
+		start[b] += start[b - 1];
+	size_t *next = malloc(sizeof(size_t) * buckets);
+	memcpy(next, start, sizeof(size_t) * buckets);
+	for (size_t i = 0; i < n; i++)
+		tmp[next[keys[i][depth]]++] = keys[i];
+	memcpy(keys, tmp, sizeof(*keys) * n);
+	free(next);
+	// Kubełek 0 to słowa, które się skończyły, więc są sobie równe.
+	for (size_t b = 1; b < buckets; b++)
+		if (start[b + 1] - start[b] > 1)
+			radix_sort(keys + start[b], tmp + start[b], start[b + 1] - start[b],
+					depth + 1, buckets);
+	free(start);
+}
+
+/// @}
+
+/** @name Elementy interfejsu
+ @{
+ */
+
+int import_word_list(const char *path, struct import_result *result)
+{
+	memset(result, 0, sizeof(*result));
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	if (st.st_size == 0)
+	{
+		close(fd);
+		return 0;
+	}
+	char *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (text == MAP_FAILED)
+		return -1;
+	madvise(text, st.st_size, MADV_SEQUENTIAL);
+	const char *end = text + st.st_size;
+
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t threads = cpus > 0 ? (size_t) cpus : 1;
+	if (threads > IMPORT_MAX_THREADS)
+		threads = IMPORT_MAX_THREADS;
+	if (threads > st.st_size / IMPORT_MIN_CHUNK)
+		threads = st.st_size / IMPORT_MIN_CHUNK > 0 ? st.st_size / IMPORT_MIN_CHUNK : 1;
+	struct import_job *jobs = calloc(threads, sizeof(struct import_job));
+	const char *begin = text;
+	for (size_t i = 0; i < threads; i++)
+	{
+		jobs[i].begin = begin;
+		const char *split = text + st.st_size / threads * (i + 1);
+		if (i + 1 == threads || split <= begin)
+			split = end;
+		else
+		{
+			const char *newline = memchr(split, '\n', end - split);
+			split = newline != NULL ? newline + 1 : end;
+		}
+		jobs[i].end = split;
+		begin = split;
+		char_set_init(&jobs[i].letters, CHAR_SET_SIZE);
+		jobs[i].offsets_capacity = BUFFER_SIZE;
+		jobs[i].offsets = malloc(sizeof(size_t) * BUFFER_SIZE);
+	}
+	run_pass(jobs, threads, 1);
+
+	// Alfabet w kolejności wcscoll, indeksy liter od 1.
+	struct char_set alphabet;
+	char_set_init(&alphabet, CHAR_SET_SIZE);
+	for (size_t i = 0; i < threads; i++)
+	{
+		for (size_t k = 0; k < jobs[i].letters.capacity; k++)
+			if (jobs[i].letters.keys[k] != L'\0')
+				char_set_add(&alphabet, jobs[i].letters.keys[k], 1);
+		char_set_done(&jobs[i].letters);
+	}
+	int status = alphabet.size < MAX_LETTERS ? 0 : -1;
+	result->alphabet = malloc(sizeof(wchar_t) * (alphabet.size + 1));
+	for (size_t k = 0; k < alphabet.capacity; k++)
+		if (alphabet.keys[k] != L'\0')
+			result->alphabet[result->alphabet_size++] = alphabet.keys[k];
+	qsort(result->alphabet, result->alphabet_size, sizeof(wchar_t),
+			letter_compare);
+	for (size_t i = 0; i < result->alphabet_size && status == 0; i++)
+		char_set_add(&alphabet, result->alphabet[i], (uint16_t) (i + 1));
+
+	if (status == 0)
+	{
+		for (size_t i = 0; i < threads; i++)
+			jobs[i].alphabet = &alphabet;
+		run_pass(jobs, threads, 2);
+	}
+	munmap(text, st.st_size);
+	char_set_done(&alphabet);
+
+	size_t total = 0;
+	for (size_t i = 0; i < threads; i++)
+	{
+		total += jobs[i].count;
+		if (jobs[i].failed)
+			status = -1;
+	}
+	result->pools = malloc(sizeof(uint16_t *) * threads);
+	result->words = malloc(sizeof(uint16_t *) * (total + 1));
+	for (size_t i = 0; i < threads; i++)
+	{
+		for (size_t k = 0; k < jobs[i].count; k++)
+			result->words[result->count++] = jobs[i].pool + jobs[i].offsets[k];
+		result->pools[result->pools_count++] = jobs[i].pool;
+		free(jobs[i].offsets);
+	}
+	free(jobs);
+	if (status != 0)
+	{
+		import_result_done(result);
+		return -1;
+	}
+
+	const uint16_t **tmp = malloc(sizeof(uint16_t *) * (total + 1));
+	radix_sort(result->words, tmp, result->count, 0,
+			result->alphabet_size + 1);
+	free(tmp);
+	result->frequencies = malloc(sizeof(uint32_t) * (total + 1));
+	size_t unique = 0;
+	for (size_t i = 0; i < result->count; i++)
+	{
+		uint32_t frequency = word_frequency(result->words[i]);
+		if (unique == 0 || word_compare(result->words[unique - 1],
+				result->words[i]) != 0)
+		{
+			result->frequencies[unique] = frequency;
+			result->words[unique++] = result->words[i];
+		}
+		else if (result->frequencies[unique - 1] > UINT32_MAX - frequency)
+			result->frequencies[unique - 1] = UINT32_MAX;
+		else
+			result->frequencies[unique - 1] += frequency;
+	}
+	result->count = unique;
+	return 0;
+}
+
+void import_result_done(struct import_result *result)
+{
+	for (size_t i = 0; i < result->pools_count; i++)
+		free(result->pools[i]);
+	free(result->pools);
+	free(result->words);
+	free(result->frequencies);
+	free(result->alphabet);
+	memset(result, 0, sizeof(*result));
+}
+
+/**
+ @}
+ */
@@ -0,0 +1,54 @@
+/** @file
+    Interfejs importu słownika z listy słów.
+    Lista słów to plik tekstowy z jednym słowem w każdej linii.
+    Za słowem może być podana, po białych znakach, jego częstość.
+
+    @ingroup dictionary
+    @author Maja Zalewska <mz336088@students.mimuw.edu.pl>
+    @copyright Uniwerstet Warszawski
+    @date 2015-06-12
+ */
+
+#ifndef IMPORT_H_
+#define IMPORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+/**
+	Wynik importu listy słów.
+	Słowa są zapisane jako ciągi indeksów liter alfabetu powiększonych
+	o 1 i zakończone zerem, posortowane i bez powtórzeń.
+ */
+struct import_result
+{
+	wchar_t *alphabet;	///< Litery alfabetu w kolejności wcscoll.
+	size_t alphabet_size;	///< Liczba liter alfabetu.
+	const uint16_t **words;	///< Posortowane, unikalne słowa.
+	/// Częstości kolejnych słów, powtórzone słowo ma sumę częstości.
+	uint32_t *frequencies;
+	size_t count;	///< Liczba słów.
+	uint16_t **pools;	///< Bufory, w których zapisane są słowa.
+	size_t pools_count;	///< Liczba buforów.
+};
+
+/**
+	Wczytuje listę słów.
+	Plik jest mapowany do pamięci i dzielony na części przetwarzane
+	równolegle. Słowa są zamieniane na małe litery, linie zawierające
+	znaki niebędące literami są pomijane. Słowo bez podanej częstości
+	ma częstość DEFAULT_FREQUENCY.
+	@param[in] path Ścieżka pliku z listą słów.
+	@param[out] result Wynik importu, należy go zwolnić import_result_done().
+	@return 0 jeśli się udało, -1 w p.p.
+ */
+int import_word_list(const char *path, struct import_result *result);
+
+/**
+	Zwalnia pamięć wyniku importu.
+	@param[in,out] result Wynik importu.
+ */
+void import_result_done(struct import_result *result);
+
+#endif /* IMPORT_H_ */
@@ -0,0 +1,361 @@
+/** @file
+ Implementacja automatu Aho–Corasick dla lewych stron reguł.
+
+ @ingroup dictionary
+ @author Maja Zalewska <mz336088@students.mimuw.edu.pl>
+ @copyright Uniwerstet Warszawski
+ @date 2015-06-16
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <wctype.h>
+#include "rule_matcher.h"
+
+#define ROOT_NODE	0	///< Indeks korzenia automatu.
+#define NO_NODE	((size_t) -1)	///< Brak węzła.
+#define NODES_SIZE	16	///< Początkowy rozmiar tablicy węzłów.
+#define PATTERNS_SIZE	16	///< Początkowy rozmiar tablicy wzorców.
+
+/// Krawędź automatu.
+struct matcher_edge
+{
+	wchar_t symbol;	///< Litera krawędzi.
+	size_t target;	///< Węzeł docelowy.
+};
+
+/// Węzeł automatu.
+struct matcher_node
+{
+	struct matcher_edge *edges;	///< Krawędzie posortowane po literach.
+	size_t edges_len;	///< Liczba krawędzi.
+	size_t fail;	///< Węzeł najdłuższego właściwego sufiksu.
+	/// Najbliższy węzeł na ścieżce fail kończący słowo kluczowe, ROOT_NODE jeśli brak.
+	size_t output;
+	size_t *patterns;	///< Wzorce, których słowo kluczowe kończy się w węźle.
+	size_t patterns_len;	///< Liczba wzorców.
+};
+
+/// Wzorzec automatu.
+struct matcher_pattern
+{
+	size_t length;	///< Długość wzorca.
+	size_t key_offset;	///< Pozycja słowa kluczowego we wzorcu.
+	size_t key_length;	///< Długość słowa kluczowego, 0 jeśli wzorzec ma same zmienne.
+};
+
+/// Automat dopasowujący wzorce.
+struct rule_matcher
+{
+	struct matcher_node *nodes;	///< Węzły automatu.
+	size_t nodes_len;	///< Liczba węzłów.
+	size_t nodes_max;	///< Rozmiar tablicy węzłów.
+	struct matcher_pattern *patterns;	///< Wzorce.
+	size_t patterns_len;	///< Liczba wzorców.
+	size_t patterns_max;	///< Rozmiar tablic patterns i wildcards.
+	size_t *wildcards;	///< Wzorce złożone tylko ze zmiennych.
+	size_t wildcards_len;	///< Liczba takich wzorców.
+	bool linked;	///< Czy krawędzie fail są aktualne.
+};
+
+/** @name Funkcje pomocnicze
+ @{
+ */
+
+/**
+ Zwraca węzeł, do którego prowadzi krawędź o danej literze.
+ @param[in] node Węzeł.
+ @param[in] symbol Litera.
+ @return Węzeł docelowy, NO_NODE jeśli nie ma takiej krawędzi.
+ */
+static size_t node_goto(const struct matcher_node *node, wchar_t symbol)
+{
+	size_t first = 0;
+	size_t last = node->edges_len;
+	while (first < last)
+	{
+		size_t middle = (first + last) / 2;
+		if (node->edges[middle].symbol < symbol)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+	if (first < node->edges_len && node->edges[first].symbol == symbol)
+		return node->edges[first].target;
+	return NO_NODE;
+}
+
+/**
+ Dodaje nowy węzeł do automatu.
+ @param[in,out] matcher Automat.
+ @return Indeks węzła, NO_NODE jeśli zabrakło pamięci.
+ */
+static size_t add_node(struct rule_matcher *matcher)
+{
+	if (matcher->nodes_len == matcher->nodes_max)
+	{
+		size_t nodes_max = matcher->nodes_max * 2;
+		struct matcher_node *nodes =
+			realloc(matcher->nodes, sizeof(struct matcher_node) * nodes_max);
+		if (nodes == NULL)
+			return NO_NODE;
+		matcher->nodes = nodes;
+		matcher->nodes_max = nodes_max;
+	}
+	struct matcher_node *node = &matcher->nodes[matcher->nodes_len];
+	node->edges = NULL;
+	node->edges_len = 0;
+	node->fail = ROOT_NODE;
+	node->output = ROOT_NODE;
+	node->patterns = NULL;
+	node->patterns_len = 0;
+	return matcher->nodes_len++;
+}
+
+/**
+ Zwraca dziecko węzła o danej literze, tworząc je w razie potrzeby.
+ @param[in,out] matcher Automat.
+ @param[in] parent Indeks węzła.
+ @param[in] symbol Litera.
+ @return Indeks dziecka, NO_NODE jeśli zabrakło pamięci.
+ */
+static size_t add_child(struct rule_matcher *matcher, size_t parent, wchar_t symbol)
+{
+	size_t child = node_goto(&matcher->nodes[parent], symbol);
+	if (child != NO_NODE)
+		return child;
+	if ((child = add_node(matcher)) == NO_NODE)
+		return NO_NODE;
+	struct matcher_node *node = &matcher->nodes[parent];
+	struct matcher_edge *edges =
+		realloc(node->edges, sizeof(struct matcher_edge) * (node->edges_len + 1));
+	if (edges == NULL)
+		return NO_NODE;
+	size_t i = node->edges_len;
+	while (i > 0 && edges[i - 1].symbol > symbol)
+	{
+		edges[i] = edges[i - 1];
+		i--;
+	}
+	edges[i].symbol = symbol;
+	edges[i].target = child;
+	node->edges = edges;
+	node->edges_len++;
+	return child;
+}
+
+/**
+ Wyznacza słowo kluczowe wzorca, czyli najdłuższy fragment bez cyfr.
+ @param[in] pattern Wzorzec.
+ @param[out] info Długość wzorca i położenie słowa kluczowego.
+ */
+static void find_key(const wchar_t *pattern, struct matcher_pattern *info)
+{
+	size_t run = 0;
+	info->key_offset = 0;
+	info->key_length = 0;
+	for (info->length = 0; pattern[info->length] != L'\0'; info->length++)
+	{
+		run = iswdigit(pattern[info->length]) ? 0 : run + 1;
+		if (run > info->key_length)
+		{
+			info->key_length = run;
+			info->key_offset = info->length + 1 - run;
+		}
+	}
+}
+
+/**
+ Powiększa podwójnie tablice wzorców.
+ @param[in,out] matcher Automat.
+ @return true jeśli się udało, false jeśli zabrakło pamięci.
+ */
+static bool resize_patterns(struct rule_matcher *matcher)
+{
+	size_t patterns_max = matcher->patterns_max * 2;
+	struct matcher_pattern *patterns =
+		realloc(matcher->patterns, sizeof(struct matcher_pattern) * patterns_max);
+	if (patterns == NULL)
+		return false;
+	matcher->patterns = patterns;
+	size_t *wildcards = realloc(matcher->wildcards, sizeof(size_t) * patterns_max);
+	if (wildcards == NULL)
+		return false;
+	matcher->wildcards = wildcards;
+	matcher->patterns_max = patterns_max;
+	return true;
+}
+
+/**
+ Wyznacza krawędzie fail i output, przechodząc automat wszerz.
+ @param[in,out] matcher Automat.
+ @return true jeśli się udało, false jeśli zabrakło pamięci.
+ */
+static bool link_nodes(struct rule_matcher *matcher)
+{
+	size_t *queue = malloc(sizeof(size_t) * matcher->nodes_len);
+	if (queue == NULL)
+		return false;
+	size_t head = 0;
+	size_t tail = 0;
+	queue[tail++] = ROOT_NODE;
+	while (head < tail)
+	{
+		size_t parent = queue[head++];
+		struct matcher_node *node = &matcher->nodes[parent];
+		for (size_t i = 0; i < node->edges_len; i++)
+		{
+			wchar_t symbol = node->edges[i].symbol;
+			struct matcher_node *child = &matcher->nodes[node->edges[i].target];
+			child->fail = ROOT_NODE;
+			if (parent != ROOT_NODE)
+			{
+				size_t fail = node->fail;
+				while (fail != ROOT_NODE && node_goto(&matcher->nodes[fail], symbol) == NO_NODE)
+					fail = matcher->nodes[fail].fail;
+				size_t next = node_goto(&matcher->nodes[fail], symbol);
+				if (next != NO_NODE)
+					child->fail = next;
+			}
+			struct matcher_node *fail = &matcher->nodes[child->fail];
+			child->output = fail->patterns_len > 0 ? child->fail : fail->output;
+			queue[tail++] = node->edges[i].target;
+		}
+	}
+	free(queue);
+	return true;
+}
+
+/**
+ Zgłasza dopasowania wzorców, których słowo kluczowe kończy się w węźle.
+ @param[in] matcher Automat.
+ @param[in] node Węzeł.
+ @param[in] end Pozycja w słowie za słowem kluczowym.
+ @param[in] len Długość słowa.
+ @param[in] callback Funkcja wywoływana dla każdego dopasowania.
+ @param[in,out] data Dane przekazywane do funkcji callback.
+ */
+static void report(const struct rule_matcher *matcher, const struct matcher_node *node,
+		size_t end, size_t len, rule_matcher_callback *callback, void *data)
+{
+	for (size_t i = 0; i < node->patterns_len; i++)
+	{
+		const struct matcher_pattern *info = &matcher->patterns[node->patterns[i]];
+		size_t key_start = end - info->key_length;
+		if (key_start < info->key_offset)
+			continue;
+		size_t start = key_start - info->key_offset;
+		if (start + info->length <= len)
+			callback(node->patterns[i], start, data);
+	}
+}
+
+/// @}
+
+/** @name Elementy interfejsu
+ @{
+ */
+
+struct rule_matcher *rule_matcher_new(void)
+{
+	struct rule_matcher *matcher = calloc(1, sizeof(struct rule_matcher));
+	if (matcher == NULL)
+		return NULL;
+	matcher->nodes_max = NODES_SIZE;
+	matcher->nodes = malloc(sizeof(struct matcher_node) * NODES_SIZE);
+	matcher->patterns_max = PATTERNS_SIZE;
+	matcher->patterns = malloc(sizeof(struct matcher_pattern) * PATTERNS_SIZE);
+	matcher->wildcards = malloc(sizeof(size_t) * PATTERNS_SIZE);
+	matcher->linked = true;
+	if (matcher->nodes == NULL || matcher->patterns == NULL
+			|| matcher->wildcards == NULL || add_node(matcher) != ROOT_NODE)
+	{
+		rule_matcher_free(matcher);
+		return NULL;
+	}
+	return matcher;
+}
+
+int rule_matcher_add(struct rule_matcher *matcher, const wchar_t *pattern)
+{
+	if (matcher->patterns_len == matcher->patterns_max && !resize_patterns(matcher))
+		return -1;
+	size_t index = matcher->patterns_len;
+	struct matcher_pattern *info = &matcher->patterns[index];
+	find_key(pattern, info);
+	if (info->key_length == 0)
+	{
+		matcher->wildcards[matcher->wildcards_len++] = index;
+		matcher->patterns_len++;
+		return 0;
+	}
+	size_t node = ROOT_NODE;
+	for (size_t i = 0; i < info->key_length; i++)
+	{
+		node = add_child(matcher, node, pattern[info->key_offset + i]);
+		if (node == NO_NODE)
+			return -1;
+	}
+	struct matcher_node *end = &matcher->nodes[node];
+	size_t *patterns = realloc(end->patterns, sizeof(size_t) * (end->patterns_len + 1));
+	if (patterns == NULL)
+		return -1;
+	patterns[end->patterns_len++] = index;
+	end->patterns = patterns;
+	matcher->patterns_len++;
+	matcher->linked = false;
+	return 0;
+}
+
+int rule_matcher_prepare(struct rule_matcher *matcher)
+{
+	if (!matcher->linked)
+	{
+		if (!link_nodes(matcher))
+			return -1;
+		matcher->linked = true;
+	}
+	return 0;
+}
+
+void rule_matcher_free(struct rule_matcher *matcher)
+{
+	if (matcher == NULL)
+		return;
+	for (size_t i = 0; i < matcher->nodes_len; i++)
+	{
+		free(matcher->nodes[i].edges);
+		free(matcher->nodes[i].patterns);
+	}
+	free(matcher->nodes);
+	free(matcher->patterns);
+	free(matcher->wildcards);
+	free(matcher);
+}
+
+void rule_matcher_run(const struct rule_matcher *matcher, const wchar_t *text,
+		size_t len, rule_matcher_callback *callback, void *data)
+{
+	for (size_t i = 0; i < matcher->wildcards_len; i++)
+	{
+		size_t pattern = matcher->wildcards[i];
+		size_t length = matcher->patterns[pattern].length;
+		for (size_t start = 0; start + length <= len; start++)
+			callback(pattern, start, data);
+	}
+	size_t state = ROOT_NODE;
+	for (size_t i = 0; i < len; i++)
+	{
+		size_t next;
+		while ((next = node_goto(&matcher->nodes[state], text[i])) == NO_NODE
+				&& state != ROOT_NODE)
+			state = matcher->nodes[state].fail;
+		state = next != NO_NODE ? next : ROOT_NODE;
+		for (size_t node = state; node != ROOT_NODE; node = matcher->nodes[node].output)
+			report(matcher, &matcher->nodes[node], i + 1, len, callback, data);
+	}
+}
+
+/**
+ @}
+ */
@@ -0,0 +1,75 @@
+/** @file
+    Interfejs automatu dopasowującego lewe strony reguł.
+    Automat Aho–Corasick jest budowany ze wzorców, w których cyfry
+    oznaczają zmienne pasujące do dowolnej litery. Jedno przejście po
+    słowie wyznacza wszystkie miejsca, w których wzorce mogą pasować.
+
+    @ingroup dictionary
+    @author Maja Zalewska <mz336088@students.mimuw.edu.pl>
+    @copyright Uniwerstet Warszawski
+    @date 2015-06-16
+ */
+
+#ifndef RULE_MATCHER_H_
+#define RULE_MATCHER_H_
+
+#include <stddef.h>
+#include <wchar.h>
+
+struct rule_matcher;	///< Automat dopasowujący wzorce. Patrz rule_matcher.c
+
+/**
+	Funkcja wywoływana dla każdego dopasowania.
+	Litery wzorca są zgodne ze słowem, ale zgodność zmiennych
+	(ta sama cyfra to ta sama litera) trzeba sprawdzić samemu.
+	@param[in] pattern Indeks wzorca.
+	@param[in] start Pozycja w słowie, od której pasuje wzorzec.
+	@param[in,out] data Dane przekazane do rule_matcher_run().
+ */
+typedef void rule_matcher_callback(size_t pattern, size_t start, void *data);
+
+/**
+	Tworzy pusty automat.
+	@return Automat, NULL jeśli zabrakło pamięci.
+ */
+struct rule_matcher *rule_matcher_new(void);
+
+/**
+	Dodaje wzorzec do automatu.
+	Wzorce są numerowane kolejno od zera. Słowem kluczowym wzorca jest
+	jego najdłuższy fragment bez zmiennych, wzorce złożone tylko ze
+	zmiennych pasują w każdym miejscu, w którym mieszczą się w słowie.
+	Po dodaniu wzorców przed wyszukiwaniem trzeba wywołać
+	rule_matcher_prepare().
+	@param[in,out] matcher Automat.
+	@param[in] pattern Wzorzec.
+	@return 0 jeśli się udało, -1 jeśli zabrakło pamięci.
+ */
+int rule_matcher_add(struct rule_matcher *matcher, const wchar_t *pattern);
+
+/**
+	Wyznacza krawędzie automatu dla wzorców dodanych od ostatniego wywołania.
+	@param[in,out] matcher Automat.
+	@return 0 jeśli się udało, -1 jeśli zabrakło pamięci.
+ */
+int rule_matcher_prepare(struct rule_matcher *matcher);
+
+/**
+	Zwalnia automat.
+	@param[in] matcher Automat, może być NULL.
+ */
+void rule_matcher_free(struct rule_matcher *matcher);
+
+/**
+	Wyszukuje w słowie wszystkie dopasowania wzorców.
+	Automat musi być przygotowany przez rule_matcher_prepare().
+	@param[in] matcher Automat.
+	@param[in] text Słowo.
+	@param[in] len Długość słowa.
+	@param[in] callback Funkcja wywoływana dla każdego dopasowania.
+	@param[in,out] data Dane przekazywane do funkcji callback.
+ */
+void rule_matcher_run(const struct rule_matcher *matcher, const wchar_t *text,
+		size_t len, rule_matcher_callback *callback, void *data);
+
+#endif /* RULE_MATCHER_H_ */
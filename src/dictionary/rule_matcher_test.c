@@ -0,0 +1,108 @@
+/** @file
+	Test do automatu dopasowującego lewe strony reguł.
+	@ingroup tests
+	@date: 16 June 2015
+	@author: Maja Zalewska <mz336088@mimuw.edu.pl>
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <cmocka.h>
+#include "rule_matcher.h"
+
+#define MAX_MATCHES	64	///< Maksymalna liczba zapamiętywanych dopasowań.
+
+/// Dopasowania zebrane przez automat.
+struct matches
+{
+	size_t count;	///< Liczba dopasowań.
+	size_t pattern[MAX_MATCHES];	///< Indeksy wzorców.
+	size_t start[MAX_MATCHES];	///< Pozycje dopasowań.
+};
+
+/// Zapamiętuje dopasowanie.
+static void remember(size_t pattern, size_t start, void *data)
+{
+	struct matches *matches = data;
+	assert_true(matches->count < MAX_MATCHES);
+	matches->pattern[matches->count] = pattern;
+	matches->start[matches->count] = start;
+	matches->count++;
+}
+
+/// Sprawdza, czy wzorzec pattern został dopasowany od pozycji start.
+static int matched(const struct matches *matches, size_t pattern, size_t start)
+{
+	for (size_t i = 0; i < matches->count; i++)
+		if (matches->pattern[i] == pattern && matches->start[i] == start)
+			return 1;
+	return 0;
+}
+
+/// Sprawdza dopasowania wzorców bez zmiennych, także zachodzących na siebie.
+static void rule_matcher_literal_test(void **state)
+{
+	const wchar_t *patterns[] = { L"he", L"she", L"his", L"hers" };
+	struct rule_matcher *matcher = rule_matcher_new();
+	assert_non_null(matcher);
+	for (int i = 0; i < 4; i++)
+		assert_int_equal(rule_matcher_add(matcher, patterns[i]), 0);
+	assert_int_equal(rule_matcher_prepare(matcher), 0);
+	struct matches matches = { 0 };
+	rule_matcher_run(matcher, L"ushers", 6, remember, &matches);
+	assert_int_equal(matches.count, 3);
+	assert_true(matched(&matches, 0, 2));
+	assert_true(matched(&matches, 1, 1));
+	assert_true(matched(&matches, 3, 2));
+	// Wzorce można dodawać do przygotowanego już automatu.
+	assert_int_equal(rule_matcher_add(matcher, L"rs"), 0);
+	assert_int_equal(rule_matcher_prepare(matcher), 0);
+	matches.count = 0;
+	rule_matcher_run(matcher, L"ushers", 6, remember, &matches);
+	assert_int_equal(matches.count, 4);
+	assert_true(matched(&matches, 4, 4));
+	rule_matcher_free(matcher);
+}
+
+/// Sprawdza dopasowania wzorców ze zmiennymi i pustego wzorca.
+static void rule_matcher_wildcard_test(void **state)
+{
+	const wchar_t *patterns[] = { L"0ab", L"a1", L"01", L"" };
+	struct rule_matcher *matcher = rule_matcher_new();
+	assert_non_null(matcher);
+	for (int i = 0; i < 4; i++)
+		assert_int_equal(rule_matcher_add(matcher, patterns[i]), 0);
+	assert_int_equal(rule_matcher_prepare(matcher), 0);
+	struct matches matches = { 0 };
+	rule_matcher_run(matcher, L"cab", 3, remember, &matches);
+	// "0ab" od 0, "a1" od 1, "01" od 0 i 1, "" od 0, 1, 2 i 3.
+	assert_int_equal(matches.count, 8);
+	assert_true(matched(&matches, 0, 0));
+	assert_true(matched(&matches, 1, 1));
+	assert_true(matched(&matches, 2, 0));
+	assert_true(matched(&matches, 2, 1));
+	assert_true(matched(&matches, 3, 3));
+	matches.count = 0;
+	// Wzorzec nie może wystawać poza słowo.
+	rule_matcher_run(matcher, L"ab", 2, remember, &matches);
+	assert_int_equal(matches.count, 5);
+	assert_false(matched(&matches, 0, 0));
+	assert_true(matched(&matches, 1, 0));
+	assert_false(matched(&matches, 2, 1));
+	rule_matcher_free(matcher);
+}
+
+/// Wywołuje testy.
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(rule_matcher_literal_test),
+		cmocka_unit_test(rule_matcher_wildcard_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -10,9 +10,13 @@
 #include "rules_list.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <assert.h>
 
+#define STATE_SET_SIZE	1024	///< Początkowy rozmiar tablicy zbioru stanów.
+#define WALK_MEMO_SIZE	256	///< Początkowy rozmiar tablicy pamięci przejść.
+
 
 /**
  Powiększa podwójnie rozmiar rules_list.
@@ -20,8 +24,17 @@
  */
 static void rules_list_resize(struct rules_list *list, size_t new_max)
 {
-	void ** array = realloc(list->array,
-			sizeof(void *) * new_max);
+	void ** array;
+	if (list->arena != NULL)
+	{
+		if (new_max <= list->max_size)
+			return;
+		array = arena_alloc(list->arena, sizeof(void *) * new_max);
+		if (array)
+			memcpy(array, list->array, sizeof(void *) * list->size);
+	}
+	else
+		array = realloc(list->array, sizeof(void *) * new_max);
 	if (array)
 	{
 		list->array = array;
@@ -29,6 +42,122 @@ static void rules_list_resize(struct rules_list *list, size_t new_max)
 	}
 }
 
+/**
+ Liczy skrót klucza stanu.
+ @param[in] pos Pozycja w słowie.
+ @param[in] node Węzeł drzewa.
+ @param[in] start Początek bieżącego słowa.
+ @return Skrót.
+ */
+static uint64_t state_hash(size_t pos, const struct nodeInfo *node,
+		const struct state *start)
+{
+	uint64_t hash = pos;
+	hash = hash * 0x9E3779B97F4A7C15ULL + (uintptr_t) node;
+	hash = hash * 0x9E3779B97F4A7C15ULL + (uintptr_t) start;
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+/**
+ Zwraca miejsce w tablicy zbioru dla danego klucza: zajęte przez stan
+ o tym kluczu albo pierwsze wolne.
+ @param[in] table Tablica zbioru.
+ @param[in] capacity Rozmiar tablicy.
+ @param[in] pos Pozycja w słowie.
+ @param[in] node Węzeł drzewa.
+ @param[in] start Początek bieżącego słowa.
+ @return Indeks w tablicy.
+ */
+static size_t state_set_slot(struct state **table, size_t capacity, size_t pos,
+		const struct nodeInfo *node, const struct state *start)
+{
+	size_t i = state_hash(pos, node, start) & (capacity - 1);
+	while (table[i] != NULL && (table[i]->pos != pos || table[i]->node != node
+			|| table[i]->start != start))
+		i = (i + 1) & (capacity - 1);
+	return i;
+}
+
+/**
+ Powiększa tablicę zbioru stanów.
+ @param[in,out] set Powiększany zbiór.
+ @param[in] capacity Nowy rozmiar tablicy, potęga dwójki.
+ @return true jeśli się udało, false jeśli zabrakło pamięci.
+ */
+static bool state_set_resize(struct state_set *set, size_t capacity)
+{
+	struct state **table = arena_alloc(set->arena, sizeof(struct state *) * capacity);
+	if (table == NULL)
+		return false;
+	memset(table, 0, sizeof(struct state *) * capacity);
+	for (size_t i = 0; i < set->capacity; i++)
+	{
+		struct state *state = set->table[i];
+		if (state != NULL)
+			table[state_set_slot(table, capacity, state->pos, state->node, state->start)] = state;
+	}
+	set->table = table;
+	set->capacity = capacity;
+	return true;
+}
+
+/**
+ Zwraca miejsce w tablicy pamięci przejść dla danego klucza: zajęte
+ przez przejście o tym kluczu albo pierwsze wolne.
+ @param[in] table Tablica pamięci.
+ @param[in] capacity Rozmiar tablicy.
+ @param[in] pos Pozycja w słowie.
+ @param[in] node Węzeł drzewa.
+ @return Indeks w tablicy.
+ */
+static size_t walk_memo_slot(const struct walk *table, size_t capacity, size_t pos,
+		const struct nodeInfo *node)
+{
+	size_t i = state_hash(pos, node, NULL) & (capacity - 1);
+	while (table[i].node != NULL && (table[i].pos != pos || table[i].node != node))
+		i = (i + 1) & (capacity - 1);
+	return i;
+}
+
+/**
+ Przydziela wyzerowaną tablicę pamięci przejść.
+ @param[in,out] arena Arena.
+ @param[in] capacity Rozmiar tablicy.
+ @return Tablica, NULL jeśli zabrakło pamięci.
+ */
+static struct walk *walk_memo_table(struct arena *arena, size_t capacity)
+{
+	struct walk *table = arena_alloc(arena, sizeof(struct walk) * capacity);
+	if (table != NULL)
+		memset(table, 0, sizeof(struct walk) * capacity);
+	return table;
+}
+
+/**
+ Powiększa podwójnie tablicę pamięci przejść.
+ @param[in,out] memo Powiększana pamięć.
+ @return true jeśli się udało, false jeśli zabrakło pamięci.
+ */
+static bool walk_memo_resize(struct walk_memo *memo)
+{
+	size_t capacity = memo->capacity > 0 ? memo->capacity * 2 : WALK_MEMO_SIZE;
+	struct walk *table = walk_memo_table(memo->arena, capacity);
+	if (table == NULL)
+		return false;
+	for (size_t i = 0; i < memo->capacity; i++)
+	{
+		const struct walk *walk = &memo->table[i];
+		if (walk->node != NULL)
+			table[walk_memo_slot(table, capacity, walk->pos, walk->node)] = *walk;
+	}
+	memo->table = table;
+	memo->capacity = capacity;
+	return true;
+}
+
 /** @name Elementy interfejsu
  @{
  */
@@ -38,6 +167,15 @@ void rules_list_init(struct rules_list *list)
 	list->size = 0;
 	list->max_size = BASE_SIZE;
 	list->array = malloc(sizeof(void *) * BASE_SIZE);
+	list->arena = NULL;
+}
+
+void rules_list_init_arena(struct rules_list *list, struct arena *arena)
+{
+	list->size = 0;
+	list->max_size = BASE_SIZE;
+	list->array = arena_alloc(arena, sizeof(void *) * BASE_SIZE);
+	list->arena = arena;
 }
 
 void rules_list_done(struct rules_list *list, int flag)
@@ -52,15 +190,11 @@ void rules_list_done(struct rules_list *list, int flag)
 				 free(list->array[i]);
 				 list->array[i] = NULL;
 				 break;
-			 case DEL_STATE:
-				 delete_state((struct state *)list->array[i]);
-				 free(list->array[i]);
-				 list->array[i] = NULL;
-				 break;
 			 }
 		 }
 	 }
-	 free(list->array);
+	 if (list->arena == NULL)
+		 free(list->array);
 	 list->size = 0;
 	 list->max_size = 0;
 }
@@ -92,9 +226,6 @@ size_t rules_list_delete(struct rules_list *list, int index)
 {
 	if (index < 0 || index >= list->size)
 		return -1;
-	delete_state(*((struct state **)list->array[index]));
-	free(*((struct state **)list->array[index]));
-	*((struct state **)list->array[index]) = NULL;
 	list->array[index] = NULL;
 	int i;
 	for (i = index; i < list->size - 1; i++)
@@ -112,77 +243,161 @@ void rules_list_copy(struct rules_list *list, void *elem)
 	if (list->size >= list->max_size)
 		rules_list_resize(list, list->max_size * 2);
 	struct state * cpy = (struct state *)elem;
-	list->array[list->size] = create_state(cpy->word, 0, wcslen(cpy->word), cpy->cost, cpy->change, cpy->node, cpy->prev, cpy->used_s);
+	list->array[list->size] = create_state(list->arena, cpy->pos, cpy->node, cpy->cost,
+			cpy->prev, cpy->fragment, cpy->fragment_len, cpy->start);
 	list->size++;
 
 }
 
-/**
-	Odwraca dany wyraz.
-	@param[in] str Wyraz do odwórcenia.
-	@retrun Odwrócony wyraz.
- */
-static wchar_t *reverse(wchar_t *str) {
-	size_t len = wcslen(str);
-	size_t i;
-	wchar_t temp;
-	fprintf(stderr, "REVERSE: %d, %ls\n", len, str);
-	for (i = 0; i < (len / 2); i++)
-	{
-	    char temp = str[len - i - 1];
-	    str[len - i - 1] = str[i];
-	    str[i] = temp;
-	}
-	fprintf(stderr, "REVERSE_END: %d, %ls\n", len, str);
-	return str;
+struct state *create_state(struct arena *arena, size_t pos, struct nodeInfo *node,
+		int cost, struct state *prev, const wchar_t *fragment, size_t fragment_len,
+		struct state *start)
+{
+	struct state *state = arena_alloc(arena, sizeof(struct state));
+	state->pos = pos;
+	state->node = node;
+	state->cost = cost;
+	state->prev = prev;
+	state->fragment = fragment;
+	state->fragment_len = fragment_len;
+	state->start = start;
+	return state;
 }
 
-struct state *create_state(wchar_t *word, size_t pos, size_t length, int cost, wchar_t *change,
-		struct nodeInfo *node, struct state *prev, int used_s)
+void state_set_init(struct state_set *set, struct arena *arena)
 {
-	struct state *state = malloc(sizeof(struct state));
-	size_t len = wcslen(word) - pos;
-	state->word = malloc(sizeof(wchar_t) * (len + 1));
-	wcsncpy(state->word, word+pos, len);
-	state->word[len] = L'\0';
-	state->cost = cost;
-	state->change = malloc(sizeof(wchar_t) * (wcslen(change) + 1));
-//	state->change = "\0";
-	fprintf(stderr, "create state change input: %ls\n", change);
-	wcscpy(state->change, change);
-	if (prev != NULL) {
-		if (wcslen(state->change) == 0)
-			wcscpy(state->change, prev->change);
-		//if (wcslen(prev->change) != 0)
-		else
+	set->arena = arena;
+	set->size = 0;
+	set->capacity = STATE_SET_SIZE;
+	set->table = arena_alloc(arena, sizeof(struct state *) * STATE_SET_SIZE);
+	memset(set->table, 0, sizeof(struct state *) * STATE_SET_SIZE);
+}
+
+struct state *state_set_find(const struct state_set *set, size_t pos,
+		const struct nodeInfo *node, const struct state *start)
+{
+	return set->table[state_set_slot(set->table, set->capacity, pos, node, start)];
+}
+
+bool state_set_add(struct state_set *set, struct state *state)
+{
+	// Wypełnienie tablicy trzymamy poniżej 3/4.
+	if (4 * (set->size + 1) > 3 * set->capacity
+			&& !state_set_resize(set, set->capacity * 2))
+		return false;
+	size_t i = state_set_slot(set->table, set->capacity, state->pos, state->node,
+			state->start);
+	if (set->table[i] == NULL)
+		set->size++;
+	else if (set->table[i]->cost <= state->cost)
+		return false;
+	set->table[i] = state;
+	return true;
+}
+
+void state_set_clear(struct state_set *set)
+{
+	memset(set->table, 0, sizeof(struct state *) * set->capacity);
+	set->size = 0;
+}
+
+bool state_set_reserve(struct state_set *set, size_t size)
+{
+	size_t capacity = set->capacity;
+	while (4 * size > 3 * capacity)
+		capacity *= 2;
+	return capacity == set->capacity || state_set_resize(set, capacity);
+}
+
+bool state_set_add_shared(struct state_set *set, struct state *state)
+{
+	size_t mask = set->capacity - 1;
+	size_t i = state_hash(state->pos, state->node, state->start) & mask;
+	for (;; i = (i + 1) & mask)
+	{
+		struct state *other = __atomic_load_n(&set->table[i], __ATOMIC_ACQUIRE);
+		if (other == NULL)
 		{
-			wchar_t *cpy = malloc(sizeof(wchar_t) * (wcslen(prev->change) + wcslen(state->change) + 1));
-			wcscpy(cpy, prev->change);
-			wcscat(cpy, state->change);
-			size_t leng = wcslen(state->change);
-			free(state->change);
-			state->change = malloc(sizeof(wchar_t) * (wcslen(prev->change) + leng + 1));
-			wcscpy(state->change, cpy);
-			fprintf(stderr, "^^^^ %ls \n", state->change);
-			free(cpy);
+			if (__sync_bool_compare_and_swap(&set->table[i], NULL, state))
+			{
+				__sync_fetch_and_add(&set->size, 1);
+				return true;
+			}
+			// Inny wątek zajął to miejsce, sprawdzamy jego stan.
+			other = __atomic_load_n(&set->table[i], __ATOMIC_ACQUIRE);
 		}
-//		reverse(state->change);
+		if (other->pos == state->pos && other->node == state->node
+				&& other->start == state->start)
+			return false;
 	}
-	state->node = node;
-	state->prev = prev;
-	state->used_s = used_s;
-	fprintf(stderr, "dodaje stan od slowa %ls: słowo: %ls, change: %ls, koszt: %d\n", word, state->word, state->change, state->cost);
-	return state;
 }
 
-void delete_state(struct state *state)
+void walk_memo_init(struct walk_memo *memo, struct arena *arena)
+{
+	memo->arena = arena;
+	memo->size = 0;
+	memo->capacity = 0;
+	memo->table = NULL;
+}
+
+struct walk *walk_memo_find(const struct walk_memo *memo, size_t pos,
+		const struct nodeInfo *node)
+{
+	if (memo->capacity == 0)
+		return NULL;
+	struct walk *walk = &memo->table[walk_memo_slot(memo->table, memo->capacity,
+			pos, node)];
+	return walk->node != NULL ? walk : NULL;
+}
+
+bool walk_memo_add(struct walk_memo *memo, size_t pos,
+		const struct nodeInfo *node, struct nodeInfo *end, size_t len)
+{
+	// Wypełnienie tablicy trzymamy poniżej 3/4, pustą przydzielamy dopiero teraz.
+	if (4 * (memo->size + 1) > 3 * memo->capacity && !walk_memo_resize(memo))
+		return false;
+	struct walk *walk = &memo->table[walk_memo_slot(memo->table, memo->capacity,
+			pos, node)];
+	walk->pos = pos;
+	walk->node = node;
+	walk->end = end;
+	walk->len = len;
+	memo->size++;
+	return true;
+}
+
+void state_queue_init(struct state_queue *queue, int max_priority,
+		struct arena *arena)
 {
-	free(state->word);
-	state->word = NULL;
-	free(state->change);
-	state->change = NULL;
+	queue->buckets = arena_alloc(arena, sizeof(struct rules_list) * (max_priority + 1));
+	for (int i = 0; i <= max_priority; i++)
+		rules_list_init_arena(&queue->buckets[i], arena);
+	queue->max_priority = max_priority;
+	queue->current = 0;
+	queue->next = 0;
 }
 
+bool state_queue_push(struct state_queue *queue, struct state *state, int priority)
+{
+	assert(priority >= queue->current);
+	if (priority > queue->max_priority)
+		return false;
+	return rules_list_add(&queue->buckets[priority], state);
+}
+
+bool state_queue_pop(struct state_queue *queue, struct state_entry *entry)
+{
+	while (queue->next >= rules_list_size(&queue->buckets[queue->current]))
+	{
+		if (queue->current == queue->max_priority)
+			return false;
+		queue->current++;
+		queue->next = 0;
+	}
+	entry->priority = queue->current;
+	entry->state = rules_list_get(&queue->buckets[queue->current])[queue->next++];
+	return true;
+}
 
 /**@}*/
 
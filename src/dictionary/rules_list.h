@@ -14,11 +14,11 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <wchar.h>
+#include "arena.h"
 
 #define BASE_SIZE	4
 #define DEL_NO	0
 #define DEL_FREE	1
-#define DEL_STATE	2
 
 struct rule;	///< Struktura reprezentująca regułę. Patrz dictionary.c
 struct nodeInfo;	///< Struktura reprezentująca węzeł słownika.
@@ -32,17 +32,84 @@ struct rules_list
 	size_t max_size;
 	/// Tablica reguł.
 	void **array;
+	/// Arena, z której przydzielana jest tablica, NULL jeśli z malloc.
+	struct arena *arena;
 };
 
-/// Stan postaci (sufix, node)
+/**
+  Stan wyszukiwania podpowiedzi.
+  Nieprzetworzony sufiks słowa jest wyznaczony przez pozycję pos,
+  a podpowiedź odtwarzamy tylko dla stanów końcowych, idąc po prev
+  i sklejając kolejne fragmenty.
+  */
 struct state
 {
-	wchar_t *word;
-	int cost;
-	wchar_t *change;
-	struct nodeInfo *node;
-	struct state *prev;
-	int used_s;
+	size_t pos;	///< Pozycja w słowie, od której zaczyna się nieprzetworzony sufiks.
+	struct nodeInfo *node;	///< Węzeł drzewa odpowiadający bieżącemu słowu podpowiedzi.
+	int cost;	///< Koszt dojścia do stanu.
+	struct state *prev;	///< Stan, z którego przeszliśmy, NULL dla stanu początkowego.
+	const wchar_t *fragment;	///< Tekst dopisany do podpowiedzi przy przejściu z prev.
+	size_t fragment_len;	///< Długość fragmentu.
+	/// Stan, od którego zaczyna się bieżące słowo podpowiedzi, NULL dla pierwszego słowa.
+	struct state *start;
+};
+
+/**
+  Zbiór stanów, w którym stany o tej samej pozycji, węźle i początku
+  słowa są traktowane jako równe. Dla takich stanów trzymamy ten
+  o najmniejszym koszcie.
+  */
+struct state_set
+{
+	struct state **table;	///< Tablica z adresowaniem otwartym.
+	size_t size;	///< Liczba stanów w zbiorze.
+	size_t capacity;	///< Rozmiar tablicy, potęga dwójki.
+	struct arena *arena;	///< Arena, z której przydzielana jest tablica.
+};
+
+/**
+  Wynik przejścia po drzewie resztą słowa od pozycji i węzła, bez
+  żadnych zmian.
+  */
+struct walk
+{
+	size_t pos;	///< Pozycja w słowie.
+	const struct nodeInfo *node;	///< Węzeł drzewa.
+	struct nodeInfo *end;	///< Węzeł, na którym przejście się zatrzymało.
+	size_t len;	///< Liczba przejętych liter, pos + len == długość słowa, jeśli doszło do końca.
+};
+
+/**
+  Zapamiętane przejścia, po jednym dla pozycji w słowie i węzła.
+  */
+struct walk_memo
+{
+	/// Tablica z adresowaniem otwartym, wolne miejsca mają node równe NULL.
+	struct walk *table;
+	size_t size;	///< Liczba przejść.
+	size_t capacity;	///< Rozmiar tablicy, potęga dwójki.
+	struct arena *arena;	///< Arena, z której przydzielana jest tablica.
+};
+
+/// Element kolejki priorytetowej stanów.
+struct state_entry
+{
+	int priority;	///< Priorytet, mniejszy jest wcześniej.
+	struct state *state;	///< Stan.
+};
+
+/**
+  Kolejka priorytetowa stanów o priorytetach od 0 do max_priority.
+  Stany o jednym priorytecie trzymamy w osobnej liście (kubełku).
+  Priorytety wyjmowanych stanów nie mogą maleć, więc wystarczy
+  przechodzić kubełki po kolei.
+  */
+struct state_queue
+{
+	struct rules_list *buckets;	///< Kubełki, po jednym na priorytet.
+	int max_priority;	///< Największy priorytet.
+	int current;	///< Priorytet bieżącego kubełka.
+	size_t next;	///< Indeks następnego stanu w bieżącym kubełku.
 };
 
 /**
@@ -51,6 +118,14 @@ struct state
   */
 void rules_list_init(struct rules_list *list);
 
+/**
+  Inicjuje listę, której tablica jest przydzielana z areny.
+  Taka lista nie wymaga rules_list_done(), jest zwalniana razem z areną.
+  @param[in,out] list Lista.
+  @param[in] arena Arena.
+  */
+void rules_list_init_arena(struct rules_list *list, struct arena *arena);
+
 /**
   Destrukcja listy reguł.
   @param[in,out] list Lista reguł.
@@ -90,6 +165,7 @@ size_t rules_list_delete(struct rules_list *list, int index);
 
 /**
 	Dodaje do listy skopiowany element.
+	Kopia stanu jest przydzielana z areny listy.
 	@param[in] list Lista, do której jest dodawany element.
 	@param[in] elem Element, który ma być skopiowany.
  */
@@ -97,20 +173,136 @@ void rules_list_copy(struct rules_list *list, void *elem);
 
 /**
 	Tworzy nową strukturę state.
-	@param[in] word Słowo.
-	@param[in] pos Pozycja w słowie word, od której zaczyna się sufix.
-	@param[in] change Prawa strona reguły, po której przeszliśmy do tego stanu.
-	@param[in] cost Koszt przejścia z prev do tu.
+	Stan jest przydzielany z areny i zwalniany razem z nią. Fragment nie
+	jest kopiowany, musi żyć co najmniej tak długo jak stan.
+	@param[in,out] arena Arena, z której przydzielana jest pamięć.
+	@param[in] pos Pozycja w słowie, od której zaczyna się sufiks.
+	@param[in] node Węzeł drzewa.
+	@param[in] cost Koszt dojścia do stanu.
+	@param[in] prev Stan, z którego przeszlismy.
+	@param[in] fragment Tekst dopisany do podpowiedzi przy przejściu z prev.
+	@param[in] fragment_len Długość fragmentu.
+	@param[in] start Stan, od którego zaczyna się bieżące słowo.
+	@return Nowy stan.
+ */
+struct state *create_state(struct arena *arena, size_t pos, struct nodeInfo *node,
+		int cost, struct state *prev, const wchar_t *fragment, size_t fragment_len,
+		struct state *start);
+
+/**
+	Inicjuje pusty zbiór stanów.
+	Tablica zbioru jest przydzielana z areny i zwalniana razem z nią.
+	@param[out] set Zbiór.
+	@param[in,out] arena Arena.
+ */
+void state_set_init(struct state_set *set, struct arena *arena);
+
+/**
+	Szuka w zbiorze stanu o danej pozycji, węźle i początku słowa.
+	@param[in] set Zbiór.
+	@param[in] pos Pozycja w słowie.
+	@param[in] node Węzeł drzewa.
+	@param[in] start Początek bieżącego słowa.
+	@return Znaleziony stan, NULL jeśli go nie ma.
+ */
+struct state *state_set_find(const struct state_set *set, size_t pos,
+		const struct nodeInfo *node, const struct state *start);
+
+/**
+	Dodaje stan do zbioru.
+	Jeśli zbiór zawiera już równy stan o koszcie nie większym,
+	to nowy stan jest odrzucany.
+	@param[in,out] set Zbiór.
+	@param[in] state Dodawany stan.
+	@return true jeśli stan został dodany, false jeśli go odrzucono.
+ */
+bool state_set_add(struct state_set *set, struct state *state);
+
+/**
+	Usuwa wszystkie stany ze zbioru, zachowując rozmiar tablicy.
+	@param[in,out] set Zbiór.
+ */
+void state_set_clear(struct state_set *set);
+
+/**
+	Powiększa zbiór tak, żeby zmieścił size stanów bez powiększania tablicy.
+	@param[in,out] set Zbiór.
+	@param[in] size Liczba stanów.
+	@return true jeśli się udało, false jeśli zabrakło pamięci.
+ */
+bool state_set_reserve(struct state_set *set, size_t size);
+
+/**
+	Dodaje stan do zbioru, można ją wywoływać równocześnie z wielu wątków.
+	Zbiór nie jest powiększany, więc trzeba wcześniej zarezerwować
+	miejsce przez state_set_reserve(). Stan jest odrzucany, jeśli zbiór
+	zawiera równy stan o dowolnym koszcie, więc koszty dodawanych stanów
+	nie mogą być mniejsze niż koszty stanów zbioru.
+	@param[in,out] set Zbiór.
+	@param[in] state Dodawany stan.
+	@return true jeśli stan został dodany, false jeśli go odrzucono.
+ */
+bool state_set_add_shared(struct state_set *set, struct state *state);
+
+/**
+	Inicjuje pustą pamięć przejść.
+	Tablica jest przydzielana z areny przy pierwszym walk_memo_add()
+	i zwalniana razem z areną.
+	@param[out] memo Pamięć przejść.
+	@param[in,out] arena Arena.
+ */
+void walk_memo_init(struct walk_memo *memo, struct arena *arena);
+
+/**
+	Szuka przejścia od danej pozycji i węzła.
+	@param[in] memo Pamięć przejść.
+	@param[in] pos Pozycja w słowie.
+	@param[in] node Węzeł drzewa.
+	@return Znalezione przejście, ważne do następnego walk_memo_add(),
+	NULL jeśli go nie ma.
+ */
+struct walk *walk_memo_find(const struct walk_memo *memo, size_t pos,
+		const struct nodeInfo *node);
+
+/**
+	Zapamiętuje przejście od danej pozycji i węzła, którego jeszcze nie ma.
+	@param[in,out] memo Pamięć przejść.
+	@param[in] pos Pozycja w słowie.
 	@param[in] node Węzeł drzewa.
-	@param[in] prev Stan z którego przeszlismy.
-	@param[in] used_s Czy użyto reguły z flagą s.
+	@param[in] end Węzeł, na którym przejście się zatrzymało.
+	@param[in] len Liczba przejętych liter.
+	@return true jeśli się udało, false jeśli zabrakło pamięci.
+ */
+bool walk_memo_add(struct walk_memo *memo, size_t pos,
+		const struct nodeInfo *node, struct nodeInfo *end, size_t len);
+
+/**
+	Inicjuje pustą kolejkę stanów.
+	Kubełki są przydzielane z areny i zwalniane razem z nią.
+	@param[out] queue Kolejka.
+	@param[in] max_priority Największy priorytet.
+	@param[in,out] arena Arena.
+ */
+void state_queue_init(struct state_queue *queue, int max_priority,
+		struct arena *arena);
+
+/**
+	Wstawia stan do kolejki.
+	Priorytet nie może być mniejszy niż priorytet ostatnio wyjętego stanu.
+	@param[in,out] queue Kolejka.
+	@param[in] state Stan.
+	@param[in] priority Priorytet stanu.
+	@return true jeśli się udało, false jeśli priorytet jest za duży.
  */
-struct state *create_state(wchar_t *word, size_t pos, size_t length, int cost, wchar_t *change, struct nodeInfo *node, struct state *prev, int used_s);
+bool state_queue_push(struct state_queue *queue, struct state *state, int priority);
 
 /**
-	Usuwa strukturę state, czyści pamić.
-	@param[in] state Stan do usunięcia.
+	Wyjmuje z kolejki element o najmniejszym priorytecie.
+	Stany o równym priorytecie wychodzą w kolejności wstawienia.
+	@param[in,out] queue Kolejka.
+	@param[out] entry Wyjęty element.
+	@return true jeśli kolejka nie była pusta, false w p.p.
  */
-void delete_state(struct state *state);
+bool state_queue_pop(struct state_queue *queue, struct state_entry *entry);
 
 #endif /* RULES_LIST_H_ */
@@ -0,0 +1,147 @@
+/** @file
+ Implementacja śledzenia działania słownika.
+ Bufor jest tablicą TRACE_ENTRIES wpisów. Piszący rezerwuje kolejny
+ numer komunikatu atomowym zwiększeniem licznika, a wpis o numerze n
+ trafia na miejsce n % TRACE_ENTRIES. Na czas zapisu miejsce ma numer
+ TRACE_BUSY, a jeśli inny wątek właśnie pisze w tym samym miejscu, to
+ komunikat jest pomijany. Po zapisaniu treści wpis dostaje numer n + 1,
+ więc czytający rozpoznaje wpisy niedokończone lub nadpisane w trakcie
+ czytania i je pomija.
+
+ @ingroup dictionary
+ @author Maja Zalewska <mz336088@students.mimuw.edu.pl>
+ @copyright Uniwerstet Warszawski
+ @date 2015-06-19
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "trace.h"
+
+#define TRACE_ENTRIES	1024	///< Liczba pamiętanych komunikatów, potęga dwójki.
+#define TRACE_TEXT	120	///< Największa długość treści komunikatu.
+#define TRACE_BUSY	UINT64_MAX	///< Numer wpisu w trakcie zapisu.
+
+/// Wpis bufora śledzenia.
+struct trace_entry
+{
+	/// Numer komunikatu + 1, 0 dla pustego wpisu, TRACE_BUSY w trakcie zapisu.
+	uint64_t sequence;
+	enum trace_level level;	///< Poziom komunikatu.
+	const char *function;	///< Funkcja, z której pochodzi komunikat.
+	char text[TRACE_TEXT];	///< Treść komunikatu.
+};
+
+/// Największy poziom zapisywanych komunikatów.
+static enum trace_level max_level = TRACE_INFO;
+
+#if DICTIONARY_TRACE
+/// Nazwy poziomów komunikatów.
+static const char *level_names[] = { "error", "info", "debug" };
+/// Bufor cykliczny komunikatów.
+static struct trace_entry entries[TRACE_ENTRIES];
+/// Numer następnego komunikatu.
+static uint64_t next_entry = 0;
+#endif
+
+#if DICTIONARY_TRACE
+/** @name Funkcje pomocnicze
+ @{
+ */
+
+/**
+	Kopiuje treść komunikatu.
+	Wpis może być w tym czasie zapisywany przez inny wątek, dlatego
+	każdy znak czytamy i zapisujemy atomowo.
+	@param[out] to Miejsce docelowe.
+	@param[in] from Kopiowana treść.
+ */
+static void copy_text(char *to, const char *from)
+{
+	for (size_t i = 0; i < TRACE_TEXT; i++)
+	{
+		char ch = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+		__atomic_store_n(&to[i], ch, __ATOMIC_RELAXED);
+		if (ch == '\0')
+			break;
+	}
+}
+
+/// @}
+#endif
+
+/** @name Elementy interfejsu
+ @{
+ */
+
+void trace_write(enum trace_level level, const char *function,
+		const char *format, ...)
+{
+#if DICTIONARY_TRACE
+	if (level > __atomic_load_n(&max_level, __ATOMIC_RELAXED))
+		return;
+	char text[TRACE_TEXT];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(text, TRACE_TEXT, format, args);
+	va_end(args);
+	uint64_t number = __sync_fetch_and_add(&next_entry, 1);
+	struct trace_entry *entry = &entries[number & (TRACE_ENTRIES - 1)];
+	uint64_t sequence = __atomic_load_n(&entry->sequence, __ATOMIC_RELAXED);
+	if (sequence == TRACE_BUSY || !__atomic_compare_exchange_n(&entry->sequence,
+			&sequence, TRACE_BUSY, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		return;
+	__atomic_store_n(&entry->level, level, __ATOMIC_RELAXED);
+	__atomic_store_n(&entry->function, function, __ATOMIC_RELAXED);
+	copy_text(entry->text, text);
+	__atomic_store_n(&entry->sequence, number + 1, __ATOMIC_RELEASE);
+#endif
+}
+
+enum trace_level trace_set_level(enum trace_level level)
+{
+	return __atomic_exchange_n(&max_level, level, __ATOMIC_RELAXED);
+}
+
+size_t trace_dump(FILE *stream)
+{
+	size_t dumped = 0;
+#if DICTIONARY_TRACE
+	uint64_t end = __atomic_load_n(&next_entry, __ATOMIC_ACQUIRE);
+	uint64_t number = end > TRACE_ENTRIES ? end - TRACE_ENTRIES : 0;
+	for (; number < end; number++)
+	{
+		struct trace_entry *entry = &entries[number & (TRACE_ENTRIES - 1)];
+		struct trace_entry copy;
+		if (__atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE) != number + 1)
+			continue;
+		copy.level = __atomic_load_n(&entry->level, __ATOMIC_RELAXED);
+		copy.function = __atomic_load_n(&entry->function, __ATOMIC_RELAXED);
+		copy_text(copy.text, entry->text);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		// Wpis mógł zostać w tym czasie zarezerwowany przez nowszy komunikat.
+		if (__atomic_load_n(&entry->sequence, __ATOMIC_RELAXED) != number + 1
+				|| __atomic_load_n(&next_entry, __ATOMIC_RELAXED) > number + TRACE_ENTRIES)
+			continue;
+		copy.text[TRACE_TEXT - 1] = '\0';
+		fprintf(stream, "[%s] %s: %s\n", level_names[copy.level], copy.function,
+				copy.text);
+		dumped++;
+	}
+#endif
+	return dumped;
+}
+
+void trace_clear(void)
+{
+#if DICTIONARY_TRACE
+	memset(entries, 0, sizeof(entries));
+	next_entry = 0;
+#endif
+}
+
+/**
+ @}
+ */
@@ -0,0 +1,74 @@
+/** @file
+    Interfejs śledzenia działania słownika.
+    Komunikaty TRACE() trafiają do bufora cyklicznego w pamięci,
+    który można w dowolnej chwili wypisać przez trace_dump(). Gdy
+    DICTIONARY_TRACE jest równe 0 (wersja release), TRACE() nie
+    generuje żadnego kodu, a jego argumenty nie są obliczane.
+
+    @ingroup dictionary
+    @author Maja Zalewska <mz336088@students.mimuw.edu.pl>
+    @copyright Uniwerstet Warszawski
+    @date 2015-06-19
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "conf.h"
+#include <stdio.h>
+
+/// Poziom ważności komunikatu.
+enum trace_level
+{
+	TRACE_ERROR,	///< Błąd, np. niepoprawny plik.
+	TRACE_INFO,	///< Przebieg operacji na całym słowniku.
+	TRACE_DEBUG	///< Szczegóły pojedynczych zapytań.
+};
+
+#if DICTIONARY_TRACE
+/**
+	Zapisuje komunikat w buforze śledzenia.
+	Argumenty jak w printf(), słowa wypisujemy przez %ls.
+	@param[in] level Poziom komunikatu, enum trace_level.
+ */
+#define TRACE(level, ...)	trace_write(level, __func__, __VA_ARGS__)
+#else
+#define TRACE(level, ...)	((void) 0)
+#endif
+
+/**
+	Zapisuje komunikat w buforze śledzenia, jeśli jego poziom jest
+	nie większy niż ustawiony przez trace_set_level().
+	Można ją wywoływać równocześnie z wielu wątków, nie blokuje ich.
+	Zamiast niej należy używać TRACE().
+	@param[in] level Poziom komunikatu.
+	@param[in] function Nazwa funkcji, z której pochodzi komunikat.
+	@param[in] format Format komunikatu jak w printf().
+ */
+void trace_write(enum trace_level level, const char *function,
+		const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+/**
+	Ustawia największy poziom zapisywanych komunikatów.
+	Domyślnie TRACE_INFO.
+	@param[in] level Nowy poziom.
+	@return Dotychczasowy poziom.
+ */
+enum trace_level trace_set_level(enum trace_level level);
+
+/**
+	Wypisuje komunikaty z bufora, od najstarszego.
+	Bufor pamięta ostatnie TRACE_ENTRIES komunikatów (patrz trace.c).
+	Komunikaty zapisywane w trakcie wypisywania mogą zostać pominięte.
+	@param[in,out] stream Plik, do którego wypisujemy.
+	@return Liczba wypisanych komunikatów, 0 gdy śledzenie jest wyłączone.
+ */
+size_t trace_dump(FILE *stream);
+
+/**
+	Usuwa wszystkie komunikaty z bufora.
+	Nie można jej wywoływać równocześnie z trace_write().
+ */
+void trace_clear(void);
+
+#endif /* TRACE_H_ */
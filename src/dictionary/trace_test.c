@@ -0,0 +1,122 @@
+/** @file
+	Test do śledzenia działania słownika.
+	@ingroup tests
+	@date: 19 June 2015
+	@author: Maja Zalewska <mz336088@mimuw.edu.pl>
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <cmocka.h>
+#include "trace.h"
+
+#define THREADS	4	///< Liczba wątków piszących równocześnie.
+#define MESSAGES	1000	///< Liczba komunikatów każdego wątku.
+#define LINE	256	///< Rozmiar bufora na wiersz.
+
+/// Wypisuje bufor do pliku tymczasowego i ustawia go na początek.
+static FILE *dump(size_t *count)
+{
+	FILE *fp = tmpfile();
+	assert_non_null(fp);
+	*count = trace_dump(fp);
+	rewind(fp);
+	return fp;
+}
+
+/// Sprawdza zapisywanie komunikatów i ich poziomy.
+static void trace_level_test(void **state)
+{
+	char line[LINE];
+	size_t count;
+	trace_clear();
+	assert_int_equal(trace_set_level(TRACE_INFO), TRACE_INFO);
+	TRACE(TRACE_ERROR, "błąd %d", 1);
+	TRACE(TRACE_DEBUG, "pominięty");
+	TRACE(TRACE_INFO, "słowo %ls", L"kot");
+	FILE *fp = dump(&count);
+	assert_int_equal(count, 2);
+	assert_non_null(fgets(line, LINE, fp));
+	assert_string_equal(line, "[error] trace_level_test: błąd 1\n");
+	assert_non_null(fgets(line, LINE, fp));
+	assert_string_equal(line, "[info] trace_level_test: słowo kot\n");
+	fclose(fp);
+	assert_int_equal(trace_set_level(TRACE_DEBUG), TRACE_INFO);
+	TRACE(TRACE_DEBUG, "zapisany");
+	fclose(dump(&count));
+	assert_int_equal(count, 3);
+	trace_set_level(TRACE_INFO);
+}
+
+/// Sprawdza, czy bufor pamięta tylko najnowsze komunikaty.
+static void trace_overflow_test(void **state)
+{
+	char line[LINE];
+	size_t count;
+	trace_clear();
+	for (int i = 0; i < 3000; i++)
+		TRACE(TRACE_INFO, "%d", i);
+	FILE *fp = dump(&count);
+	assert_true(count > 0 && count < 3000);
+	for (size_t i = 0; i < count; i++)
+	{
+		char expected[LINE];
+		snprintf(expected, LINE, "[info] trace_overflow_test: %zu\n", 3000 - count + i);
+		assert_non_null(fgets(line, LINE, fp));
+		assert_string_equal(line, expected);
+	}
+	fclose(fp);
+}
+
+/// Zapisuje komunikaty z jednego wątku.
+static void *writer(void *arg)
+{
+	for (int i = 0; i < MESSAGES; i++)
+		TRACE(TRACE_INFO, "wątek %d: %d", *(int *) arg, i);
+	return NULL;
+}
+
+/// Sprawdza równoczesne zapisywanie z wielu wątków.
+static void trace_threads_test(void **state)
+{
+	pthread_t ids[THREADS];
+	int numbers[THREADS];
+	char line[LINE];
+	size_t count;
+	trace_clear();
+	for (int i = 0; i < THREADS; i++)
+	{
+		numbers[i] = i;
+		assert_int_equal(pthread_create(&ids[i], NULL, writer, &numbers[i]), 0);
+	}
+	for (int i = 0; i < THREADS; i++)
+		pthread_join(ids[i], NULL);
+	FILE *fp = dump(&count);
+	assert_true(count > 0);
+	for (size_t i = 0; i < count; i++)
+	{
+		int thread, message;
+		assert_non_null(fgets(line, LINE, fp));
+		assert_int_equal(sscanf(line, "[info] writer: wątek %d: %d", &thread, &message), 2);
+		assert_true(thread >= 0 && thread < THREADS);
+		assert_true(message >= 0 && message < MESSAGES);
+	}
+	fclose(fp);
+}
+
+/// Wywołuje testy.
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(trace_level_test),
+		cmocka_unit_test(trace_overflow_test),
+		cmocka_unit_test(trace_threads_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -11,9 +11,391 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "trie.h"
 #include "utils.h"
 
+#define END_CHILDREN	'#'	///< Znak kończący zapis dzieci węzła w obrazie pliku.
+#define OFFSETS_BEGIN	'@'	///< Znak rozpoczynający tablicę przesunięć poddrzew.
+#define MAX_THREADS	16	///< Maksymalna liczba wątków zapisu i odczytu.
+#define NUMBER_LENGTH	24	///< Długość bufora na zapis liczby.
+
+/// Bufor w pamięci, do którego zapisywane jest poddrzewo.
+struct save_buffer
+{
+	char *data;	///< Zapisane bajty.
+	size_t size;	///< Liczba zapisanych bajtów.
+	size_t capacity;	///< Rozmiar bufora.
+	mbstate_t ps;	///< Stan konwersji znaków.
+	bool failed;	///< Czy zapis się nie powiódł.
+};
+
+/// Wspólny stan wątków zapisujących poddrzewa dzieci korzenia.
+struct save_job
+{
+	vector *children;	///< Dzieci korzenia.
+	struct save_buffer *buffers;	///< Bufory kolejnych dzieci.
+	int count;	///< Liczba dzieci.
+	int next;	///< Pierwsze nieprzydzielone dziecko.
+};
+
+/// Wspólny stan wątków wczytujących poddrzewa dzieci korzenia.
+struct load_job
+{
+	struct nodeInfo *root;	///< Korzeń drzewa.
+	const char *text;	///< Początek zapisu dzieci korzenia.
+	const size_t *offsets;	///< Przesunięcia zapisów kolejnych dzieci.
+	int depth;	///< Liczba wczytywanych poziomów, jak w trie_image_load().
+	vectorItem **items;	///< Wczytane dzieci.
+	int count;	///< Liczba dzieci.
+	int next;	///< Pierwsze nieprzydzielone dziecko.
+	int failed;	///< Czy któryś zapis był niepoprawny.
+};
+
+/// Chroni wczytywanie niewczytanych poddrzew przez trie_children().
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** @name Funkcje pomocnicze
+ @{
+ */
+
+/**
+	Wczytuje kolejny znak z obrazu pliku.
+	@param[in] text Początek znaku.
+	@param[in] end Koniec obrazu.
+	@param[out] symbol Wczytany znak, może być NULL.
+	@param[in,out] ps Stan konwersji.
+	@return Długość znaku w bajtach, 0 jeśli znak jest niepoprawny.
+ */
+static size_t image_symbol(const char *text, const char *end, wchar_t *symbol,
+		mbstate_t *ps)
+{
+	size_t len = mbrtowc(symbol, text, end - text, ps);
+	if (len == 0 || len == (size_t) -1 || len == (size_t) -2)
+		return 0;
+	return len;
+}
+
+/**
+	Dopisuje cyfrę do częstości słowa.
+	Za duże częstości są obcinane do UINT32_MAX.
+	@param[in] frequency Częstość wczytana z poprzednich cyfr.
+	@param[in] digit Kolejna cyfra.
+	@return Częstość po dopisaniu cyfry.
+ */
+static uint32_t add_digit(uint32_t frequency, int digit)
+{
+	if (frequency > (UINT32_MAX - digit) / 10)
+		return UINT32_MAX;
+	return 10 * frequency + digit;
+}
+
+/**
+	Pomija zapis poddrzewa bez tworzenia węzłów.
+	@param[in] text Początek zapisu dzieci węzła.
+	@param[in] end Koniec obrazu pliku.
+	@return Wskaźnik za zapisem poddrzewa, NULL jeśli zapis jest niepoprawny.
+ */
+static const char *image_skip(const char *text, const char *end)
+{
+	mbstate_t ps;
+	memset(&ps, 0, sizeof(ps));
+	int depth = 1;
+	while (text < end)
+	{
+		if (*text == END_CHILDREN)
+		{
+			text++;
+			if (--depth == 0)
+				return text;
+		}
+		else if (*text >= '0' && *text <= '9')
+			text++;
+		else
+		{
+			size_t len = image_symbol(text, end, NULL, &ps);
+			if (len == 0)
+				return NULL;
+			text += len;
+			depth++;
+		}
+	}
+	return NULL;
+}
+
+/**
+	Wczytuje dziecko węzła z obrazu pliku razem z jego poddrzewem.
+	@param[in] node Rodzic wczytywanego dziecka.
+	@param[in] text Początek zapisu dziecka.
+	@param[in] end Koniec obrazu pliku.
+	@param[in] depth Liczba wczytywanych poziomów, jak w trie_image_load().
+	@param[in,out] ps Stan konwersji.
+	@param[out] item Utworzone dziecko, NULL jeśli litera jest niepoprawna.
+	Dziecko należy dodać do węzła także wtedy, gdy zapis poddrzewa
+	jest niepoprawny, żeby zostało zwolnione razem z drzewem.
+	@return Wskaźnik za zapisem dziecka, NULL jeśli zapis jest niepoprawny.
+ */
+static const char *image_entry(struct nodeInfo *node, const char *text,
+		const char *end, int depth, mbstate_t *ps, vectorItem **item)
+{
+	wchar_t symbol;
+	size_t len = image_symbol(text, end, &symbol, ps);
+	*item = NULL;
+	if (len == 0)
+		return NULL;
+	text += len;
+	int number = MID_NODE;
+	uint32_t frequency = DEFAULT_FREQUENCY;
+	if (text < end && *text >= '0' && *text <= '9')
+	{
+		number = WORD;
+		frequency = 0;
+		while (text < end && *text >= '0' && *text <= '9')
+			frequency = add_digit(frequency, *text++ - '0');
+	}
+	struct nodeInfo *child = trie_create_nodeInfo(number, node);
+	child->frequency = frequency;
+	*item = create_vectorItem(child, symbol);
+	if (depth == 1)
+	{
+		child->pending = malloc(sizeof(struct trie_pending));
+		child->pending->text = text;
+		child->pending->end = end;
+		child->pending->failed = false;
+		return image_skip(text, end);
+	}
+	text = trie_image_load(child, text, end, depth > 0 ? depth - 1 : 0);
+	trie_update_bounds(child);
+	return text;
+}
+
+/**
+	Wczytuje liczbę z obrazu pliku, pomijając poprzedzające spacje.
+	@param[in,out] text Początek liczby, przesuwany za jej koniec.
+	@param[in] end Koniec obrazu pliku.
+	@param[out] value Wczytana liczba.
+	@return true jeśli wczytano liczbę, false w p.p.
+ */
+static bool image_number(const char **text, const char *end, size_t *value)
+{
+	while (*text < end && **text == ' ')
+		(*text)++;
+	if (*text == end || **text < '0' || **text > '9')
+		return false;
+	*value = 0;
+	while (*text < end && **text >= '0' && **text <= '9')
+		*value = 10 * *value + (*(*text)++ - '0');
+	return true;
+}
+
+/**
+	Szuka tablicy przesunięć poddrzew dzieci korzenia na końcu obrazu.
+	Tablica ma postać "@n p0 p1 ... pn\n", gdzie pi to przesunięcie zapisu
+	i-tego dziecka względem początku zapisu dzieci korzenia, a pn to
+	przesunięcie znaku kończącego zapis korzenia.
+	@param[in] text Początek zapisu dzieci korzenia.
+	@param[in] end Koniec obrazu pliku.
+	@param[out] count Liczba dzieci korzenia.
+	@return Tablica count + 1 przesunięć, NULL jeśli obraz jej nie zawiera.
+ */
+static size_t *image_offsets(const char *text, const char *end, int *count)
+{
+	const char *table = end;
+	while (table > text && table[-1] != OFFSETS_BEGIN)
+	{
+		char c = table[-1];
+		if (c != ' ' && c != '\n' && (c < '0' || c > '9'))
+			return NULL;
+		table--;
+	}
+	if (table - text < 2 || table[-2] != END_CHILDREN)
+		return NULL;
+	size_t children;
+	size_t root_end = table - 2 - text;
+	if (!image_number(&table, end, &children) || children > root_end)
+		return NULL;
+	size_t *offsets = malloc(sizeof(size_t) * (children + 1));
+	for (size_t i = 0; i <= children; i++)
+		if (!image_number(&table, end, &offsets[i])
+				|| (i == 0 ? offsets[i] != 0 : offsets[i] <= offsets[i - 1]))
+		{
+			free(offsets);
+			return NULL;
+		}
+	if (offsets[children] != root_end)
+	{
+		free(offsets);
+		return NULL;
+	}
+	*count = (int) children;
+	return offsets;
+}
+
+/**
+	Wykonuje pracę na count elementach w kilku wątkach.
+	Bieżący wątek również wykonuje pracę.
+	@param[in] worker Funkcja wątku, sama przydziela sobie elementy.
+	@param[in,out] job Wspólny stan wątków.
+	@param[in] count Liczba elementów.
+ */
+static void run_threads(void *(*worker)(void *), void *job, int count)
+{
+	pthread_t ids[MAX_THREADS];
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int threads = cpus > MAX_THREADS ? MAX_THREADS : (cpus > 0 ? (int) cpus : 1);
+	if (threads > count)
+		threads = count > 0 ? count : 1;
+	int started = 0;
+	while (started + 1 < threads
+			&& pthread_create(&ids[started], NULL, worker, job) == 0)
+		started++;
+	worker(job);
+	for (int i = 0; i < started; i++)
+		pthread_join(ids[i], NULL);
+}
+
+/**
+	Zapewnia miejsce w buforze.
+	@param[in,out] buf Bufor.
+	@param[in] len Liczba potrzebnych bajtów.
+	@return true jeśli jest miejsce, false jeśli zabrakło pamięci.
+ */
+static bool buffer_reserve(struct save_buffer *buf, size_t len)
+{
+	if (buf->failed)
+		return false;
+	if (buf->size + len > buf->capacity)
+	{
+		size_t capacity = 2 * (buf->size + len);
+		char *data = realloc(buf->data, capacity);
+		if (data == NULL)
+		{
+			buf->failed = true;
+			return false;
+		}
+		buf->data = data;
+		buf->capacity = capacity;
+	}
+	return true;
+}
+
+/**
+	Zapisuje do bufora literę prowadzącą do węzła,
+	a jeśli węzeł kończy słowo, to także częstość słowa.
+	@param[in,out] buf Bufor.
+	@param[in] symbol Litera.
+	@param[in] node Węzeł.
+ */
+static void buffer_symbol(struct save_buffer *buf, wchar_t symbol,
+		const struct nodeInfo *node)
+{
+	if (!buffer_reserve(buf, MB_CUR_MAX + NUMBER_LENGTH))
+		return;
+	size_t len = wcrtomb(buf->data + buf->size, symbol, &buf->ps);
+	if (len == (size_t) -1)
+	{
+		buf->failed = true;
+		return;
+	}
+	buf->size += len;
+	if (node->number == WORD)
+		buf->size += snprintf(buf->data + buf->size, NUMBER_LENGTH, "%" PRIu32,
+				node->frequency);
+}
+
+/**
+	Zapisuje do bufora dzieci węzła, w formacie trie_dfs_save().
+	@param[in] node Węzeł.
+	@param[in,out] buf Bufor.
+ */
+static void buffer_subtree(struct nodeInfo *node, struct save_buffer *buf)
+{
+	vector *children = trie_children(node);
+	// Zapisanie pustych dzieci zamiast niepoprawnych gubiłoby słowa.
+	if (trie_load_failed(node))
+		buf->failed = true;
+	for (int i = 0; i < size(children) && !buf->failed; i++)
+	{
+		vectorItem *item = at_pos(children, i);
+		buffer_symbol(buf, item->symbol, item->node);
+		buffer_subtree(item->node, buf);
+	}
+	if (buffer_reserve(buf, 1))
+		buf->data[buf->size++] = END_CHILDREN;
+}
+
+/**
+	Zapisuje do buforów kolejne nieprzydzielone dzieci korzenia.
+	@param[in,out] arg Wspólny stan wątków, struct save_job.
+	@return NULL.
+ */
+static void *save_worker(void *arg)
+{
+	struct save_job *job = arg;
+	int i;
+	while ((i = __sync_fetch_and_add(&job->next, 1)) < job->count)
+	{
+		vectorItem *item = at_pos(job->children, i);
+		buffer_symbol(&job->buffers[i], item->symbol, item->node);
+		buffer_subtree(item->node, &job->buffers[i]);
+	}
+	return NULL;
+}
+
+/**
+	Wczytuje kolejne nieprzydzielone dzieci korzenia.
+	@param[in,out] arg Wspólny stan wątków, struct load_job.
+	@return NULL.
+ */
+static void *load_worker(void *arg)
+{
+	struct load_job *job = arg;
+	int i;
+	while ((i = __sync_fetch_and_add(&job->next, 1)) < job->count)
+	{
+		const char *begin = job->text + job->offsets[i];
+		const char *end = job->text + job->offsets[i + 1];
+		mbstate_t ps;
+		memset(&ps, 0, sizeof(ps));
+		if (image_entry(job->root, begin, end, job->depth, &ps,
+				&job->items[i]) != end)
+			__sync_fetch_and_or(&job->failed, 1);
+	}
+	return NULL;
+}
+
+/**
+	Zapisuje tablicę przesunięć poddrzew dzieci korzenia.
+	@param[in] buffers Bufory kolejnych dzieci.
+	@param[in] count Liczba dzieci.
+	@param[in,out] stream Plik, do którego zapisywany jest słownik.
+	@return 0 jeżeli zapisanie się powiedzie, -1 w p.p.
+ */
+static int save_offsets(const struct save_buffer *buffers, int count,
+		FILE *stream)
+{
+	char number[NUMBER_LENGTH];
+	snprintf(number, sizeof(number), "%c%d", OFFSETS_BEGIN, count);
+	if (fputs(number, stream) == EOF)
+		return -1;
+	size_t offset = 0;
+	for (int i = 0; i <= count; i++)
+	{
+		snprintf(number, sizeof(number), " %zu", offset);
+		if (fputs(number, stream) == EOF)
+			return -1;
+		if (i < count)
+			offset += buffers[i].size;
+	}
+	return fputc('\n', stream) == EOF ? -1 : 0;
+}
+
+/// @}
+
 /** @name Elementy interfejsu
  @{
  */
@@ -24,6 +406,11 @@ struct nodeInfo *trie_create_nodeInfo(int num, struct nodeInfo *parent)
 	node->children = init();
 	node->parent = parent;
 	node->number = num;
+	node->frequency = DEFAULT_FREQUENCY;
+	node->pending = NULL;
+	node->min_depth = 0;
+	node->max_depth = TRIE_UNBOUNDED;
+	node->letters = ~UINT64_C(0);
 	return node;
 }
 
@@ -33,6 +420,8 @@ struct nodeInfo *trie_delete_node(struct nodeInfo *node)
 	{
 		node->children = delete_all(node->children);
 		node->children = NULL;
+		free(node->pending);
+		node->pending = NULL;
 		free(node);
 		node = NULL;
 	}
@@ -53,6 +442,39 @@ struct nodeInfo *trie_clear(struct nodeInfo *node)
 	return node;
 }
 
+struct nodeInfo *trie_copy(struct nodeInfo *node, struct nodeInfo *parent)
+{
+	struct nodeInfo *copy = trie_create_nodeInfo(node->number, parent);
+	copy->frequency = node->frequency;
+	if (__atomic_load_n(&node->pending, __ATOMIC_ACQUIRE) != NULL)
+	{
+		// Inny wątek może właśnie wczytywać te dzieci.
+		pthread_mutex_lock(&pending_lock);
+		if (node->pending != NULL)
+		{
+			copy->pending = malloc(sizeof(struct trie_pending));
+			*copy->pending = *node->pending;
+		}
+		pthread_mutex_unlock(&pending_lock);
+		if (copy->pending != NULL)
+		{
+			trie_update_bounds(copy);
+			return copy;
+		}
+	}
+	copy->min_depth = node->min_depth;
+	copy->max_depth = node->max_depth;
+	copy->letters = node->letters;
+	reserve(copy->children, size(node->children));
+	for (int i = 0; i < size(node->children); i++)
+	{
+		vectorItem *item = at_pos(node->children, i);
+		push_back(copy->children,
+				create_vectorItem(trie_copy(item->node, copy), item->symbol));
+	}
+	return copy;
+}
+
 int trie_insert(struct nodeInfo *node, const wchar_t *word, vector *alphabet)
 {
 	if (trie_find(node, word) || node == NULL)
@@ -62,7 +484,7 @@ int trie_insert(struct nodeInfo *node, const wchar_t *word, vector *alphabet)
 	bool found = false;
 	while ((i < length) && (!found))
 	{
-		if (at(node->children, word[i]) != NULL)
+		if (at(trie_children(node), word[i]) != NULL)
 		{
 			node = at(node->children, word[i])->node;
 			if (node != NULL)
@@ -82,28 +504,36 @@ int trie_insert(struct nodeInfo *node, const wchar_t *word, vector *alphabet)
 		i++;
 	}
 	node->number = WORD;
+	node->frequency = DEFAULT_FREQUENCY;
+	for (; node != NULL; node = node->parent)
+		trie_update_bounds(node);
 	return 1;
 }
 
 bool trie_find(struct nodeInfo *node, const wchar_t *word)
+{
+	return trie_find_word(node, word) != NULL;
+}
+
+struct nodeInfo *trie_find_word(struct nodeInfo *node, const wchar_t *word)
 {
 	if (node == NULL)
-		return false;
+		return NULL;
 	int i = 0;
 	int length = wcslen(word);
 	vectorItem *vecItm;
 	while (i < length)
 	{
-		vecItm = at(node->children, word[i]);
+		vecItm = at(trie_children(node), word[i]);
 		if (vecItm != NULL)
 			node = vecItm->node;
 		else
-			return false;
+			return NULL;
 		i++;
 	}
 	if (node->number == WORD)
-		return true;
-	return false;
+		return node;
+	return NULL;
 }
 
 void trie_clear_path(struct nodeInfo *node, const wchar_t *word, int *i,
@@ -114,14 +544,14 @@ void trie_clear_path(struct nodeInfo *node, const wchar_t *word, int *i,
 		int index = *i;
 		++(*i);
 		if (word[index] != L'\0' && *success == 0)
-			trie_clear_path(at(node->children, word[index])->node, word, i,
+			trie_clear_path(at(trie_children(node), word[index])->node, word, i,
 					success);
 		if (node->number == WORD && word[index] == L'\0')
 			*success = 1;
 		*i = index;
 		if (*i > 0)
 		{
-			if (size(node->children) == 0)
+			if (size(trie_children(node)) == 0)
 			{
 				delete(node->parent->children, word[--(*i)]);
 				trie_delete_node(node);
@@ -130,9 +560,12 @@ void trie_clear_path(struct nodeInfo *node, const wchar_t *word, int *i,
 			{
 				if ((*i) == wcslen(word))
 					node->number = MID_NODE;
+				trie_update_bounds(node);
 				--(*i);
 			}
 		}
+		else
+			trie_update_bounds(node);
 	}
 }
 
@@ -140,13 +573,14 @@ int trie_dfs_save(struct nodeInfo *node, FILE* stream)
 {
 	if (node != NULL)
 	{
-		int children = size(node->children);
+		int children = size(trie_children(node));
+		if (trie_load_failed(node))
+			return -1;
 		vectorItem *vItm;
 		int i;
 		int number = node->number;
 		if (number == ROOT)
 			fprintf(stream, "%d", node->number);
-		node->number = DONE;
 		for (i = 0; i < children; i++)
 		{
 			vItm = at_pos(node->children, i);
@@ -160,11 +594,12 @@ int trie_dfs_save(struct nodeInfo *node, FILE* stream)
 			}
 			else if (vItm->node->number == WORD)
 			{
-				if (fprintf(stream, "%lc%d", vItm->symbol, number) < 0)
+				if (fprintf(stream, "%lc%" PRIu32, vItm->symbol,
+						vItm->node->frequency) < 0)
 					return -1;
 			}
-			if (vItm->node->number != DONE)
-				trie_dfs_save(vItm->node, stream);
+			if (trie_dfs_save(vItm->node, stream) != 0)
+				return -1;
 		}
 		if (fprintf(stream, "#") < 0)
 			return -1;
@@ -172,6 +607,31 @@ int trie_dfs_save(struct nodeInfo *node, FILE* stream)
 	return 0;
 }
 
+int trie_parallel_save(struct nodeInfo *root, FILE *stream, bool offsets)
+{
+	struct save_job job;
+	job.children = trie_children(root);
+	if (trie_load_failed(root))
+		return -1;
+	job.count = size(job.children);
+	job.next = 0;
+	job.buffers = calloc(job.count + 1, sizeof(struct save_buffer));
+	run_threads(save_worker, &job, job.count);
+	int result = fputc('0' + ROOT, stream) == EOF ? -1 : 0;
+	for (int i = 0; i < job.count && result == 0; i++)
+		if (job.buffers[i].failed || fwrite(job.buffers[i].data, 1,
+				job.buffers[i].size, stream) != job.buffers[i].size)
+			result = -1;
+	if (result == 0 && fputc(END_CHILDREN, stream) == EOF)
+		result = -1;
+	if (result == 0 && offsets)
+		result = save_offsets(job.buffers, job.count, stream);
+	for (int i = 0; i < job.count; i++)
+		free(job.buffers[i].data);
+	free(job.buffers);
+	return result;
+}
+
 void trie_dfs_load(struct nodeInfo *node, FILE *stream, wchar_t last)
 {
 	wchar_t ch;
@@ -181,26 +641,219 @@ void trie_dfs_load(struct nodeInfo *node, FILE *stream, wchar_t last)
 	while (last != END_DFS
 			|| ((ch = fgetwc(stream)) != EOF && ch != L'#' && !iswdigit(ch)))
 	{
-		struct nodeInfo *child;
 		num = fgetwc(stream);
+		struct nodeInfo *child = trie_create_nodeInfo(
+				iswdigit(num) ? WORD : MID_NODE, node);
 		if (iswdigit(num))
 		{
-			last = END_DFS;
-			child = trie_create_nodeInfo(WORD, node);
-		}
-		else if (num == EOF || num == L'#')
-			last = END_DFS;
-		else
-		{
-			last = num;
-			child = trie_create_nodeInfo(MID_NODE, node);
+			child->frequency = 0;
+			while (iswdigit(num))
+			{
+				child->frequency = add_digit(child->frequency, num - L'0');
+				num = fgetwc(stream);
+			}
 		}
 		vectorItem *vItem = create_vectorItem(child, ch);
 		insert(node->children, vItem, NULL);
-		if (last != EOF)
-			trie_dfs_load(child, stream, last);
+		// Za literą i częstością jest litera dziecka albo koniec dzieci.
+		if (num != EOF && num != L'#')
+			trie_dfs_load(child, stream, num);
+		else
+			trie_update_bounds(child);
 		last = END_DFS;
 	}
+	trie_update_bounds(node);
+}
+
+const char *trie_image_load(struct nodeInfo *node, const char *text,
+		const char *end, int depth)
+{
+	mbstate_t ps;
+	memset(&ps, 0, sizeof(ps));
+	while (text < end && *text != END_CHILDREN)
+	{
+		vectorItem *item;
+		text = image_entry(node, text, end, depth, &ps, &item);
+		if (item != NULL)
+			insert(node->children, item, NULL);
+		if (text == NULL)
+			return NULL;
+	}
+	if (text >= end)
+		return NULL;
+	return text + 1;
+}
+
+const char *trie_image_load_parallel(struct nodeInfo *node, const char *text,
+		const char *end, int depth)
+{
+	struct load_job job;
+	size_t *offsets = image_offsets(text, end, &job.count);
+	if (offsets == NULL)
+	{
+		text = trie_image_load(node, text, end, depth);
+		trie_update_bounds(node);
+		return text;
+	}
+	job.root = node;
+	job.text = text;
+	job.offsets = offsets;
+	job.depth = depth;
+	job.items = calloc(job.count + 1, sizeof(vectorItem *));
+	job.next = 0;
+	job.failed = 0;
+	run_threads(load_worker, &job, job.count);
+	reserve(node->children, job.count);
+	for (int i = 0; i < job.count; i++)
+		if (job.items[i] != NULL)
+			insert(node->children, job.items[i], NULL);
+	trie_update_bounds(node);
+	const char *result = job.failed ? NULL : text + offsets[job.count] + 1;
+	free(job.items);
+	free(offsets);
+	return result;
+}
+
+vector *trie_children(struct nodeInfo *node)
+{
+	// Inny wątek widzi pending == NULL dopiero po wczytaniu wszystkich dzieci.
+	if (__atomic_load_n(&node->pending, __ATOMIC_ACQUIRE) != NULL)
+	{
+		pthread_mutex_lock(&pending_lock);
+		struct trie_pending *pending = node->pending;
+		if (pending != NULL && !pending->failed)
+		{
+			if (trie_image_load(node, pending->text, pending->end, 0) != NULL)
+			{
+				__atomic_store_n(&node->pending, NULL, __ATOMIC_RELEASE);
+				free(pending);
+			}
+			else
+			{
+				// Częściowo wczytane dzieci usuwamy, węzeł pamięta błąd.
+				for (int i = 0; i < size(node->children); i++)
+					trie_clear(at_pos(node->children, i)->node);
+				delete_all(node->children);
+				node->children = init();
+				pending->failed = true;
+			}
+		}
+		pthread_mutex_unlock(&pending_lock);
+	}
+	return node->children;
+}
+
+bool trie_load_failed(const struct nodeInfo *node)
+{
+	const struct trie_pending *pending =
+			__atomic_load_n(&node->pending, __ATOMIC_ACQUIRE);
+	return pending != NULL && pending->failed;
+}
+
+void trie_update_bounds(struct nodeInfo *node)
+{
+	if (node->pending != NULL)
+	{
+		node->min_depth = 0;
+		node->max_depth = TRIE_UNBOUNDED;
+		node->letters = ~UINT64_C(0);
+		return;
+	}
+	node->min_depth = node->number == WORD ? 0 : TRIE_UNBOUNDED;
+	node->max_depth = 0;
+	node->letters = 0;
+	for (int i = 0; i < size(node->children); i++)
+	{
+		vectorItem *item = at_pos(node->children, i);
+		const struct nodeInfo *child = item->node;
+		node->letters |= TRIE_LETTER(item->symbol) | child->letters;
+		if (child->min_depth != TRIE_UNBOUNDED && child->min_depth + 1 < node->min_depth)
+			node->min_depth = child->min_depth + 1;
+		if (child->max_depth == TRIE_UNBOUNDED)
+			node->max_depth = TRIE_UNBOUNDED;
+		else if (node->max_depth != TRIE_UNBOUNDED && child->max_depth + 1 > node->max_depth)
+			node->max_depth = child->max_depth + 1;
+	}
+}
+
+void trie_builder_init(struct trie_builder *builder, struct nodeInfo *root)
+{
+	builder->capacity = ONE_LETTER_STRING;
+	builder->path = malloc(sizeof(struct nodeInfo *) * builder->capacity);
+	builder->symbols = malloc(sizeof(wchar_t) * builder->capacity);
+	builder->path[0] = root;
+	builder->depth = 0;
+}
+
+void trie_builder_add(struct trie_builder *builder, const wchar_t *word,
+		size_t len, uint32_t frequency)
+{
+	if (len + 1 > builder->capacity)
+	{
+		builder->capacity = 2 * (len + 1);
+		builder->path = realloc(builder->path,
+				sizeof(struct nodeInfo *) * builder->capacity);
+		builder->symbols = realloc(builder->symbols,
+				sizeof(wchar_t) * builder->capacity);
+	}
+	size_t common = 0;
+	while (common < len && common < builder->depth
+			&& builder->symbols[common] == word[common])
+		common++;
+	// Poddrzewa węzłów poza wspólnym prefiksem są już kompletne.
+	for (size_t i = builder->depth; i > common; i--)
+		trie_update_bounds(builder->path[i]);
+	for (size_t i = common; i < len; i++)
+	{
+		struct nodeInfo *parent = builder->path[i];
+		struct nodeInfo *child = trie_create_nodeInfo(MID_NODE, parent);
+		push_back(parent->children, create_vectorItem(child, word[i]));
+		builder->path[i + 1] = child;
+		builder->symbols[i] = word[i];
+	}
+	builder->depth = len;
+	if (len > 0)
+	{
+		builder->path[len]->number = WORD;
+		builder->path[len]->frequency = frequency;
+	}
+}
+
+void trie_builder_done(struct trie_builder *builder)
+{
+	for (size_t i = builder->depth + 1; i-- > 0; )
+		trie_update_bounds(builder->path[i]);
+	free(builder->path);
+	free(builder->symbols);
+	builder->path = NULL;
+	builder->symbols = NULL;
+	builder->depth = 0;
+	builder->capacity = 0;
+}
+
+int trie_load_all(struct nodeInfo *node)
+{
+	vector *children = trie_children(node);
+	int result = trie_load_failed(node) ? -1 : 0;
+	for (int i = 0; i < size(children); i++)
+		if (trie_load_all(at_pos(children, i)->node) != 0)
+			result = -1;
+	return result;
+}
+
+void trie_stats(struct nodeInfo *node, size_t *nodes, size_t *pending,
+		size_t *bytes)
+{
+	if (node == NULL)
+		return;
+	(*nodes)++;
+	if (node->pending != NULL)
+		(*pending)++;
+	*bytes += sizeof(struct nodeInfo) + sizeof(vector)
+			+ sizeof(vectorItem *) * node->children->limit
+			+ sizeof(vectorItem) * node->children->size;
+	for (int i = 0; i < size(node->children); i++)
+		trie_stats(at_pos(node->children, i)->node, nodes, pending, bytes);
 }
 /**
  @}
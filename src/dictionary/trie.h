@@ -12,6 +12,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "vector.h"
 
 
@@ -21,18 +22,58 @@
 #define MID_NODE  -1	///< Wartość dla węzła niekończącego słowa.
 #define ROOT	0	///< Wartość dla korzenia.
 #define WORD	1	///< Wartość dla węzła kończącego słowo.
-#define DONE	2	///< Wartość węzła ustawiana podczas DFSa zapisującego słownik.
 #define END_DFS	L'2'	///< Kod oznaczający koniec wywołania DFS_LOAD.
+#define DEFAULT_FREQUENCY	1	///< Częstość słowa, dla którego jej nie podano.
+#define TRIE_UNBOUNDED	UINT32_MAX	///< Długość nieograniczona albo brak słowa w poddrzewie.
+/// Bit litery w masce liter poddrzewa, różne litery mogą mieć ten sam bit.
+#define TRIE_LETTER(symbol)	(UINT64_C(1) << ((uint32_t) (symbol) % 64))
 
 
+/**
+	Niewczytane jeszcze poddrzewo węzła.
+	Wskazuje fragment obrazu pliku słownika, z którego dzieci węzła
+	zostaną utworzone przy pierwszym odwołaniu, patrz trie_children().
+ */
+struct trie_pending
+{
+	const char *text;	///< Początek zapisu dzieci węzła w obrazie pliku.
+	const char *end;	///< Koniec obrazu pliku.
+	bool failed;	///< Czy zapis okazał się niepoprawny, wtedy dzieci nie ma.
+};
+
 /**
 	Struktura reprezentująca węzeł w słowniku.
+	Ograniczenia poddrzewa opisują słowa kończące się w węźle i poniżej,
+	długości liczymy od węzła. Są to przybliżenia: usunięcie słowa ich
+	nie zawęża, a węzeł o niewczytanych dzieciach ma ograniczenia
+	nieznane (0, TRIE_UNBOUNDED i wszystkie litery), tak jak każdy nowy
+	węzeł, dopóki nie wywołamy dla niego trie_update_bounds().
  */
 struct nodeInfo
 {
 	vector *children; ///< Dzieci węzła.
 	struct nodeInfo *parent; ///< Wskaźnik na rodzica.
 	int number;	///< Numer słowa, bądź -1 jeżeli węzeł środkowy.
+	uint32_t frequency;	///< Częstość słowa kończącego się w węźle.
+	struct trie_pending *pending;	///< Niewczytane dzieci węzła, NULL jeśli wczytane.
+	/// Nie większa niż najmniejsza długość słowa poddrzewa, TRIE_UNBOUNDED jeśli słów nie ma.
+	uint32_t min_depth;
+	/// Nie mniejsza niż największa długość słowa poddrzewa, TRIE_UNBOUNDED jeśli nieznana.
+	uint32_t max_depth;
+	uint64_t letters;	///< Maska TRIE_LETTER() liter na krawędziach poddrzewa.
+};
+
+/**
+	Budowniczy drzewa z posortowanych słów.
+	Kolejne słowa muszą być rosnące w porządku liter dzieci węzłów,
+	wtedy każdą nową literę wystarczy dopisać na koniec dzieci węzła.
+ */
+struct trie_builder
+{
+	struct nodeInfo **path;	///< Węzły na ścieżce ostatnio dodanego słowa.
+	wchar_t *symbols;	///< Litery ostatnio dodanego słowa.
+	size_t depth;	///< Długość ostatnio dodanego słowa.
+	size_t capacity;	///< Rozmiar tablic path i symbols.
 };
 
 /**
@@ -58,8 +99,20 @@ struct nodeInfo *trie_delete_node(struct nodeInfo *node);
  */
 struct nodeInfo *trie_clear(struct nodeInfo *node);
 
+/**
+	Kopiuje poddrzewo.
+	Niewczytane dzieci nie są wczytywane, kopia wskazuje ten sam fragment
+	obrazu pliku. Oryginał może być w tym czasie czytany, także przez
+	trie_children(), w innych wątkach, ale nie zmieniany.
+	@param[in] node Korzeń kopiowanego poddrzewa.
+	@param[in] parent Rodzic kopii.
+	@return Kopia poddrzewa.
+ */
+struct nodeInfo *trie_copy(struct nodeInfo *node, struct nodeInfo *parent);
+
 /**
 	Wstawia do drzewa słowo.
+	Nowe słowo ma częstość DEFAULT_FREQUENCY.
 	@param[in] node Korzeń drzewa.
 	@param[in] word Wstawiane słowo.
 	@param[in, out] alphabet Alfabet słownika.
@@ -75,6 +128,14 @@ int trie_insert(struct nodeInfo *node, const wchar_t *word, vector *alphabet);
  */
 bool trie_find(struct nodeInfo *node, const wchar_t *word);
 
+/**
+	Szuka węzła kończącego dane słowo.
+	@param[in] node Korzeń drzewa.
+	@param[in] word Szukane słowo.
+	@return Węzeł kończący słowo, NULL jeśli słowa nie ma w drzewie.
+ */
+struct nodeInfo *trie_find_word(struct nodeInfo *node, const wchar_t *word);
+
 /**
 	Usuwa ścieżkę dla danego słowa.
 	Należy wywoływać, jeżeli uprzednio wywolane trie_find zwróciło 1
@@ -87,13 +148,29 @@ void trie_clear_path(struct nodeInfo *node, const wchar_t *word, int *i, int *su
 
 /**
 	Przechodzi przez słownik DFSem.
-	Zapisuje dane do pliku.
+	Zapisuje dane do pliku. Za literą prowadzącą do węzła kończącego
+	słowo zapisywana jest dziesiętnie częstość słowa.
 	@param[in] node Obecnie przerabiany węzeł.
 	@param[in] stream Plik, do którego zapisywany jest słownik.
-	@return 0 jeżeli zapisanie się powiedzie, -1 w p.p.
+	@return 0 jeżeli zapisanie się powiedzie, -1 w p.p., także wtedy,
+	gdy nie udało się wczytać któregoś poddrzewa, patrz trie_load_failed().
  */
 int trie_dfs_save(struct nodeInfo *node, FILE* stream);
 
+/**
+	Zapisuje drzewo w tym samym formacie co trie_dfs_save().
+	Poddrzewa dzieci korzenia są zapisywane równolegle do buforów
+	w pamięci, a następnie kolejno wypisywane do pliku.
+	Opcjonalnie za zapisem korzenia dopisywana jest tablica przesunięć
+	poddrzew, z której korzysta trie_image_load_parallel().
+	@param[in] root Korzeń drzewa.
+	@param[in,out] stream Plik, do którego zapisywany jest słownik.
+	@param[in] offsets Czy dopisać tablicę przesunięć poddrzew.
+	@return 0 jeżeli zapisanie się powiedzie, -1 w p.p., także wtedy,
+	gdy nie udało się wczytać któregoś poddrzewa.
+ */
+int trie_parallel_save(struct nodeInfo *root, FILE *stream, bool offsets);
+
 /**
 	Wczytuje słownik z pliku.
 	@param[in] node Węzeł poprzedzający wczytywaną literkę.
@@ -102,5 +179,106 @@ int trie_dfs_save(struct nodeInfo *node, FILE* stream);
  */
 void trie_dfs_load(struct nodeInfo *node, FILE *stream, wchar_t last);
 
+/**
+	Wczytuje dzieci węzła z obrazu pliku słownika w pamięci.
+	Format jest taki sam jak w trie_dfs_save(), bez początkowego numeru korzenia.
+	Węzły położone głębiej niż depth poziomów pod node nie są tworzone:
+	ich zapis jest pomijany, a węzły na granicy dostają trie_pending,
+	dzięki któremu zostaną wczytane przy pierwszym użyciu.
+	Obraz musi pozostać w pamięci aż do usunięcia drzewa.
+	@param[in,out] node Węzeł, którego dzieci wczytujemy.
+	@param[in] text Początek zapisu dzieci węzła.
+	@param[in] end Koniec obrazu pliku.
+	@param[in] depth Liczba wczytywanych poziomów, 0 oznacza całe poddrzewo.
+	@return Wskaźnik za zapisem poddrzewa, NULL jeśli zapis jest niepoprawny.
+ */
+const char *trie_image_load(struct nodeInfo *node, const char *text,
+		const char *end, int depth);
+
+/**
+	Wczytuje dzieci korzenia tak jak trie_image_load().
+	Jeśli obraz kończy się tablicą przesunięć poddrzew zapisaną przez
+	trie_parallel_save(), poddrzewa dzieci korzenia są wczytywane równolegle.
+	@param[in,out] node Korzeń drzewa.
+	@param[in] text Początek zapisu dzieci korzenia.
+	@param[in] end Koniec obrazu pliku.
+	@param[in] depth Liczba wczytywanych poziomów, 0 oznacza całe poddrzewo.
+	@return Wskaźnik za zapisem drzewa, NULL jeśli zapis jest niepoprawny.
+ */
+const char *trie_image_load_parallel(struct nodeInfo *node, const char *text,
+		const char *end, int depth);
+
+/**
+	Zwraca dzieci węzła, w razie potrzeby wczytując je z obrazu pliku.
+	Wszystkie odwołania do dzieci węzła, które mogą dotrzeć do
+	niewczytanej części drzewa, powinny przechodzić przez tę funkcję.
+	Można ją wywoływać równocześnie z wielu wątków.
+	Jeśli zapis dzieci jest niepoprawny, zwracany vector jest pusty,
+	a węzeł zachowuje trie_pending oznaczone jako błędne, patrz
+	trie_load_failed().
+	@param[in,out] node Węzeł drzewa.
+	@return Vector dzieci węzła.
+ */
+vector *trie_children(struct nodeInfo *node);
+
+/**
+	Sprawdza, czy nie udało się wczytać dzieci węzła z obrazu pliku.
+	Ma sens po wywołaniu trie_children() dla tego węzła.
+	@param[in] node Węzeł drzewa.
+	@return true jeśli zapis dzieci węzła był niepoprawny, false w p.p.
+ */
+bool trie_load_failed(const struct nodeInfo *node);
+
+/**
+	Wyznacza ograniczenia poddrzewa węzła z ograniczeń jego dzieci.
+	Nie wczytuje niewczytanych dzieci, wtedy ograniczenia są nieznane.
+	@param[in,out] node Węzeł drzewa.
+ */
+void trie_update_bounds(struct nodeInfo *node);
+
+/**
+	Inicjuje budowniczego drzewa.
+	@param[in,out] builder Budowniczy.
+	@param[in] root Korzeń budowanego drzewa, bez dzieci.
+ */
+void trie_builder_init(struct trie_builder *builder, struct nodeInfo *root);
+
+/**
+	Dodaje do drzewa kolejne słowo.
+	Słowo musi być większe od poprzednio dodanego.
+	@param[in,out] builder Budowniczy.
+	@param[in] word Dodawane słowo.
+	@param[in] len Długość słowa.
+	@param[in] frequency Częstość słowa.
+ */
+void trie_builder_add(struct trie_builder *builder, const wchar_t *word,
+		size_t len, uint32_t frequency);
+
+/**
+	Kończy budowanie drzewa, zwalnia pamięć budowniczego.
+	@param[in,out] builder Budowniczy.
+ */
+void trie_builder_done(struct trie_builder *builder);
+
+/**
+	Wczytuje wszystkie niewczytane poddrzewa.
+	Jeśli się to uda, drzewo nie odwołuje się już do obrazu pliku.
+	@param[in,out] node Korzeń drzewa.
+	@return 0 jeśli wczytano wszystko, -1 jeśli zapis któregoś poddrzewa
+	jest niepoprawny.
+ */
+int trie_load_all(struct nodeInfo *node);
+
+/**
+	Zlicza pamięć zajmowaną przez drzewo.
+	Nie wczytuje niewczytanych poddrzew.
+	@param[in] node Korzeń drzewa.
+	@param[in,out] nodes Zwiększane o liczbę wczytanych węzłów.
+	@param[in,out] pending Zwiększane o liczbę niewczytanych poddrzew.
+	@param[in,out] bytes Zwiększane o przybliżoną liczbę zajętych bajtów.
+ */
+void trie_stats(struct nodeInfo *node, size_t *nodes, size_t *pending,
+		size_t *bytes);
+
 
 #endif /* TRIE_H_ */
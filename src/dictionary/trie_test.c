@@ -14,6 +14,7 @@
 #include <setjmp.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <cmocka.h>
 #include "trie.h"
 
@@ -254,6 +255,150 @@ static void trie_dfs_save_test(void **state)
 	trie_dfs_save(node, stderr);
 }
 
+/// Sprawdza wczytywanie z obrazu pliku, w tym leniwe wczytywanie poddrzew.
+static void trie_image_load_test(void **state)
+{
+	const char image[] = "abrakadabra1###########cat1###te1st1#####";
+	const char *end = image + sizeof(image) - 1;
+	struct nodeInfo *node = trie_create_nodeInfo(ROOT, NULL);
+	assert_true(trie_image_load(node, image, end, 1) == end);
+	assert_int_equal(size(node->children), 3);
+	size_t nodes = 0, pending = 0, bytes = 0;
+	trie_stats(node, &nodes, &pending, &bytes);
+	assert_int_equal(nodes, 4);
+	assert_int_equal(pending, 3);
+	assert_true(trie_find(node, forth));
+	assert_true(trie_find(node, second));
+	assert_false(trie_find(node, first));
+	nodes = pending = bytes = 0;
+	trie_stats(node, &nodes, &pending, &bytes);
+	assert_int_equal(pending, 1);
+	trie_load_all(node);
+	assert_true(trie_find(node, third));
+	trie_clear(node);
+	node = trie_create_nodeInfo(ROOT, NULL);
+	assert_null(trie_image_load(node, image, image + 10, 0));
+	trie_clear(node);
+}
+
+/// Sprawdza, czy niepoprawne poddrzewo nie jest traktowane jak puste.
+static void trie_image_load_failed_test(void **state)
+{
+	char image[] = "abrakadabra1###########cat1###te1st1#####";
+	const char *end = image + sizeof(image) - 1;
+	struct nodeInfo *node = trie_create_nodeInfo(ROOT, NULL);
+	assert_true(trie_image_load(node, image, end, 1) == end);
+	// Zapis poddrzewa litery a nie ma już końca dzieci.
+	memset(image + 1, 'x', sizeof(image) - 2);
+	struct nodeInfo *child = at(node->children, L'a')->node;
+	assert_int_equal(size(trie_children(child)), 0);
+	assert_true(trie_load_failed(child));
+	assert_int_equal(size(trie_children(child)), 0);
+	assert_int_equal(trie_load_all(node), -1);
+	char *buf;
+	size_t len;
+	FILE *stream = open_memstream(&buf, &len);
+	assert_int_equal(trie_parallel_save(node, stream, false), -1);
+	fclose(stream);
+	free(buf);
+	trie_clear(node);
+}
+
+/// Sprawdza, czy kopia poddrzewa, także niewczytanego, jest od niego niezależna.
+static void trie_copy_test(void **state)
+{
+	struct nodeInfo *node = *state;
+	const char expected[] = "0abrakadabra1###########cat1###test1#####";
+	struct nodeInfo *copy = trie_copy(node, NULL);
+	assert_true(trie_insert(copy, first, alphabet));
+	assert_false(trie_find(node, first));
+	char *buf;
+	size_t len;
+	FILE *stream = open_memstream(&buf, &len);
+	assert_int_equal(trie_parallel_save(node, stream, false), 0);
+	fclose(stream);
+	assert_string_equal(buf, expected);
+	free(buf);
+	trie_clear(copy);
+	char image[] = "abrakadabra1###########cat1###te1st1#####";
+	const char *end = image + sizeof(image) - 1;
+	struct nodeInfo *lazy = trie_create_nodeInfo(ROOT, NULL);
+	assert_true(trie_image_load(lazy, image, end, 1) == end);
+	copy = trie_copy(lazy, NULL);
+	// Kopia wczytuje poddrzewa z tego samego obrazu, niezależnie od oryginału.
+	assert_non_null(at(copy->children, L'c')->node->pending);
+	assert_true(trie_find(copy, forth));
+	assert_int_equal(trie_load_all(lazy), 0);
+	stream = open_memstream(&buf, &len);
+	assert_int_equal(trie_parallel_save(copy, stream, false), 0);
+	fclose(stream);
+	assert_string_equal(buf + 1, image);
+	free(buf);
+	trie_clear(copy);
+	trie_clear(lazy);
+}
+
+/// Sprawdza równoległy zapis i wczytywanie z tablicą przesunięć poddrzew.
+static void trie_parallel_save_test(void **state)
+{
+	struct nodeInfo *node = *state;
+	const char expected[] = "0abrakadabra1###########cat1###test1#####";
+	char *buf;
+	size_t len;
+	FILE *stream = open_memstream(&buf, &len);
+	assert_int_equal(trie_parallel_save(node, stream, false), 0);
+	fclose(stream);
+	assert_string_equal(buf, expected);
+	free(buf);
+	stream = open_memstream(&buf, &len);
+	assert_int_equal(trie_parallel_save(node, stream, true), 0);
+	fclose(stream);
+	assert_string_equal(buf + sizeof(expected) - 1, "@3 0 23 30 39\n");
+	assert_true(trie_find(node, test));
+	struct nodeInfo *loaded = trie_create_nodeInfo(ROOT, NULL);
+	assert_true(trie_image_load_parallel(loaded, buf + 1, buf + len, 0)
+			== buf + sizeof(expected) - 1);
+	assert_int_equal(size(loaded->children), 3);
+	assert_true(trie_find(loaded, test));
+	assert_true(trie_find(loaded, third));
+	assert_true(trie_find(loaded, forth));
+	assert_false(trie_find(loaded, second));
+	trie_clear(loaded);
+	free(buf);
+}
+
+/// Sprawdza ograniczenia poddrzew po wstawieniu, usunięciu i wczytaniu słów.
+static void trie_bounds_test(void **state)
+{
+	struct nodeInfo *node = *state;
+	assert_int_equal(node->min_depth, 3);
+	assert_int_equal(node->max_depth, 11);
+	assert_true(node->letters & TRIE_LETTER(L'k'));
+	assert_false(node->letters & TRIE_LETTER(L'z'));
+	struct nodeInfo *child = at(node->children, L't')->node;
+	assert_int_equal(child->min_depth, 3);
+	assert_int_equal(child->max_depth, 3);
+	assert_false(child->letters & TRIE_LETTER(L'a'));
+	int pos = 0;
+	int success = 0;
+	trie_clear_path(node, forth, &pos, &success);
+	assert_int_equal(node->min_depth, 4);
+	assert_false(node->letters & TRIE_LETTER(L'c'));
+	const char image[] = "abrakadabra1###########cat1###te1st1#####";
+	const char *end = image + sizeof(image) - 1;
+	struct nodeInfo *loaded = trie_create_nodeInfo(ROOT, NULL);
+	assert_true(trie_image_load_parallel(loaded, image, end, 1) == end);
+	child = at(loaded->children, L't')->node;
+	assert_int_equal(child->max_depth, TRIE_UNBOUNDED);
+	assert_int_equal(loaded->min_depth, 1);
+	assert_int_equal(loaded->max_depth, TRIE_UNBOUNDED);
+	trie_load_all(loaded);
+	child = at(child->children, L'e')->node;
+	assert_int_equal(child->min_depth, 0);
+	assert_int_equal(child->max_depth, 2);
+	trie_clear(loaded);
+}
+
 /// Wywołuje testy.
 int main(void)
 {
@@ -262,12 +407,19 @@ int main(void)
 		cmocka_unit_test(trie_insert_test),
 		cmocka_unit_test(trie_delete_node_test),
 		cmocka_unit_test(trie_dfs_load_test),
+		cmocka_unit_test(trie_image_load_test),
+		cmocka_unit_test(trie_image_load_failed_test),
 		cmocka_unit_test_setup_teardown(trie_clear_path_test, trie_setup,
 										trie_teardown),
 		cmocka_unit_test_setup_teardown(trie_clear_test, trie_setup, trie_teardown),
 		cmocka_unit_test_setup_teardown(trie_find_test, trie_setup, trie_teardown),
 		cmocka_unit_test_setup_teardown(trie_dfs_save_test, trie_setup,
 										trie_teardown),
+		cmocka_unit_test_setup_teardown(trie_copy_test, trie_setup, trie_teardown),
+		cmocka_unit_test_setup_teardown(trie_parallel_save_test, trie_setup,
+										trie_teardown),
+		cmocka_unit_test_setup_teardown(trie_bounds_test, trie_setup,
+										trie_teardown),
 	};
 
 	return cmocka_run_group_tests(tests, NULL, NULL);
@@ -14,66 +14,331 @@
 #include <string.h>
 #include <assert.h>
 
+#define HASH_OFFSET	2166136261u	///< Początkowa wartość skrótu FNV-1a.
+#define HASH_PRIME	16777619u	///< Mnożnik skrótu FNV-1a.
 
-/** @name Elementy interfejsu
+/** @name Funkcje pomocnicze
  @{
  */
 
-void word_list_init(struct word_list *list)
+/**
+ Liczy skrót słowa (FNV-1a).
+ @param[in] word Słowo.
+ @return Skrót.
+ */
+static uint32_t word_hash(const wchar_t *word)
 {
-	list->size = 0;
-	list->max_size = WORD_LIST_MAX_WORDS;
-	list->array = (const wchar_t **) malloc(sizeof(wchar_t *) * WORD_LIST_MAX_WORDS);
+	uint32_t hash = HASH_OFFSET;
+	for (; *word != L'\0'; word++)
+	{
+		hash ^= (uint32_t) *word;
+		hash *= HASH_PRIME;
+	}
+	return hash;
 }
 
-void word_list_done(struct word_list *list)
+/**
+ Porównuje słowo z wpisem zbieracza.
+ @param[in] cost Koszt słowa.
+ @param[in] rank Ranga słowa.
+ @param[in] word Słowo.
+ @param[in] entry Wpis.
+ @return <0 jeśli słowo jest lepsze od wpisu, 0 jeśli są równe, >0 w p.p.
+ */
+static int entry_compare_word(int cost, uint32_t rank, const wchar_t *word,
+		const struct word_entry *entry)
 {
-	 for (int i = 0; i < list->size; i++)
-		 free((void *)list->array[i]);
-	 free((void *)list->array);
-	 list->size = 0;
-	 list->max_size = 0;
+	if (cost != entry->cost)
+		return cost < entry->cost ? -1 : 1;
+	if (rank != entry->rank)
+		return rank > entry->rank ? -1 : 1;
+	return wcscoll(word, entry->word);
+}
+
+/**
+ Porównuje wpisy zbieracza, słowa według kluczy.
+ @param[in] a Pierwszy wpis.
+ @param[in] b Drugi wpis.
+ @return <0 jeśli a jest lepszy od b, 0 jeśli są równe, >0 w p.p.
+ */
+static int entry_compare(const struct word_entry *a, const struct word_entry *b)
+{
+	if (a->cost != b->cost)
+		return a->cost < b->cost ? -1 : 1;
+	if (a->rank != b->rank)
+		return a->rank > b->rank ? -1 : 1;
+	return wcscmp(a->key, b->key);
+}
+
+/**
+ Porównuje wpisy od najlepszego, dla qsort().
+ @param[in] a Wskaźnik na pierwszy wpis.
+ @param[in] b Wskaźnik na drugi wpis.
+ @return <0 jeśli pierwszy wpis jest lepszy, 0 jeśli są równe, >0 w p.p.
+ */
+static int entry_rank_compare(const void *a, const void *b)
+{
+	return entry_compare(*(struct word_entry * const *) a,
+			*(struct word_entry * const *) b);
+}
+
+/**
+ Porównuje wpisy według kluczy, dla qsort().
+ @param[in] a Wskaźnik na pierwszy wpis.
+ @param[in] b Wskaźnik na drugi wpis.
+ @return Wynik porównania jak w wcscoll() dla słów wpisów.
+ */
+static int entry_key_compare(const void *a, const void *b)
+{
+	return wcscmp((*(struct word_entry * const *) a)->key,
+			(*(struct word_entry * const *) b)->key);
+}
+
+/**
+ Kopiuje słowo razem z jego kluczem wcsxfrm do nowego bloku pamięci.
+ @param[in] word Słowo.
+ @param[out] key Klucz słowa w tym samym bloku.
+ @return Kopia słowa, NULL jeśli zabrakło pamięci.
+ */
+static wchar_t *entry_block(const wchar_t *word, const wchar_t **key)
+{
+	size_t len = wcslen(word);
+	size_t key_len = wcsxfrm(NULL, word, 0);
+	wchar_t *block = malloc(sizeof(wchar_t) * (len + key_len + 2));
+	if (block == NULL)
+		return NULL;
+	wmemcpy(block, word, len + 1);
+	wcsxfrm(block + len + 1, word, key_len + 1);
+	*key = block + len + 1;
+	return block;
+}
+
+/**
+ Zamienia miejscami dwa wpisy kopca.
+ @param[in,out] collector Zbieracz.
+ @param[in] i Pozycja pierwszego wpisu.
+ @param[in] j Pozycja drugiego wpisu.
+ */
+static void heap_swap(struct word_collector *collector, size_t i, size_t j)
+{
+	struct word_entry *entry = collector->heap[i];
+	collector->heap[i] = collector->heap[j];
+	collector->heap[j] = entry;
+	collector->heap[i]->heap_pos = i;
+	collector->heap[j]->heap_pos = j;
+}
+
+/**
+ Przesuwa wpis w stronę szczytu kopca, dopóki jest gorszy od rodzica.
+ @param[in,out] collector Zbieracz.
+ @param[in] i Pozycja wpisu.
+ */
+static void heap_up(struct word_collector *collector, size_t i)
+{
+	while (i > 0 && entry_compare(collector->heap[(i - 1) / 2],
+			collector->heap[i]) < 0)
+	{
+		heap_swap(collector, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+/**
+ Przesuwa wpis w stronę liści kopca, dopóki któreś z dzieci jest od niego gorsze.
+ @param[in,out] collector Zbieracz.
+ @param[in] i Pozycja wpisu.
+ */
+static void heap_down(struct word_collector *collector, size_t i)
+{
+	while (2 * i + 1 < collector->size)
+	{
+		size_t worst = 2 * i + 1;
+		if (worst + 1 < collector->size && entry_compare(collector->heap[worst + 1],
+				collector->heap[worst]) > 0)
+			worst++;
+		if (entry_compare(collector->heap[worst], collector->heap[i]) <= 0)
+			return;
+		heap_swap(collector, i, worst);
+		i = worst;
+	}
+}
+
+/**
+ Szuka słowa w tablicy skrótów zbieracza.
+ @param[in] collector Zbieracz.
+ @param[in] word Słowo.
+ @param[in] hash Skrót słowa.
+ @return Miejsce w tablicy z wpisem słowa albo wolne miejsce, gdzie powinien się znaleźć.
+ */
+static size_t table_find(const struct word_collector *collector,
+		const wchar_t *word, uint32_t hash)
+{
+	size_t mask = collector->capacity - 1;
+	size_t pos = hash & mask;
+	while (collector->table[pos] != 0)
+	{
+		const struct word_entry *entry = &collector->entries[collector->table[pos] - 1];
+		if (entry->hash == hash && wcscmp(entry->word, word) == 0)
+			break;
+		pos = (pos + 1) & mask;
+	}
+	return pos;
+}
+
+/**
+ Usuwa wpis z tablicy skrótów, przesuwając w jego miejsce dalsze
+ wpisy tego samego ciągu, żeby dalej dało się je znaleźć.
+ @param[in,out] collector Zbieracz.
+ @param[in] pos Miejsce usuwanego wpisu.
+ */
+static void table_remove(struct word_collector *collector, size_t pos)
+{
+	size_t mask = collector->capacity - 1;
+	size_t next = pos;
+	collector->table[pos] = 0;
+	while (collector->table[next = (next + 1) & mask] != 0)
+	{
+		size_t home = collector->entries[collector->table[next] - 1].hash & mask;
+		// Wpis zostaje, jeśli jego miejsce docelowe leży cyklicznie w (pos, next].
+		if ((pos < next && pos < home && home <= next)
+				|| (pos > next && (pos < home || home <= next)))
+			continue;
+		collector->table[pos] = collector->table[next];
+		collector->table[next] = 0;
+		pos = next;
+	}
 }
 
 /**
  Powiększa podwójnie rozmiar word_list.
  @param[in] list Powiększana lista.
+ @return 1 jeśli się udało, 0 w p.p.
  */
-static void word_list_resize(struct word_list *list)
+static int word_list_resize(struct word_list *list)
 {
 	const wchar_t ** array = (const wchar_t **) realloc(list->array,
 			sizeof(wchar_t*) * list->max_size * 2);
 	if (array)
 	{
 		list->array = array;
+		array = (const wchar_t **) realloc(list->ranked,
+				sizeof(wchar_t*) * list->max_size * 2);
+	}
+	if (array)
+	{
+		list->ranked = array;
 		list->max_size = list->max_size * 2;
+		return 1;
 	}
+	return 0;
 }
 
-int word_list_add(struct word_list *list, const wchar_t *word)
+/**
+ Powiększa bufor słów listy tak, żeby zmieścił jeszcze len znaków.
+ Słowa są przenoszone do nowego bufora, a wskaźniki w tablicy słów
+ przesuwane razem z nimi.
+ @param[in,out] list Lista słów.
+ @param[in] len Liczba dopisywanych znaków.
+ @return 1 jeśli się udało, 0 w p.p.
+ */
+static int word_list_reserve(struct word_list *list, size_t len)
 {
-	if (list->size >= list->max_size)
-		word_list_resize(list);
-	size_t len = wcslen(word) + 1;
-	int i = 0;
-	int compare = 0;
-	while (i < list->size && (compare = wcscoll(list->array[i], word)) < 0)
+	if (list->pool_size + len <= list->pool_max_size)
+		return 1;
+	size_t max_size = list->pool_max_size > 0 ? list->pool_max_size :
+			WORD_LIST_POOL_SIZE;
+	while (max_size < list->pool_size + len)
+		max_size *= 2;
+	wchar_t *pool = malloc(sizeof(wchar_t) * max_size);
+	if (pool == NULL)
+		return 0;
+	wmemcpy(pool, list->pool, list->pool_size);
+	for (size_t i = 0; i < list->size; i++)
 	{
-		i++;
+		list->array[i] = pool + (list->array[i] - list->pool);
+		list->ranked[i] = pool + (list->ranked[i] - list->pool);
 	}
-	if (i < list->size && compare == 0)
-		return 1;
-	list->size++;
-	if (i != list->size - 1)
+	free(list->pool);
+	list->pool = pool;
+	list->pool_max_size = max_size;
+	return 1;
+}
+
+/**
+ Dopisuje słowo na koniec bufora listy.
+ Bufor musi mieć miejsce na len znaków.
+ @param[in,out] list Lista słów.
+ @param[in] word Słowo.
+ @param[in] len Długość słowa razem z L'\0'.
+ @return Kopia słowa w buforze.
+ */
+static const wchar_t *word_list_append(struct word_list *list,
+		const wchar_t *word, size_t len)
+{
+	wchar_t *copy = list->pool + list->pool_size;
+	wmemcpy(copy, word, len);
+	list->pool_size += len;
+	return copy;
+}
+
+/**@}*/
+
+/** @name Elementy interfejsu
+ @{
+ */
+
+void word_list_init(struct word_list *list)
+{
+	list->size = 0;
+	list->max_size = WORD_LIST_MAX_WORDS;
+	list->array = (const wchar_t **) malloc(sizeof(wchar_t *) * WORD_LIST_MAX_WORDS);
+	list->ranked = (const wchar_t **) malloc(sizeof(wchar_t *) * WORD_LIST_MAX_WORDS);
+	list->pool = NULL;
+	list->pool_size = 0;
+	list->pool_max_size = 0;
+}
+
+void word_list_done(struct word_list *list)
+{
+	 free((void *)list->array);
+	 free((void *)list->ranked);
+	 free(list->pool);
+	 list->array = NULL;
+	 list->ranked = NULL;
+	 list->pool = NULL;
+	 list->size = 0;
+	 list->max_size = 0;
+	 list->pool_size = 0;
+	 list->pool_max_size = 0;
+}
+
+int word_list_add(struct word_list *list, const wchar_t *word)
+{
+	if (list->size >= list->max_size && !word_list_resize(list))
+		return 0;
+	size_t len = wcslen(word) + 1;
+	// Szukamy binarnie pierwszego słowa nie mniejszego od word.
+	size_t low = 0;
+	size_t high = list->size;
+	while (low < high)
 	{
-		const wchar_t *inList = list->array[i];
-		for (int j = list->size - 1; j > i + 1; j--)
-			list->array[j] = list->array[j - 1];
-		if (i + 1 < list->size)
-			list->array[i + 1] = inList;
+		size_t middle = low + (high - low) / 2;
+		int compare = wcscoll(list->array[middle], word);
+		if (compare == 0)
+			return 1;
+		if (compare < 0)
+			low = middle + 1;
+		else
+			high = middle;
 	}
-	list->array[i] = malloc(sizeof(wchar_t) * len);
-	wcscpy((wchar_t *) list->array[i], word);
+	// Słowo z tej listy zostało już znalezione, więc przeniesienie
+	// bufora nie unieważni word.
+	if (!word_list_reserve(list, len))
+		return 0;
+	memmove(list->array + low + 1, list->array + low,
+			sizeof(wchar_t *) * (list->size - low));
+	list->array[low] = word_list_append(list, word, len);
+	list->ranked[list->size++] = list->array[low];
 	return 1;
 }
 
@@ -91,6 +356,158 @@ const wchar_t * const * word_list_get(const struct word_list *list)
 	return NULL;
 }
 
+const wchar_t * const * word_list_ranked(const struct word_list *list)
+{
+	if (list != NULL)
+		return list->ranked;
+	return NULL;
+}
+
+int word_collector_init(struct word_collector *collector, size_t limit)
+{
+	collector->limit = limit;
+	collector->size = 0;
+	collector->capacity = 1;
+	while (collector->capacity <= 2 * limit)
+		collector->capacity *= 2;
+	collector->entries = malloc(sizeof(struct word_entry) * (limit + 1));
+	collector->heap = malloc(sizeof(struct word_entry *) * (limit + 1));
+	collector->table = calloc(collector->capacity, sizeof(size_t));
+	if (collector->entries == NULL || collector->heap == NULL
+			|| collector->table == NULL)
+	{
+		word_collector_done(collector);
+		return -1;
+	}
+	return 0;
+}
+
+void word_collector_done(struct word_collector *collector)
+{
+	for (size_t i = 0; i < collector->size; i++)
+		free(collector->entries[i].word);
+	free(collector->entries);
+	free(collector->heap);
+	free(collector->table);
+	collector->entries = NULL;
+	collector->heap = NULL;
+	collector->table = NULL;
+	collector->size = 0;
+}
+
+bool word_collector_full(const struct word_collector *collector)
+{
+	return collector->size >= collector->limit;
+}
+
+bool word_collector_accepts(const struct word_collector *collector, int cost,
+		uint32_t rank)
+{
+	if (!word_collector_full(collector))
+		return true;
+	if (collector->limit == 0)
+		return false;
+	const struct word_entry *worst = collector->heap[0];
+	return cost < worst->cost || (cost == worst->cost && rank >= worst->rank);
+}
+
+int word_collector_add(struct word_collector *collector, const wchar_t *word,
+		int cost, uint32_t rank)
+{
+	if (collector->limit == 0)
+		return 0;
+	uint32_t hash = word_hash(word);
+	size_t pos = table_find(collector, word, hash);
+	if (collector->table[pos] != 0)
+	{
+		struct word_entry *entry = &collector->entries[collector->table[pos] - 1];
+		if (cost >= entry->cost)
+			return 0;
+		// Lepszy wpis przesuwa się w stronę liści.
+		entry->cost = cost;
+		heap_down(collector, entry->heap_pos);
+		return 1;
+	}
+	struct word_entry *entry;
+	if (!word_collector_full(collector))
+	{
+		entry = &collector->entries[collector->size];
+		entry->word = entry_block(word, &entry->key);
+		if (entry->word == NULL)
+			return -1;
+		collector->table[pos] = collector->size + 1;
+		entry->heap_pos = collector->size;
+		collector->heap[collector->size++] = entry;
+	}
+	else
+	{
+		entry = collector->heap[0];
+		if (entry_compare_word(cost, rank, word, entry) >= 0)
+			return 0;
+		const wchar_t *key;
+		wchar_t *block = entry_block(word, &key);
+		if (block == NULL)
+			return -1;
+		// Najgorszy wpis zastępujemy nowym słowem.
+		table_remove(collector, table_find(collector, entry->word, entry->hash));
+		free(entry->word);
+		entry->word = block;
+		entry->key = key;
+		collector->table[table_find(collector, word, hash)] =
+				entry - collector->entries + 1;
+	}
+	entry->cost = cost;
+	entry->rank = rank;
+	entry->hash = hash;
+	if (entry->heap_pos > 0)
+		heap_up(collector, entry->heap_pos);
+	else
+		heap_down(collector, 0);
+	return 1;
+}
+
+void word_collector_finish(struct word_collector *collector,
+		struct word_list *list)
+{
+	qsort(collector->heap, collector->size, sizeof(struct word_entry *),
+			entry_rank_compare);
+	size_t i = 0;
+	if (list->size == 0)
+	{
+		size_t len = 0;
+		for (size_t j = 0; j < collector->size; j++)
+			len += wcslen(collector->heap[j]->word) + 1;
+		while (list->max_size < collector->size && word_list_resize(list))
+			;
+		if (list->max_size >= collector->size && word_list_reserve(list, len))
+		{
+			// Słowa trafiają do bufora od najlepszego, a pozycja w kopcu
+			// zapamiętuje ich miejsce po sortowaniu według kluczy.
+			for (; i < collector->size; i++)
+			{
+				const wchar_t *word = collector->heap[i]->word;
+				list->ranked[i] = word_list_append(list, word, wcslen(word) + 1);
+				collector->heap[i]->heap_pos = i;
+			}
+			qsort(collector->heap, collector->size, sizeof(struct word_entry *),
+					entry_key_compare);
+			for (size_t j = 0; j < collector->size; j++)
+			{
+				list->array[j] = list->ranked[collector->heap[j]->heap_pos];
+				free(collector->heap[j]->word);
+			}
+			list->size = i;
+		}
+	}
+	for (; i < collector->size; i++)
+	{
+		word_list_add(list, collector->heap[i]->word);
+		free(collector->heap[i]->word);
+	}
+	collector->size = 0;
+	memset(collector->table, 0, sizeof(size_t) * collector->capacity);
+}
+
 
 /**@}*/
 
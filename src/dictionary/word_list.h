@@ -11,6 +11,8 @@
 #ifndef __WORD_LIST_H__
 #define __WORD_LIST_H__
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <wchar.h>
 
 /**
@@ -18,8 +20,17 @@
   */
 #define WORD_LIST_MAX_WORDS 32
 
+/**
+  Początkowa liczba znaków w buforze słów listy.
+  */
+#define WORD_LIST_POOL_SIZE 256
+
 /**
   Struktura przechowująca listę słów.
+  Wszystkie słowa leżą jedno za drugim w jednym buforze, do którego
+  tylko dopisujemy, a tablica słów wskazuje ich początki w porządku
+  alfabetycznym. Druga tablica wskazuje te same słowa w kolejności
+  dodania, więc słowa ze zbieracza są w niej od najlepszego.
   Należy używać funkcji operujących na strukturze,
   gdyż jej implementacja może się zmienić.
   */
@@ -27,10 +38,60 @@ struct word_list
 {
     /// Liczba słów.
     size_t size;
-    /// Maksymalna liczba znaków.
+    /// Maksymalna liczba słów.
     size_t max_size;
-    /// Tablica słów.
+    /// Tablica słów, wskaźniki do bufora.
     const wchar_t **array;
+    /// Tablica słów w kolejności dodania, wskaźniki do bufora.
+    const wchar_t **ranked;
+    /// Bufor ze słowami zakończonymi L'\0'.
+    wchar_t *pool;
+    /// Liczba zajętych znaków bufora.
+    size_t pool_size;
+    /// Rozmiar bufora w znakach.
+    size_t pool_max_size;
+};
+
+/**
+  Słowo wybrane przez zbieracz słów.
+  */
+struct word_entry
+{
+    /// Słowo, a za nim w tym samym bloku pamięci jego klucz wcsxfrm.
+    wchar_t *word;
+    /// Klucz słowa, wcscmp na kluczach porównuje jak wcscoll na słowach.
+    const wchar_t *key;
+    /// Koszt słowa, mniejszy jest lepszy.
+    int cost;
+    /// Ranga słowa przy równym koszcie, większa jest lepsza.
+    uint32_t rank;
+    /// Skrót słowa.
+    uint32_t hash;
+    /// Pozycja wpisu w kopcu.
+    size_t heap_pos;
+};
+
+/**
+  Zbieracz co najwyżej limit najlepszych słów.
+  Lepsze słowo ma mniejszy koszt, przy równym koszcie większą rangę,
+  a przy równej randze jest wcześniej w porządku wcscoll. Słowa są
+  w kopcu z najgorszym na szczycie, więc nowe słowo porównujemy tylko
+  z nim, a powtórzenia znajdujemy w tablicy skrótów.
+  */
+struct word_collector
+{
+    /// Największa liczba słów.
+    size_t limit;
+    /// Liczba słów.
+    size_t size;
+    /// Wpisy słów, limit miejsc.
+    struct word_entry *entries;
+    /// Kopiec wpisów, najgorszy na szczycie.
+    struct word_entry **heap;
+    /// Tablica skrótów z adresowaniem otwartym, indeksy wpisów + 1, 0 to wolne miejsce.
+    size_t *table;
+    /// Rozmiar tablicy skrótów, potęga dwójki większa niż 2 * limit.
+    size_t capacity;
 };
 
 /**
@@ -67,4 +128,70 @@ size_t word_list_size(const struct word_list *list);
   */
 const wchar_t * const * word_list_get(const struct word_list *list);
 
+/**
+  Zwraca tablicę słów w liście w kolejności dodania.
+  Słowa przeniesione przez word_collector_finish() są w niej od
+  najlepszego, czyli według kosztu, potem rangi, potem wcscoll.
+  @param[in] list Lista słów.
+  @return Tablica word_list_size() słów.
+  */
+const wchar_t * const * word_list_ranked(const struct word_list *list);
+
+/**
+  Inicjuje pusty zbieracz słów.
+  @param[out] collector Zbieracz.
+  @param[in] limit Największa liczba zbieranych słów.
+  @return 0 jeśli się udało, -1 jeśli zabrakło pamięci.
+  */
+int word_collector_init(struct word_collector *collector, size_t limit);
+
+/**
+  Zwalnia pamięć zbieracza razem z niewydanymi słowami.
+  @param[in,out] collector Zbieracz.
+  */
+void word_collector_done(struct word_collector *collector);
+
+/**
+  Sprawdza, czy zbieracz ma już limit słów.
+  @param[in] collector Zbieracz.
+  @return true jeśli zbieracz jest pełny, false w p.p.
+  */
+bool word_collector_full(const struct word_collector *collector);
+
+/**
+  Sprawdza, czy słowo o danym koszcie i randze może zostać wybrane.
+  Pozwala nie tworzyć słów, które i tak zostałyby odrzucone.
+  @param[in] collector Zbieracz.
+  @param[in] cost Koszt słowa.
+  @param[in] rank Ranga słowa.
+  @return false jeśli słowo na pewno zostanie odrzucone, true w p.p.
+  */
+bool word_collector_accepts(const struct word_collector *collector, int cost,
+                            uint32_t rank);
+
+/**
+  Dodaje słowo do zbieracza. Jeśli zbieracz jest pełny, to słowo
+  zastępuje najgorsze, o ile jest od niego lepsze. Powtórzone słowo
+  zostaje raz, z mniejszym kosztem. Słowo jest kopiowane.
+  @param[in,out] collector Zbieracz.
+  @param[in] word Słowo.
+  @param[in] cost Koszt słowa.
+  @param[in] rank Ranga słowa.
+  @return 1 jeśli słowo zostało wybrane, 0 jeśli je odrzucono,
+  -1 jeśli zabrakło pamięci.
+  */
+int word_collector_add(struct word_collector *collector, const wchar_t *word,
+                       int cost, uint32_t rank);
+
+/**
+  Przenosi wybrane słowa do listy i opróżnia zbieracz.
+  Słowa są dodawane od najlepszego, patrz word_list_ranked(), a porządek
+  alfabetyczny wyznaczają klucze wcsxfrm policzone przy dodaniu.
+  Do pustej listy słowa są kopiowane bez porównywania.
+  @param[in,out] collector Zbieracz.
+  @param[in,out] list Lista słów.
+  */
+void word_collector_finish(struct word_collector *collector,
+                           struct word_list *list);
+
 #endif /* __WORD_LIST_H__ */
@@ -43,6 +43,9 @@ static void word_list_add_test(void **state)
 	assert_int_equal(word_list_size(&l), 2);
 	assert_true(wcscmp(test, word_list_get(&l)[1]) == 0);
 	assert_true(wcscmp(first, word_list_get(&l)[0]) == 0);
+	// Druga tablica zachowuje kolejność dodania.
+	assert_true(wcscmp(test, word_list_ranked(&l)[0]) == 0);
+	assert_true(wcscmp(first, word_list_ranked(&l)[1]) == 0);
 	word_list_done(&l);
 }
 
@@ -130,6 +133,75 @@ static void word_list_resize_test(void **state)
 	assert_true(l->max_size == 64);
 }
 
+/// Sprawdza, czy słowa przeżywają powiększenie bufora listy.
+static void word_list_pool_test(void **state)
+{
+	struct word_list l;
+	wchar_t word[WORD_LIST_POOL_SIZE];
+	word_list_init(&l);
+	for (size_t i = 0; i < 10; i++)
+	{
+		wmemset(word, L'a' + i, WORD_LIST_POOL_SIZE - 1);
+		word[WORD_LIST_POOL_SIZE - 1 - i] = L'\0';
+		assert_int_equal(word_list_add(&l, word), 1);
+	}
+	assert_int_equal(word_list_size(&l), 10);
+	for (size_t i = 0; i < 10; i++)
+	{
+		const wchar_t *added = word_list_get(&l)[i];
+		assert_int_equal(wcslen(added), WORD_LIST_POOL_SIZE - 1 - i);
+		assert_true(added[0] == L'a' + i && added[wcslen(added) - 1] == L'a' + i);
+	}
+	assert_true(l.pool_size <= l.pool_max_size);
+	word_list_done(&l);
+}
+
+/// Sprawdza, czy zbieracz wybiera najlepsze słowa i oddaje je posortowane
+/// alfabetycznie oraz od najlepszego.
+static void word_collector_test(void **state)
+{
+	struct word_collector c;
+	struct word_list l;
+	wchar_t word[] = L"a?";
+	assert_int_equal(word_collector_init(&c, 3), 0);
+	for (wchar_t letter = L'z'; letter >= L'a'; letter--)
+	{
+		word[1] = letter;
+		word_collector_add(&c, word, letter == L'q' ? 0 : 1, letter == L'y' ? 5 : 1);
+	}
+	assert_true(word_collector_full(&c));
+	assert_false(word_collector_accepts(&c, 2, 100));
+	assert_true(word_collector_accepts(&c, 1, 1));
+	assert_true(word_collector_accepts(&c, 0, 0));
+	// Słowo już wybrane nie jest dodawane drugi raz.
+	assert_int_equal(word_collector_add(&c, L"aa", 1, 1), 0);
+	assert_int_equal(word_collector_add(&c, L"ab", 1, 1), 0);
+	word_list_init(&l);
+	word_collector_finish(&c, &l);
+	assert_int_equal(word_list_size(&l), 3);
+	assert_true(wcscmp(word_list_get(&l)[0], L"aa") == 0);
+	assert_true(wcscmp(word_list_get(&l)[1], L"aq") == 0);
+	assert_true(wcscmp(word_list_get(&l)[2], L"ay") == 0);
+	assert_true(wcscmp(word_list_ranked(&l)[0], L"aq") == 0);
+	assert_true(wcscmp(word_list_ranked(&l)[1], L"ay") == 0);
+	assert_true(wcscmp(word_list_ranked(&l)[2], L"aa") == 0);
+	assert_false(word_collector_full(&c));
+	// Do niepustej listy słowa są dodawane jak przez word_list_add().
+	assert_int_equal(word_collector_add(&c, L"ab", 2, 1), 1);
+	assert_int_equal(word_collector_add(&c, L"ab", 1, 1), 1);
+	assert_int_equal(word_collector_add(&c, L"aa", 1, 1), 1);
+	word_collector_finish(&c, &l);
+	assert_int_equal(word_list_size(&l), 4);
+	assert_true(wcscmp(word_list_get(&l)[1], L"ab") == 0);
+	assert_true(wcscmp(word_list_ranked(&l)[3], L"ab") == 0);
+	word_list_done(&l);
+	word_collector_add(&c, L"ac", 1, 1);
+	word_collector_done(&c);
+	assert_int_equal(word_collector_init(&c, 0), 0);
+	assert_int_equal(word_collector_add(&c, L"ac", 1, 1), 0);
+	word_collector_done(&c);
+}
+
 /// Wywołuje testy.
 int main(void)
 {
@@ -145,6 +217,8 @@ int main(void)
 				word_list_setup, word_list_teardown),
 		cmocka_unit_test_setup_teardown(word_list_resize_test,
 				word_list_setup, word_list_teardown),
+		cmocka_unit_test(word_list_pool_test),
+		cmocka_unit_test(word_collector_test),
 	};
 
 	return cmocka_run_group_tests(tests, NULL, NULL);
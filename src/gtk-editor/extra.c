@@ -58,6 +58,7 @@ gboolean tag_created = false;
 
 // Usuń słownik, gdy kończy się program
 void delete_dict() {
+	dictionary_save_wait();
 	if (initialised)
 		dictionary_done(dict);
 	if (lang_list != NULL)
@@ -130,7 +131,8 @@ static void WhatCheck (GtkMenuItem *item, gpointer data) {
     wchar_t **words;
 
     dictionary_hints(dict, (wchar_t *)wword, &hints);
-    words = (wchar_t **)word_list_get(&hints);
+    // Najlepsze podpowiedzi na początku
+    words = (wchar_t **)word_list_ranked(&hints);
     dialog = gtk_dialog_new_with_buttons("Korekta", NULL, 0, 
                                          GTK_STOCK_OK,
                                          GTK_RESPONSE_ACCEPT,
@@ -210,6 +212,35 @@ void load_language(GtkMenuItem *item, gpointer data) {
 	assert(dict != NULL);
 	g_print("initialised: %d\n", initialised);
 }
+// Wynik zapisu słownika w tle.
+struct save_result {
+	gchar *lang;
+	int status;
+};
+
+// Informuje o zakończeniu zapisu, wywoływana w pętli GTK.
+static gboolean save_finished(gpointer data) {
+	struct save_result *result = data;
+	if (result->status != 0)
+		g_print("Failed to save dictionary: %s\n", result->lang);
+	else
+		g_print("Saved dictionary to: %s\n", result->lang);
+	g_free(result->lang);
+	g_free(result);
+	return FALSE;
+}
+
+// Wywoływana w wątku zapisu, przekazuje zakończenie zapisu do pętli GTK.
+static void save_progress(size_t written, size_t total, bool done, int status,
+                          void *data) {
+	if (done) {
+		struct save_result *result = g_new(struct save_result, 1);
+		result->lang = data;
+		result->status = status;
+		g_idle_add(save_finished, result);
+	}
+}
+
 void save_activate(GtkMenuItem *item, gpointer data) {
 
 	if (prepare_dict() != NULL) {
@@ -227,8 +258,11 @@ void save_activate(GtkMenuItem *item, gpointer data) {
 		gtk_box_pack_start(GTK_BOX(invbox), inlabel, FALSE, FALSE, 1);
 		gtk_box_pack_start(GTK_BOX(invbox), entry, FALSE, FALSE, 1);
 		if (gtk_dialog_run(GTK_DIALOG(save)) == GTK_RESPONSE_ACCEPT) {
-			g_print("Saved dictionary to: %s\n", gtk_entry_get_text(GTK_ENTRY(entry)));
-			dictionary_save_lang(dict, gtk_entry_get_text(GTK_ENTRY(entry)));
+			gchar *lang = g_strdup(gtk_entry_get_text(GTK_ENTRY(entry)));
+			if (dictionary_save_async(dict, lang, save_progress, lang) != 0) {
+				g_print("Failed to save dictionary: %s\n", lang);
+				g_free(lang);
+			}
 		}
 		gtk_widget_destroy(save);
 	}
@@ -92,9 +92,9 @@ static wchar_t my_insert(vector *vec, vectorItem *node)
 			return '\0';
 		i++;
 	}
-	vec->size++;
-	if (vec->size == vec->limit)
+	if (vec->size + 1 >= vec->limit)
 		resize(vec, vec->limit * 2);
+	vec->size++;
 	if (pos != vec->size - 1)
 	{
 		vectorItem *vItm = vec->tab[pos];
@@ -216,6 +216,12 @@ vector * delete_all(vector *vec)
 	return vec;
 }
 
+void reserve(vector *vec, int limit)
+{
+	if (vec->tab == NULL || limit > vec->limit)
+		resize(vec, limit > vec->limit ? limit : vec->limit);
+}
+
 int size(vector *vec)
 {
 	return (vec->size);
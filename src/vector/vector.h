@@ -96,6 +96,14 @@ int delete(vector *vec, wchar_t c);
  */
 vector * delete_all(vector *vec);
 
+/**
+	Rezerwuje miejsce na co najmniej limit elementów.
+	Pozwala uniknąć wielokrotnego powiększania przy znanej liczbie elementów.
+	@param[in] vec Używany vector.
+	@param[in] limit Oczekiwana liczba elementów.
+ */
+void reserve(vector *vec, int limit);
+
 /**
 	Zwraca liczbę elementów w vectorze.
 	@return Liczba elementów w vectorze.